@@ -1,7 +1,9 @@
 
 #include "lib/mParser.h"
 #include "lib/ASTNodes.h" 
+#include "lib/flatAST.h"
 #include "lib/lex.h"
+#include "lib/optimizer.h"
 #include <iostream>
 #include <string>
 #include <unordered_map>
@@ -24,15 +26,15 @@ void formatCallNode(std::ostream& os, const CallNode* node, int indent, bool isO
 void formatArrayLiteralNode(std::ostream& os, const ArrayLiteralNode* node, int indent, bool isOutermost);
 void formatArrayLookupNode(std::ostream& os, const ArrayLookupNode* node, int indent, bool isOutermost);
 
-Value evaluateVariable(const VariableNode* variableNode, std::shared_ptr<Scope> currentScope);
-Value evaluateBinaryOperation(const BinaryOpNode* binaryOpNode, std::shared_ptr<Scope> currentScope);
-Value evaluateAssignment(const AssignmentNode* assignmentNode, std::shared_ptr<Scope> currentScope);
-Value evaluateExpression(const ASTNode* node, std::shared_ptr<Scope> currentScope);
-Value evaluateFunctionCall(const CallNode* callNode, std::shared_ptr<Scope> currentScope);
+Value evaluateVariable(const FlatAST& ast, FlatIndex node, std::shared_ptr<Scope> currentScope);
+Value evaluateBinaryOperation(const FlatAST& ast, FlatIndex node, std::shared_ptr<Scope> currentScope);
+Value evaluateAssignment(const FlatAST& ast, FlatIndex node, std::shared_ptr<Scope> currentScope);
+Value evaluateExpression(const FlatAST& ast, FlatIndex node, std::shared_ptr<Scope> currentScope);
+Value evaluateFunctionCall(const FlatAST& ast, FlatIndex node, std::shared_ptr<Scope> currentScope);
 
-Value lenFunction(const std::vector<Value>& args);
-Value popFunction(std::vector<Value>& args);
-Value pushFunction(std::vector<Value>& args);
+Value lenFunction(Value* args, size_t count);
+Value popFunction(Value* args, size_t count);
+Value pushFunction(Value* args, size_t count);
 
 std::shared_ptr<Scope> globalScope = std::make_shared<Scope>();
 
@@ -50,14 +52,14 @@ void formatNullNode(std::ostream& os, const NullNode* node, int indent) {
 void formatBinaryOpNode(std::ostream& os, const BinaryOpNode* node, int indent) {
     os << '(';
     formatAST(os, node->left, 0, false);
-    os << ' ' << node->op.value << ' ';
+    os << ' ' << node->op.text() << ' ';
     formatAST(os, node->right, 0, false);
     os << ')';
 }
 
 // function to format numbers (especially doubles)
 void formatNumberNode(std::ostream& os, const NumberNode* node, int indent) {
-    double value = std::stod(node->value.value);
+    double value = node->value.number();
     double intPart;
     double fracPart = modf(value, &intPart);
     
@@ -91,12 +93,12 @@ void formatNumberNode(std::ostream& os, const NumberNode* node, int indent) {
 
 // function to format Booleans
 void formatBooleanNode(std::ostream& os, const BooleanNode* node, int indent) {
-    os << indentString(indent) << node->value.value;
+    os << indentString(indent) << node->value.text();
 }
 
 // function to format Variables
 void formatVariableNode(std::ostream& os, const VariableNode* node, int indent) {
-    os << indentString(indent) << node->identifier.value;
+    os << indentString(indent) << node->identifier.text();
 }
 
 // function to format assignment nodes
@@ -179,9 +181,9 @@ void formatCallNode(std::ostream& os, const CallNode* node, int indent, bool isO
 
 // Function to format FunctionNode (function definitions)
 void formatFunctionNode(std::ostream& os, const FunctionNode* node, int indent) {
-    os << indentString(indent) << "def " << node->name.value << "(";
+    os << indentString(indent) << "def " << node->name.text() << "(";
     for (size_t i = 0; i < node->parameters.size(); ++i) {
-        os << node->parameters[i].value;
+        os << node->parameters[i].text();
         if (i < node->parameters.size() - 1) {
             os << ", ";
         }
@@ -249,13 +251,22 @@ void printValue(const Value& value) {
     }
 }
 
-// Format and evaluate the Abstract Syntax Tree (AST)
-void formatAndEvaluateAST(const std::unique_ptr<ASTNode>& ast, std::shared_ptr<Scope> scope) {
+// Format, optimize and evaluate the Abstract Syntax Tree (AST)
+// The input is echoed as written unless dumpAST asks for the optimized tree
+void formatAndEvaluateAST(std::unique_ptr<ASTNode>& ast, std::shared_ptr<Scope> scope, bool dumpAST) {
     std::ostringstream formattedOutput;
-    formatAST(formattedOutput, ast, 0, true);
+    if (!dumpAST) {
+        formatAST(formattedOutput, ast, 0, true);
+    }
+    optimizeAST(ast);
+    if (dumpAST) {
+        formatAST(formattedOutput, ast, 0, true);
+    }
     std::cout << formattedOutput.str() << std::endl;
     try {
-        Value result = evaluateExpression(ast.get(), scope);
+        // The evaluator walks the flat encoding of the optimized tree
+        FlatAST flat(ast.get());
+        Value result = evaluateExpression(flat, flat.root(), scope);
         printValue(result);
         std::cout << std::endl;
     } catch (const std::exception& e) {
@@ -264,37 +275,31 @@ void formatAndEvaluateAST(const std::unique_ptr<ASTNode>& ast, std::shared_ptr<S
 }
 
 // Evaluate normal Expressions
-Value evaluateExpression(const ASTNode* node, std::shared_ptr<Scope> currentScope) {
-    if (!node) {
+Value evaluateExpression(const FlatAST& ast, FlatIndex node, std::shared_ptr<Scope> currentScope) {
+    if (node == NO_NODE) {
         throw std::runtime_error("Null expression node");
     }
     try {
-        switch (node->getType()) {
+        switch (ast.type(node)) {
             case ASTNode::Type::NumberNode: {
-                auto numberNode = static_cast<const NumberNode*>(node);
-                return Value(std::stod(numberNode->value.value));
+                return Value(ast.number(node));
             }
             case ASTNode::Type::BooleanNode: {
-                auto booleanNode = static_cast<const BooleanNode*>(node);
-                return Value(booleanNode->value.type == TokenType::BOOLEAN_TRUE);
+                return Value(ast.op(node) == TokenType::BOOLEAN_TRUE);
             }
             case ASTNode::Type::VariableNode: {
-                auto variableNode = static_cast<const VariableNode*>(node);
-                return evaluateVariable(variableNode, currentScope);
+                return evaluateVariable(ast, node, currentScope);
             }
             case ASTNode::Type::BinaryOpNode: {
-                auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
-                return evaluateBinaryOperation(binaryOpNode, currentScope);
+                return evaluateBinaryOperation(ast, node, currentScope);
             }
             case ASTNode::Type::AssignmentNode: {
-                auto assignmentNode = static_cast<const AssignmentNode*>(node);
-                return evaluateAssignment(assignmentNode, currentScope);
+                return evaluateAssignment(ast, node, currentScope);
             }
             case ASTNode::Type::BlockNode: {
-                auto blockNode = static_cast<const BlockNode*>(node);
                 Value lastValue;
-                for (const auto& stmt : blockNode->statements) {
-                    lastValue = evaluateExpression(stmt.get(), currentScope);
+                for (size_t i = 0; i < ast.childCount(node); ++i) {
+                    lastValue = evaluateExpression(ast, ast.child(node, i), currentScope);
                 }
                 return lastValue;
             }
@@ -302,21 +307,19 @@ Value evaluateExpression(const ASTNode* node, std::shared_ptr<Scope> currentScop
                 return Value();
             }
             case ASTNode::Type::CallNode: {
-                return evaluateFunctionCall(static_cast<const CallNode*>(node), currentScope);
+                return evaluateFunctionCall(ast, node, currentScope);
             }
             case ASTNode::Type::ArrayLiteralNode: {
-                auto arrayLiteralNode = static_cast<const ArrayLiteralNode*>(node);
                 std::vector<Value> arrayValues;
-                for (const auto& element : arrayLiteralNode->elements) {
-                    Value copiedElement = evaluateExpression(element.get(), currentScope).deepCopy();
+                for (size_t i = 0; i < ast.childCount(node); ++i) {
+                    Value copiedElement = evaluateExpression(ast, ast.child(node, i), currentScope).deepCopy();
                     arrayValues.push_back(copiedElement);
                 }
                 return Value(arrayValues);
             }
             case ASTNode::Type::ArrayLookupNode: {
-                auto arrayLookupNode = static_cast<const ArrayLookupNode*>(node);
-                Value arrayValue = evaluateExpression(arrayLookupNode->array.get(), currentScope);
-                Value indexValue = evaluateExpression(arrayLookupNode->index.get(), currentScope);
+                Value arrayValue = evaluateExpression(ast, ast.child(node, 0), currentScope);
+                Value indexValue = evaluateExpression(ast, ast.child(node, 1), currentScope);
 
                 if (indexValue.getType() != Value::Type::Double) {
                     throw std::runtime_error("Runtime error: index is not a number.");
@@ -342,30 +345,30 @@ Value evaluateExpression(const ASTNode* node, std::shared_ptr<Scope> currentScop
 }
 
 // Evaluate Variables
-Value evaluateVariable(const VariableNode* variableNode, std::shared_ptr<Scope> currentScope) {
-    if (!variableNode) {
+Value evaluateVariable(const FlatAST& ast, FlatIndex node, std::shared_ptr<Scope> currentScope) {
+    if (node == NO_NODE) {
         throw std::runtime_error("Null VariableNode passed to evaluateVariable");
     }
 
-    Value* valuePtr = currentScope->getVariable(variableNode->identifier.value);
+    Value* valuePtr = currentScope->getVariable(ast.symbol(node));
     if (valuePtr) {
         return *valuePtr;
     } else {
-        throw std::runtime_error("Runtime error: unknown identifier " + variableNode->identifier.value);
+        throw std::runtime_error("Runtime error: unknown identifier " + ast.name(node));
     }
 }
 
 
 // Valuate Operations
-Value evaluateBinaryOperation(const BinaryOpNode* binaryOpNode, std::shared_ptr<Scope> currentScope) {
-    if (!binaryOpNode) {
+Value evaluateBinaryOperation(const FlatAST& ast, FlatIndex node, std::shared_ptr<Scope> currentScope) {
+    if (node == NO_NODE) {
         throw std::runtime_error("Null BinaryOpNode passed to evaluateBinaryOperation");
     }
 
-    Value left = evaluateExpression(binaryOpNode->left.get(), currentScope);
-    Value right = evaluateExpression(binaryOpNode->right.get(), currentScope);
+    Value left = evaluateExpression(ast, ast.child(node, 0), currentScope);
+    Value right = evaluateExpression(ast, ast.child(node, 1), currentScope);
 
-    switch (binaryOpNode->op.type) {
+    switch (ast.op(node)) {
         case TokenType::ADD:
             return Value(left.asDouble() + right.asDouble());
         case TokenType::SUBTRACT:
@@ -401,9 +404,8 @@ Value evaluateBinaryOperation(const BinaryOpNode* binaryOpNode, std::shared_ptr<
         case TokenType::LOGICAL_OR:
             return Value(left.asBool() || right.asBool());
         case TokenType::ASSIGN:
-            if (binaryOpNode->left->getType() == ASTNode::Type::VariableNode) {
-                const auto* variableNode = static_cast<const VariableNode*>(binaryOpNode->left.get());
-                currentScope->setVariable(variableNode->identifier.value, right);
+            if (ast.type(ast.child(node, 0)) == ASTNode::Type::VariableNode) {
+                currentScope->setVariable(ast.symbol(ast.child(node, 0)), right);
                 return right;
             } else {
                 throw std::runtime_error("Runtime error: invalid assignee.");
@@ -414,23 +416,24 @@ Value evaluateBinaryOperation(const BinaryOpNode* binaryOpNode, std::shared_ptr<
 }
 
 // Evaluate Function Calls
-Value evaluateFunctionCall(const CallNode* callNode, std::shared_ptr<Scope> currentScope) {
-    if (!callNode) {
+Value evaluateFunctionCall(const FlatAST& ast, FlatIndex node, std::shared_ptr<Scope> currentScope) {
+    if (node == NO_NODE) {
         throw std::runtime_error("Null CallNode passed to evaluateFunctionCall");
     }
 
-    auto functionName = static_cast<const VariableNode*>(callNode->callee.get())->identifier.value;
+    FlatIndex callee = ast.child(node, 0);
+    std::string functionName = ast.type(callee) == ASTNode::Type::VariableNode ? ast.name(callee) : "";
 
     std::vector<Value> evaluatedArgs;
-    for (const auto& arg : callNode->arguments) {
-        evaluatedArgs.push_back(evaluateExpression(arg.get(), currentScope));
+    for (size_t i = 1; i < ast.childCount(node); ++i) {
+        evaluatedArgs.push_back(evaluateExpression(ast, ast.child(node, i), currentScope));
     }
     if (functionName == "push") {
-        return pushFunction(evaluatedArgs);
+        return pushFunction(evaluatedArgs.data(), evaluatedArgs.size());
     } else if (functionName == "pop") {
-        return popFunction(evaluatedArgs);
+        return popFunction(evaluatedArgs.data(), evaluatedArgs.size());
     } else if (functionName == "len") {
-        return lenFunction(evaluatedArgs);
+        return lenFunction(evaluatedArgs.data(), evaluatedArgs.size());
     } else {
         throw std::runtime_error("Unknown function name: " + functionName);
     }
@@ -438,34 +441,32 @@ Value evaluateFunctionCall(const CallNode* callNode, std::shared_ptr<Scope> curr
 
 
 // Evaluate Assignments
-Value evaluateAssignment(const AssignmentNode* assignmentNode, std::shared_ptr<Scope> currentScope) {
-    if (!assignmentNode) {
+Value evaluateAssignment(const FlatAST& ast, FlatIndex node, std::shared_ptr<Scope> currentScope) {
+    if (node == NO_NODE) {
         throw std::runtime_error("Null assignment node passed to evaluateAssignment");
     }
-    Value rhsValue = evaluateExpression(assignmentNode->rhs.get(), currentScope);
+    FlatIndex lhs = ast.child(node, 0);
+    FlatIndex rhs = ast.child(node, 1);
+    Value rhsValue = evaluateExpression(ast, rhs, currentScope);
 
-    if (assignmentNode->lhs->getType() == ASTNode::Type::ArrayLookupNode &&
-        assignmentNode->rhs->getType() == ASTNode::Type::ArrayLiteralNode) {
+    if (ast.type(lhs) == ASTNode::Type::ArrayLookupNode &&
+        ast.type(rhs) == ASTNode::Type::ArrayLiteralNode) {
         return rhsValue;
     }
-    if (assignmentNode->lhs->getType() == ASTNode::Type::VariableNode) {
-        auto variableNode = static_cast<const VariableNode*>(assignmentNode->lhs.get());
-        currentScope->setVariable(variableNode->identifier.value, rhsValue);
-    } else if (assignmentNode->lhs->getType() == ASTNode::Type::ArrayLookupNode) {
-        auto arrayLookupNode = static_cast<const ArrayLookupNode*>(assignmentNode->lhs.get());
+    if (ast.type(lhs) == ASTNode::Type::VariableNode) {
+        currentScope->setVariable(ast.symbol(lhs), rhsValue);
+    } else if (ast.type(lhs) == ASTNode::Type::ArrayLookupNode) {
+        FlatIndex arrayNode = ast.child(lhs, 0);
 
-        if (arrayLookupNode->array->getType() != ASTNode::Type::VariableNode) {
+        if (ast.type(arrayNode) != ASTNode::Type::VariableNode) {
             throw std::runtime_error("Runtime error: not an array.");
         }
-        auto variableNode = static_cast<const VariableNode*>(arrayLookupNode->array.get());
-        std::string arrayName = variableNode->identifier.value;
-
-        Value* arrayValuePtr = currentScope->getVariable(arrayName);
+        Value* arrayValuePtr = currentScope->getVariable(ast.symbol(arrayNode));
         if (!arrayValuePtr || arrayValuePtr->getType() != Value::Type::Array) {
             throw std::runtime_error("Runtime error: not an array.");
         }
         std::vector<Value>& array = arrayValuePtr->asArray();
-        Value indexValue = evaluateExpression(arrayLookupNode->index.get(), currentScope);
+        Value indexValue = evaluateExpression(ast, ast.child(lhs, 1), currentScope);
         if (indexValue.getType() != Value::Type::Double) {
         throw std::runtime_error("Runtime error: index is not a number.");
         }
@@ -478,7 +479,7 @@ Value evaluateAssignment(const AssignmentNode* assignmentNode, std::shared_ptr<S
         if (index < 0 || index >= static_cast<int>(array.size())) {
             throw std::runtime_error("Runtime error: index out of bounds.");
         }
-        Value rhsValue = evaluateExpression(assignmentNode->rhs.get(), currentScope);
+        Value rhsValue = evaluateExpression(ast, rhs, currentScope);
         array[index] = rhsValue;
         return rhsValue;
     }
@@ -490,9 +491,9 @@ Value evaluateAssignment(const AssignmentNode* assignmentNode, std::shared_ptr<S
 }
 
 // Len Function of Arrays
-Value lenFunction(const std::vector<Value>& args) {
-    if (args.size() != 1){
-        if(args.size() == 0) {
+Value lenFunction(Value* args, size_t count) {
+    if (count != 1){
+        if(count == 0) {
             throw std::runtime_error("Runtime error: incorrect argument count.");
         } else if(!args[0].isArray()) {
             throw std::runtime_error("Runtime error: not an array.");
@@ -503,9 +504,9 @@ Value lenFunction(const std::vector<Value>& args) {
 }
 
 // Pop function of Arrays
-Value popFunction(std::vector<Value>& args) {
-    if (args.size() != 1){
-        if(args.size() == 0) {
+Value popFunction(Value* args, size_t count) {
+    if (count != 1){
+        if(count == 0) {
             throw std::runtime_error("Runtime error: incorrect argument count.");
         } else if(!args[0].isArray()) {
             throw std::runtime_error("Runtime error: not an array.");
@@ -522,9 +523,9 @@ Value popFunction(std::vector<Value>& args) {
 }
 
 // Push function of Arrays
-Value pushFunction(std::vector<Value>& args) {
-    if (args.size() != 2){
-        if(args.size() == 0) {
+Value pushFunction(Value* args, size_t count) {
+    if (count != 2){
+        if(count == 0) {
             throw std::runtime_error("Runtime error: incorrect argument count.");
         } else if(!args[0].isArray()) {
             throw std::runtime_error("Runtime error: not an array.");
@@ -537,14 +538,25 @@ Value pushFunction(std::vector<Value>& args) {
 
 
 
-int main() {
+int main(int argc, char* argv[]) {
     std::shared_ptr<Scope> globalScope = std::make_shared<Scope>();
+    bool dumpAST = false;
     std::string line;
     std::ostream& os = std::cout;
 
-    globalScope->setVariable("len", Value(Value::FunctionPtr(lenFunction)));
-    globalScope->setVariable("pop", Value(Value::FunctionPtr(popFunction)));
-    globalScope->setVariable("push", Value(Value::FunctionPtr(pushFunction)));
+    globalScope->setVariable(SymbolTable::intern("len"), Value(lenFunction));
+    globalScope->setVariable(SymbolTable::intern("pop"), Value(popFunction));
+    globalScope->setVariable(SymbolTable::intern("push"), Value(pushFunction));
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dump-ast") {
+            dumpAST = true;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
 
     while (true) { 
         if (!std::getline(std::cin, line)) {
@@ -564,7 +576,7 @@ int main() {
             Parser parser(tokens);
             auto ast = parser.parse();
 
-            formatAndEvaluateAST(ast, globalScope);
+            formatAndEvaluateAST(ast, globalScope, dumpAST);
         } catch (const std::exception& e) {
             os << e.what() << std::endl;
         }
@@ -24,8 +24,8 @@ int main() {
         exit(1);
     }
     for (const auto& token : tokens) {
-        if (token.value != "\\n"){
-            cout << right << setw(4) << token.line << setw(5) << token.column << setw(2) << "  " << token.value << endl;
+        if (token.text() != "\\n"){
+            cout << right << setw(4) << token.line() << setw(5) << token.column() << setw(2) << "  " << token.text() << endl;
         }
     }
 
@@ -189,10 +189,18 @@ struct BlockNode : ASTNode {
 
 
 
+/* A function body the parser has only brace-matched. It is parsed from its
+tokens when it is first needed, for a function that is never called never.*/
+struct LazyBody {
+    virtual ~LazyBody() = default;
+    virtual std::unique_ptr<ASTNode> parse() const = 0;
+};
+
 struct FunctionNode : ASTNode {
     Token name;
     std::vector<Token> parameters;
     std::unique_ptr<ASTNode> body;
+    std::shared_ptr<const LazyBody> lazyBody;   // stands in for a null body the parser skipped
 
     // Constructor
     FunctionNode(Token name, std::vector<Token> parameters, std::unique_ptr<ASTNode> body)
@@ -200,7 +208,7 @@ struct FunctionNode : ASTNode {
 
     // Copy constructor
     FunctionNode(const FunctionNode& other)
-        : ASTNode(Type::FunctionNode), name(other.name), parameters(other.parameters) {
+        : ASTNode(Type::FunctionNode), name(other.name), parameters(other.parameters), lazyBody(other.lazyBody) {
         if (other.body) {
             body = std::unique_ptr<ASTNode>(other.body->clone());
         }
@@ -211,6 +219,7 @@ struct FunctionNode : ASTNode {
             name = other.name;
             parameters = other.parameters;
             body = other.body ? std::unique_ptr<ASTNode>(other.body->clone()) : nullptr;
+            lazyBody = other.lazyBody;
         }
         return *this;
     }
@@ -0,0 +1,139 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "ScryptComponents.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Instruction set of the Scrypt virtual machine. Operands are stored in the
+// instruction itself, values flow through the VM's value stack.
+enum class OpCode : uint8_t {
+    CONSTANT,       // push constants[a]
+    NIL,            // push null
+    GET_NAME,       // push the variable names[a] from the enclosing scopes, caches[b] remembers it
+    SET_NAME,       // bind names[a] to the top of the stack (value is kept), cached in caches[b]
+    UNSET_NAME,     // drop the loop-local variable names[a] unless an enclosing scope binds it
+    GET_LOCAL,      // push local slot a, falling back to names[b] while it is unassigned
+    SET_LOCAL,      // store the top of the stack in local slot a (value is kept)
+    UNSET_LOCAL,    // drop the loop-local slot a unless names[b] exists outside
+    POP,
+    // Generic binary operators, b counts how often the site was deoptimized
+    ADD, SUBTRACT, MULTIPLY, DIVIDE, MODULO,
+    LESS, LESS_EQUAL, GREATER, GREATER_EQUAL,
+    EQUAL, NOT_EQUAL,
+    // Specializations of the operators above for two doubles, in the same order
+    ADD_DD, SUBTRACT_DD, MULTIPLY_DD, DIVIDE_DD, MODULO_DD,
+    LESS_DD, LESS_EQUAL_DD, GREATER_DD, GREATER_EQUAL_DD,
+    EQUAL_DD, NOT_EQUAL_DD,
+    // Forms the compiler emits when both operands are proven to be doubles, in the same order
+    ADD_UNCHECKED, SUBTRACT_UNCHECKED, MULTIPLY_UNCHECKED, DIVIDE_UNCHECKED, MODULO_UNCHECKED,
+    LESS_UNCHECKED, LESS_EQUAL_UNCHECKED, GREATER_UNCHECKED, GREATER_EQUAL_UNCHECKED,
+    EQUAL_UNCHECKED, NOT_EQUAL_UNCHECKED,
+    LOGICAL_AND, LOGICAL_XOR, LOGICAL_OR,
+    // Logical operators on operands proven to be bools
+    LOGICAL_AND_UNCHECKED, LOGICAL_XOR_UNCHECKED, LOGICAL_OR_UNCHECKED,
+    PRINT,
+    JUMP,           // continue at a
+    JUMP_IF_FALSE,  // pop a condition, continue at a when it is false
+    JUMP_IF_FALSE_UNCHECKED, // same for a condition proven to be a bool
+    MAKE_FUNCTION,  // push functions[a] with an environment of its own over the global scope
+    MAKE_CLOSURE,   // push functions[a] closed over a copy of the current locals, under an environment of its own if b
+    CALL,           // call the callee on top of the stack with the a arguments below it
+    TAIL_CALL,      // like CALL, but the callee replaces the current activation
+    CALL_BUILTIN,   // call builtin b with the top a values
+    RETURN,
+    RETURN_NULL,
+    ARRAY,          // build an array out of the top a values
+    INDEX,
+    SET_INDEX,      // names[a][index] = value, keeps the value
+    SET_INDEX_LOCAL,// slot a (or names[b])[index] = value, keeps the value
+    FAIL,           // raise the runtime error messages[a]
+    // Superinstructions written over the GET_LOCAL or GET_NAME that starts a
+    // common sequence, keeping its operands. The sequence stays in place behind
+    // it and runs instruction by instruction whenever an operand is not a double.
+    LOCAL_OPERATE,  // load, load or constant, binary operator
+    LOCAL_BRANCH,   // load, load or constant, comparison, JUMP_IF_FALSE
+    LOCAL_STORE,    // load, load or constant, binary operator, SET_LOCAL or SET_NAME, POP
+    NAME_OPERATE,
+    NAME_BRANCH,
+    NAME_STORE,
+    HALT
+};
+
+struct Instruction {
+    OpCode op;
+    uint32_t a;
+    uint32_t b;
+};
+
+// Binary operator sites stop specializing after this many deoptimizations
+const uint32_t MAX_DEOPTIMIZATIONS = 2;
+
+// Number of generic binary operators that have double-double forms
+const int BINARY_OPERATOR_COUNT = static_cast<int>(OpCode::ADD_DD) - static_cast<int>(OpCode::ADD);
+
+// Maps a generic binary operator to its double-double forms
+inline OpCode specializedForm(OpCode op) {
+    return static_cast<OpCode>(static_cast<int>(op) + BINARY_OPERATOR_COUNT);
+}
+
+inline OpCode uncheckedForm(OpCode op) {
+    return static_cast<OpCode>(static_cast<int>(op) + 2 * BINARY_OPERATOR_COUNT);
+}
+
+// Maps any form of a binary operator back to the generic one
+inline OpCode genericForm(OpCode op) {
+    int index = (static_cast<int>(op) - static_cast<int>(OpCode::ADD)) % BINARY_OPERATOR_COUNT;
+    return static_cast<OpCode>(static_cast<int>(OpCode::ADD) + index);
+}
+
+// Maps a superinstruction back to the load it was written over
+inline OpCode unfusedForm(OpCode op) {
+    switch (op) {
+        case OpCode::LOCAL_OPERATE:
+        case OpCode::LOCAL_BRANCH:
+        case OpCode::LOCAL_STORE:
+            return OpCode::GET_LOCAL;
+        case OpCode::NAME_OPERATE:
+        case OpCode::NAME_BRANCH:
+        case OpCode::NAME_STORE:
+            return OpCode::GET_NAME;
+        default:
+            return op;
+    }
+}
+
+/* Inline cache of a by-name instruction. The binding stays valid while the
+instruction runs against the same scope and no scope changed shape since.*/
+struct InlineCache {
+    const Scope* scope = nullptr;
+    uint64_t version = 0;
+    Value* binding = nullptr;
+};
+
+struct NativeCode;
+
+/* Compiled form of a function body (or of the whole script). A call runs in
+an activation record of locals.size() slots on the VM stack: the parameters,
+then the called closure itself, then the remaining local variables.*/
+struct Prototype {
+    std::string name;
+    std::vector<std::string> parameters;
+    std::vector<SymbolId> locals;            // interned names of the slots
+    mutable std::vector<Instruction> code;   // rewritten in place as sites specialize
+    std::vector<Value> constants;
+    std::vector<SymbolId> names;             // interned names the code looks up in scopes
+    std::vector<std::string> messages;
+    std::vector<std::shared_ptr<Prototype>> functions;
+    mutable std::vector<InlineCache> caches;
+    size_t maxStack = 0;
+    bool pure = false;                       // result depends only on the arguments
+    mutable uint32_t calls = 0;              // calls counted towards the JIT threshold
+    mutable const NativeCode* native = nullptr;
+    mutable std::function<void()> compileBody;  // set while the body waits for the first call to compile it
+};
+
+#endif // BYTECODE_H
@@ -1,28 +1,30 @@
 #ifndef SCRIPT_COMPONENTS_H
 #define SCRIPT_COMPONENTS_H
 
+#include "symbols.h"
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <exception>
 #include <memory>
 #include <vector>
-#include "ASTNodes.h"
-#include <functional>
 
 class Scope;
+struct Prototype;
 
 // Value class to represent different types of values in your script
 class Value {
 public:
-    using FunctionPtr = std::function<Value(std::vector<Value>&)>;
-    enum class Type { Double, Bool, Function, Null, Array, BuiltinFunction};
+    // Builtins receive their arguments as a span over the caller's values
+    using FunctionPtr = Value (*)(Value* args, size_t count);
+    enum class Type { Double, Bool, Function, Null, Array, BuiltinFunction, Undefined};
 
     struct Function {
-        std::shared_ptr<FunctionNode> definition; 
+        std::shared_ptr<const Prototype> definition;
         std::shared_ptr<Scope> capturedScope;
 
         Function() = default;
-        Function(const std::shared_ptr<FunctionNode>& def, const std::shared_ptr<Scope>& scope)
+        Function(const std::shared_ptr<const Prototype>& def, const std::shared_ptr<Scope>& scope)
             : definition(def), capturedScope(scope) {}
         Function(const Function& other) 
             : definition(other.definition), capturedScope(other.capturedScope) {}
@@ -62,6 +64,23 @@ public:
     bool asBool() const;
     const Function& asFunction() const;
     bool isNull() const;
+    static Value undefined();
+    bool isUndefined() const;
+
+    // Unchecked accessors for the VM's type-specialized instructions
+    bool isDouble() const { return type == Type::Double; }
+    double getDouble() const { return doubleValue; }
+    bool getBool() const { return boolValue; }
+    void setDouble(double value) {
+        if (type != Type::Double && type != Type::Bool) cleanUp();
+        type = Type::Double;
+        doubleValue = value;
+    }
+    void setBool(bool value) {
+        if (type != Type::Double && type != Type::Bool) cleanUp();
+        type = Type::Bool;
+        boolValue = value;
+    }
     bool equals(const Value& other) const;
 
     bool isArray() const;
@@ -69,7 +88,6 @@ public:
     std::vector<Value>& asArray();
     const std::vector<Value>& asArray() const;
     Value deepCopy() const;
-    Value executeFunction(std::vector<Value>& args) const;
 private:
     Type type;
     union {
@@ -77,7 +95,7 @@ private:
         bool boolValue;
         Function functionValue;
         std::shared_ptr<std::vector<Value>> arrayValue;
-        FunctionPtr builtinFunction; 
+        FunctionPtr builtinFunction;
     };
 
     void cleanUp();
@@ -88,27 +106,26 @@ private:
 class Scope {
 public:
     Scope(std::shared_ptr<Scope> parent = nullptr) : parentScope(parent) {}
+    ~Scope();
 
-    void setVariable(const std::string& name, const Value& value);
-    Value* getVariable(const std::string& name);
-    const std::unordered_map<std::string, Value>& getVariables() const;
+    void setVariable(SymbolId name, const Value& value);
+    void defineVariable(SymbolId name, const Value& value);
+    void eraseVariable(SymbolId name);
+    Value* getVariable(SymbolId name);
+    const SymbolMap<Value>& getVariables() const;
 
     std::shared_ptr<Scope> getParent() const;
     std::shared_ptr<Scope> copyScope() const;
     std::shared_ptr<Scope> deepCopy() const;
-    bool hasVariable(const std::string& name);
+    bool hasVariable(SymbolId name);
+
+    // Changes whenever any scope gains, loses or frees a binding, which may move its other bindings
+    static uint64_t getShapeVersion() { return shapeVersion; }
 
 private:
-    std::unordered_map<std::string, Value> variables;
+    SymbolMap<Value> variables;    // keyed by interned name, see symbols.h
     std::shared_ptr<Scope> parentScope;
-};
-
-// Exception class for handling return statements
-class ReturnException : public std::exception {
-    Value returnValue;
-public:
-    explicit ReturnException(Value returnValue);
-    const Value& getValue() const;
+    static uint64_t shapeVersion;
 };
 
 #endif // SCRIPT_COMPONENTS_H
\ No newline at end of file
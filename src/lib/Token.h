@@ -1,13 +1,16 @@
 
 #ifndef TOKEN_H
 #define TOKEN_H
+#include "positions.h"
+#include "symbols.h"
+#include <cstdint>
 #include <string>
 
 // Token Header File for Lexer
 
 // Enumerated Type to represent each type of tokens
 
-enum class TokenType {
+enum class TokenType : uint8_t {
     IF, WHILE, PRINT, ELSE,
     LEFT_BRACE, RIGHT_BRACE,
     LEFT_PAREN, RIGHT_PAREN,
@@ -38,15 +41,25 @@ enum class TokenType {
 };
 
 
-// Struct to represent a token
+/* Struct to represent a token, 12 bytes wide. The text lives in the
+SymbolTable, so an identifier's symbol is the ID of its name, and the line
+and column are looked up from the offset only when a diagnostic needs them.*/
 struct Token {
     TokenType type;
-    std::string value;
-    int line;
-    int column;
+    SymbolId symbol;    // interned text of the token
+    uint32_t offset;    // start of the token in the SourcePositions
 
-     Token(TokenType type, std::string value, int line, int column)
-        : type(type), value(std::move(value)), line(line), column(column) {}
+    Token(TokenType type, SymbolId symbol, uint32_t offset)
+        : type(type), symbol(symbol), offset(offset) {}
+    Token(TokenType type, const std::string& text, uint32_t offset)
+        : Token(type, SymbolTable::intern(text), offset) {}
+
+    const std::string& text() const { return SymbolTable::name(symbol); }
+    double number() const { return SymbolTable::number(symbol); }
+    int line() const { return SourcePositions::line(offset); }
+    int column() const { return SourcePositions::column(offset); }
 };
 
-#endif
\ No newline at end of file
+static_assert(sizeof(Token) == 12, "tokens are kept compact");
+
+#endif
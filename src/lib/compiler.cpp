@@ -0,0 +1,589 @@
+#include "compiler.h"
+#include "optimizer.h"
+#include <stdexcept>
+
+Compiler::Compiler(const std::vector<std::string>& builtins)
+        : state(nullptr) {
+    for (const auto& builtin : builtins) {
+        this->builtins.push_back(SymbolTable::intern(builtin));
+    }
+}
+
+Compiler::Compiler(std::vector<SymbolId> builtins)
+        : builtins(std::move(builtins)), state(nullptr) {}
+
+// Collects the variables a function body assigns, without entering nested functions
+static void collectAssigned(const ASTNode* node, std::vector<SymbolId>& names) {
+    if (!node) {
+        return;
+    }
+    switch (node->getType()) {
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            collectAssigned(binaryOpNode->left.get(), names);
+            collectAssigned(binaryOpNode->right.get(), names);
+            break;
+        }
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<const AssignmentNode*>(node);
+            if (assignmentNode->lhs->getType() == ASTNode::Type::VariableNode) {
+                names.push_back(static_cast<const VariableNode*>(assignmentNode->lhs.get())->identifier.symbol);
+            } else {
+                collectAssigned(assignmentNode->lhs.get(), names);
+            }
+            collectAssigned(assignmentNode->rhs.get(), names);
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            collectAssigned(static_cast<const PrintNode*>(node)->expression.get(), names);
+            break;
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<const IfNode*>(node);
+            collectAssigned(ifNode->condition.get(), names);
+            collectAssigned(ifNode->trueBranch.get(), names);
+            collectAssigned(ifNode->falseBranch.get(), names);
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<const WhileNode*>(node);
+            collectAssigned(whileNode->condition.get(), names);
+            collectAssigned(whileNode->body.get(), names);
+            break;
+        }
+        case ASTNode::Type::BlockNode:
+            for (const auto& stmt : static_cast<const BlockNode*>(node)->statements) {
+                collectAssigned(stmt.get(), names);
+            }
+            break;
+        case ASTNode::Type::FunctionNode:
+            names.push_back(static_cast<const FunctionNode*>(node)->name.symbol);
+            break;
+        case ASTNode::Type::ReturnNode:
+            collectAssigned(static_cast<const ReturnNode*>(node)->value.get(), names);
+            break;
+        case ASTNode::Type::CallNode: {
+            auto callNode = static_cast<const CallNode*>(node);
+            collectAssigned(callNode->callee.get(), names);
+            for (const auto& arg : callNode->arguments) {
+                collectAssigned(arg.get(), names);
+            }
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (const auto& element : static_cast<const ArrayLiteralNode*>(node)->elements) {
+                collectAssigned(element.get(), names);
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            collectAssigned(lookupNode->array.get(), names);
+            collectAssigned(lookupNode->index.get(), names);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static bool isLoad(OpCode op) {
+    return op == OpCode::GET_LOCAL || op == OpCode::GET_NAME;
+}
+
+static bool isBinaryOperator(OpCode op) {
+    return op >= OpCode::ADD && op <= OpCode::NOT_EQUAL_UNCHECKED;
+}
+
+static bool isComparison(OpCode op) {
+    return isBinaryOperator(op) && genericForm(op) >= OpCode::LESS;
+}
+
+/* Rewrites the first load of every load, load-or-constant, binary operator
+sequence into a superinstruction. The rest of the sequence is left as it is,
+so jumps into it and the VM's fallback for non-double operands still work.*/
+static void fuseSuperinstructions(Prototype& proto) {
+    std::vector<Instruction>& code = proto.code;
+    size_t pc = 0;
+    while (pc + 2 < code.size()) {
+        OpCode second = code[pc + 1].op;
+        if (!isLoad(code[pc].op) || !(isLoad(second) || second == OpCode::CONSTANT) ||
+            !isBinaryOperator(code[pc + 2].op)) {
+            ++pc;
+            continue;
+        }
+        bool local = code[pc].op == OpCode::GET_LOCAL;
+        OpCode next = pc + 3 < code.size() ? code[pc + 3].op : OpCode::HALT;
+        if ((next == OpCode::SET_LOCAL || next == OpCode::SET_NAME) &&
+            pc + 4 < code.size() && code[pc + 4].op == OpCode::POP) {
+            code[pc].op = local ? OpCode::LOCAL_STORE : OpCode::NAME_STORE;
+            pc += 5;
+        } else if ((next == OpCode::JUMP_IF_FALSE || next == OpCode::JUMP_IF_FALSE_UNCHECKED) &&
+                   isComparison(code[pc + 2].op)) {
+            code[pc].op = local ? OpCode::LOCAL_BRANCH : OpCode::NAME_BRANCH;
+            pc += 4;
+        } else {
+            code[pc].op = local ? OpCode::LOCAL_OPERATE : OpCode::NAME_OPERATE;
+            pc += 3;
+        }
+    }
+}
+
+// Compiles the top level block of a script
+std::shared_ptr<Prototype> Compiler::compile(const ASTNode* program) {
+    auto proto = std::make_shared<Prototype>();
+    proto->name = "<script>";
+
+    pureFunctions = findPureFunctions(program);
+    FunctionState script{proto.get(), true, {}, scriptDeclared, {}, 0, {}, {}};
+    state = &script;
+    script.types.analyze(program);
+    compileStatement(program);
+    emit(OpCode::HALT);
+    fuseSuperinstructions(*proto);
+    scriptDeclared = std::move(script.declared);
+    state = nullptr;
+    return proto;
+}
+
+/* Compiles a function body into its own prototype. Parameters and every
+variable the body assigns before it reads it get a slot in the activation
+record, the slot after the parameters holds the closure itself so the function
+can refer to its own name without a lookup. Variables the body may read before
+it has bound them, which find what the enclosing function or an earlier call
+left, live in the closure's environment instead. Returns whether there are
+any.*/
+bool Compiler::compileFunction(Prototype* proto, const FunctionNode* node) {
+    if (!node->body && node->lazyBody) {
+        deferFunction(proto, node);
+        return false;
+    }
+    FunctionState* enclosing = state;
+    FunctionState function{proto, false, {}, {}, {}, 0, {}, {}};
+    state = &function;
+
+    proto->name = node->name.text();
+    proto->pure = pureFunctions.count(node) > 0;
+    for (const auto& param : node->parameters) {
+        function.slots.emplace(param.symbol, static_cast<uint32_t>(proto->locals.size()));
+        proto->parameters.push_back(param.text());
+        proto->locals.push_back(param.symbol);
+        function.declared.insert(param.symbol);
+    }
+    proto->locals.push_back(node->name.symbol);
+
+    function.types.analyzeFunction(node);
+    std::vector<SymbolId> assigned;
+    collectAssigned(node->body.get(), assigned);
+    for (SymbolId identifier : assigned) {
+        if (function.types.isPersistent(SymbolTable::name(identifier))) {
+            function.persistent.insert(identifier);
+        } else if (function.slots.emplace(identifier, static_cast<uint32_t>(proto->locals.size())).second) {
+            proto->locals.push_back(identifier);
+        }
+    }
+
+    compileStatement(node->body.get());
+    emit(OpCode::RETURN_NULL);
+    fuseSuperinstructions(*proto);
+
+    state = enclosing;
+    return !function.persistent.empty();
+}
+
+/* Leaves a function whose body the parser skipped to its first call. Until
+then only its parameters are known, to check the argument count against. The
+body is parsed and optimized on its own, so calls in it are not inlined and
+the function is never taken to be pure.*/
+void Compiler::deferFunction(Prototype* proto, const FunctionNode* node) {
+    proto->name = node->name.text();
+    for (const auto& param : node->parameters) {
+        proto->parameters.push_back(param.text());
+    }
+    proto->compileBody = [proto, name = node->name, parameters = node->parameters,
+                          lazyBody = node->lazyBody, builtins = builtins]() {
+        FunctionNode function(name, parameters, lazyBody->parse());
+        optimizeBody(function);
+        proto->parameters.clear();
+        Compiler compiler(builtins);
+        compiler.compileFunction(proto, &function);
+    };
+}
+
+void Compiler::compileStatement(const ASTNode* node) {
+    switch (node->getType()) {
+        case ASTNode::Type::IfNode:
+            compileIf(static_cast<const IfNode*>(node));
+            break;
+        case ASTNode::Type::WhileNode:
+            compileWhile(static_cast<const WhileNode*>(node));
+            break;
+        case ASTNode::Type::PrintNode:
+            compileExpression(static_cast<const PrintNode*>(node)->expression.get());
+            emit(OpCode::PRINT);
+            break;
+        case ASTNode::Type::AssignmentNode:
+            compileAssignment(static_cast<const AssignmentNode*>(node));
+            emit(OpCode::POP);
+            break;
+        case ASTNode::Type::BlockNode:
+            for (const auto& stmt : static_cast<const BlockNode*>(node)->statements) {
+                compileStatement(stmt.get());
+            }
+            break;
+        case ASTNode::Type::FunctionNode: {
+            auto functionNode = static_cast<const FunctionNode*>(node);
+            auto proto = std::make_shared<Prototype>();
+            bool persistent = compileFunction(proto.get(), functionNode);
+            state->proto->functions.push_back(proto);
+            emit(state->isScript ? OpCode::MAKE_FUNCTION : OpCode::MAKE_CLOSURE,
+                 static_cast<uint32_t>(state->proto->functions.size() - 1), persistent ? 1 : 0);
+            emitSet(functionNode->name.symbol);
+            emit(OpCode::POP);
+            state->declared.insert(functionNode->name.symbol);
+            break;
+        }
+        case ASTNode::Type::ReturnNode: {
+            auto returnNode = static_cast<const ReturnNode*>(node);
+            if (returnNode->value && !state->isScript &&
+                returnNode->value->getType() == ASTNode::Type::CallNode) {
+                compileCall(static_cast<const CallNode*>(returnNode->value.get()), true);
+            } else if (returnNode->value) {
+                compileExpression(returnNode->value.get());
+                emit(OpCode::RETURN);
+            } else {
+                emit(OpCode::RETURN_NULL);
+            }
+            break;
+        }
+        case ASTNode::Type::CallNode:
+            compileCall(static_cast<const CallNode*>(node));
+            emit(OpCode::POP);
+            break;
+        default:
+            emitFail("Unknown Node Type in evaluateStatement");
+            break;
+    }
+}
+
+void Compiler::compileExpression(const ASTNode* node) {
+    if (!node) {
+        throw std::runtime_error("Null expression node");
+    }
+    switch (node->getType()) {
+        case ASTNode::Type::NumberNode:
+            emit(OpCode::CONSTANT, constant(Value(static_cast<const NumberNode*>(node)->value.number())));
+            break;
+        case ASTNode::Type::BooleanNode:
+            emit(OpCode::CONSTANT, constant(Value(static_cast<const BooleanNode*>(node)->value.type == TokenType::BOOLEAN_TRUE)));
+            break;
+        case ASTNode::Type::VariableNode:
+            emitGet(static_cast<const VariableNode*>(node)->identifier.symbol);
+            break;
+        case ASTNode::Type::BinaryOpNode:
+            compileBinaryOperation(static_cast<const BinaryOpNode*>(node));
+            break;
+        case ASTNode::Type::AssignmentNode:
+            compileAssignment(static_cast<const AssignmentNode*>(node));
+            break;
+        case ASTNode::Type::CallNode:
+            compileCall(static_cast<const CallNode*>(node));
+            break;
+        case ASTNode::Type::ArrayLiteralNode: {
+            auto arrayNode = static_cast<const ArrayLiteralNode*>(node);
+            for (const auto& element : arrayNode->elements) {
+                compileExpression(element.get());
+            }
+            emit(OpCode::ARRAY, static_cast<uint32_t>(arrayNode->elements.size()));
+            break;
+        }
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            compileExpression(lookupNode->array.get());
+            compileExpression(lookupNode->index.get());
+            emit(OpCode::INDEX);
+            break;
+        }
+        case ASTNode::Type::NullNode:
+            emit(OpCode::NIL);
+            break;
+        default:
+            emitFail("Unknown expression node type");
+            adjustStack(1);
+            break;
+    }
+}
+
+void Compiler::compileIf(const IfNode* node) {
+    compileExpression(node->condition.get());
+    size_t elseJump = emitConditionalJump(node->condition.get());
+    compileStatement(node->trueBranch.get());
+    if (node->falseBranch) {
+        size_t endJump = emitJump(OpCode::JUMP);
+        patchJump(elseJump);
+        compileStatement(node->falseBranch.get());
+        patchJump(endJump);
+    } else {
+        patchJump(elseJump);
+    }
+}
+
+/* Every iteration of a while body used to run in a fresh scope, so variables
+first assigned inside the body do not outlive the iteration. The VM keeps the
+enclosing scope and unsets those variables at the end of each iteration instead.*/
+void Compiler::compileWhile(const WhileNode* node) {
+    size_t loopStart = state->proto->code.size();
+    compileExpression(node->condition.get());
+    size_t exitJump = emitConditionalJump(node->condition.get());
+
+    std::unordered_set<SymbolId> outer = state->declared;
+    compileStatement(node->body.get());
+    for (SymbolId identifier : state->declared) {
+        if (!outer.count(identifier)) {
+            emitUnset(identifier);
+        }
+    }
+    state->declared = std::move(outer);
+
+    emit(OpCode::JUMP, static_cast<uint32_t>(loopStart));
+    patchJump(exitJump);
+}
+
+void Compiler::compileAssignment(const AssignmentNode* node) {
+    compileExpression(node->rhs.get());
+
+    if (node->lhs->getType() == ASTNode::Type::VariableNode) {
+        SymbolId identifier = static_cast<const VariableNode*>(node->lhs.get())->identifier.symbol;
+        emitSet(identifier);
+        state->declared.insert(identifier);
+    } else if (node->lhs->getType() == ASTNode::Type::ArrayLookupNode) {
+        // Assigning an array literal to an element has always been a no-op
+        if (node->rhs->getType() == ASTNode::Type::ArrayLiteralNode) {
+            return;
+        }
+        auto lookupNode = static_cast<const ArrayLookupNode*>(node->lhs.get());
+        if (lookupNode->array->getType() != ASTNode::Type::VariableNode) {
+            emitFail("Runtime error: not an array.");
+            return;
+        }
+        compileExpression(lookupNode->index.get());
+        SymbolId identifier = static_cast<const VariableNode*>(lookupNode->array.get())->identifier.symbol;
+        int local = slot(identifier);
+        if (local >= 0) {
+            emit(OpCode::SET_INDEX_LOCAL, static_cast<uint32_t>(local), name(identifier));
+        } else {
+            emit(OpCode::SET_INDEX, name(identifier));
+        }
+    } else {
+        emitFail("Runtime error: invalid assignee.");
+    }
+}
+
+/* Arguments are evaluated before the callee is looked up. A call in tail
+position of a function does not need the caller's activation any more, so it
+becomes a TAIL_CALL that runs in constant stack space.*/
+void Compiler::compileCall(const CallNode* node, bool isTailCall) {
+    for (const auto& arg : node->arguments) {
+        compileExpression(arg.get());
+    }
+    uint32_t argc = static_cast<uint32_t>(node->arguments.size());
+
+    if (node->callee->getType() == ASTNode::Type::VariableNode) {
+        int index = builtin(static_cast<const VariableNode*>(node->callee.get())->identifier.symbol);
+        if (index >= 0) {
+            emit(OpCode::CALL_BUILTIN, argc, static_cast<uint32_t>(index));
+            if (isTailCall) {
+                emit(OpCode::RETURN);
+            }
+            return;
+        }
+    }
+    compileExpression(node->callee.get());
+    emit(isTailCall ? OpCode::TAIL_CALL : OpCode::CALL, argc);
+}
+
+/* Operators whose operands the type inference proved to be doubles (or
+bools for the logical operators) skip the operand type checks.*/
+void Compiler::compileBinaryOperation(const BinaryOpNode* node) {
+    compileExpression(node->left.get());
+    compileExpression(node->right.get());
+
+    StaticType left = state->types.typeOf(node->left.get());
+    StaticType right = state->types.typeOf(node->right.get());
+    bool numbers = left == StaticType::Number && right == StaticType::Number;
+    bool bools = left == StaticType::Bool && right == StaticType::Bool;
+
+    OpCode op;
+    switch (node->op.type) {
+        case TokenType::ADD:           op = OpCode::ADD; break;
+        case TokenType::SUBTRACT:      op = OpCode::SUBTRACT; break;
+        case TokenType::MULTIPLY:      op = OpCode::MULTIPLY; break;
+        case TokenType::DIVIDE:        op = OpCode::DIVIDE; break;
+        case TokenType::MODULO:        op = OpCode::MODULO; break;
+        case TokenType::LESS:          op = OpCode::LESS; break;
+        case TokenType::LESS_EQUAL:    op = OpCode::LESS_EQUAL; break;
+        case TokenType::GREATER:       op = OpCode::GREATER; break;
+        case TokenType::GREATER_EQUAL: op = OpCode::GREATER_EQUAL; break;
+        case TokenType::EQUAL:         op = OpCode::EQUAL; break;
+        case TokenType::NOT_EQUAL:     op = OpCode::NOT_EQUAL; break;
+        case TokenType::LOGICAL_AND:
+            emit(bools ? OpCode::LOGICAL_AND_UNCHECKED : OpCode::LOGICAL_AND);
+            return;
+        case TokenType::LOGICAL_XOR:
+            emit(bools ? OpCode::LOGICAL_XOR_UNCHECKED : OpCode::LOGICAL_XOR);
+            return;
+        case TokenType::LOGICAL_OR:
+            emit(bools ? OpCode::LOGICAL_OR_UNCHECKED : OpCode::LOGICAL_OR);
+            return;
+        default:
+            emitFail("Unsupported binary operator in evaluateBinaryOperation");
+            adjustStack(-1);
+            return;
+    }
+    emit(numbers ? uncheckedForm(op) : op);
+}
+
+// Reads a variable from its slot, or by name from the enclosing scopes
+void Compiler::emitGet(SymbolId identifier) {
+    int local = slot(identifier);
+    if (local >= 0) {
+        emit(OpCode::GET_LOCAL, static_cast<uint32_t>(local), name(identifier));
+    } else {
+        emit(OpCode::GET_NAME, name(identifier), inlineCache());
+    }
+}
+
+// Assignments inside a function target its activation, or its environment for the variables kept there
+void Compiler::emitSet(SymbolId identifier) {
+    if (state->isScript || state->persistent.count(identifier)) {
+        emit(OpCode::SET_NAME, name(identifier), inlineCache());
+    } else {
+        emit(OpCode::SET_LOCAL, static_cast<uint32_t>(slot(identifier)));
+    }
+}
+
+void Compiler::emitUnset(SymbolId identifier) {
+    if (state->isScript || state->persistent.count(identifier)) {
+        emit(OpCode::UNSET_NAME, name(identifier));
+    } else {
+        emit(OpCode::UNSET_LOCAL, static_cast<uint32_t>(slot(identifier)), name(identifier));
+    }
+}
+
+// Slot of a local variable, or -1 for names that live in an enclosing scope
+int Compiler::slot(SymbolId identifier) const {
+    if (state->isScript || state->persistent.count(identifier)) {
+        return -1;
+    }
+    if (const uint32_t* local = state->slots.find(identifier)) {
+        return static_cast<int>(*local);
+    }
+    // The slot after the parameters holds the closure, under the function's own name
+    size_t self = state->proto->parameters.size();
+    if (identifier == state->proto->locals[self]) {
+        return static_cast<int>(self);
+    }
+    return -1;
+}
+
+// Appends an instruction and tracks how deep the value stack can get
+void Compiler::emit(OpCode op, uint32_t a, uint32_t b) {
+    state->proto->code.push_back({op, a, b});
+
+    switch (op) {
+        case OpCode::CONSTANT:
+        case OpCode::NIL:
+        case OpCode::GET_NAME:
+        case OpCode::GET_LOCAL:
+        case OpCode::MAKE_FUNCTION:
+        case OpCode::MAKE_CLOSURE:
+            adjustStack(1);
+            break;
+        case OpCode::POP:
+        case OpCode::ADD: case OpCode::SUBTRACT: case OpCode::MULTIPLY:
+        case OpCode::DIVIDE: case OpCode::MODULO:
+        case OpCode::LESS: case OpCode::LESS_EQUAL:
+        case OpCode::GREATER: case OpCode::GREATER_EQUAL:
+        case OpCode::EQUAL: case OpCode::NOT_EQUAL:
+        case OpCode::ADD_UNCHECKED: case OpCode::SUBTRACT_UNCHECKED: case OpCode::MULTIPLY_UNCHECKED:
+        case OpCode::DIVIDE_UNCHECKED: case OpCode::MODULO_UNCHECKED:
+        case OpCode::LESS_UNCHECKED: case OpCode::LESS_EQUAL_UNCHECKED:
+        case OpCode::GREATER_UNCHECKED: case OpCode::GREATER_EQUAL_UNCHECKED:
+        case OpCode::EQUAL_UNCHECKED: case OpCode::NOT_EQUAL_UNCHECKED:
+        case OpCode::LOGICAL_AND: case OpCode::LOGICAL_XOR: case OpCode::LOGICAL_OR:
+        case OpCode::LOGICAL_AND_UNCHECKED: case OpCode::LOGICAL_XOR_UNCHECKED: case OpCode::LOGICAL_OR_UNCHECKED:
+        case OpCode::PRINT:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_FALSE_UNCHECKED:
+        case OpCode::RETURN:
+        case OpCode::INDEX:
+        case OpCode::SET_INDEX:
+        case OpCode::SET_INDEX_LOCAL:
+            adjustStack(-1);
+            break;
+        case OpCode::CALL:
+            adjustStack(-static_cast<int>(a));
+            break;
+        case OpCode::TAIL_CALL:
+            adjustStack(-static_cast<int>(a) - 1);
+            break;
+        case OpCode::CALL_BUILTIN:
+        case OpCode::ARRAY:
+            adjustStack(1 - static_cast<int>(a));
+            break;
+        default:
+            break;
+    }
+}
+
+size_t Compiler::emitJump(OpCode op) {
+    emit(op);
+    return state->proto->code.size() - 1;
+}
+
+// Conditions proven to be bools skip the check that raises "condition is not a bool"
+size_t Compiler::emitConditionalJump(const ASTNode* condition) {
+    bool proven = state->types.typeOf(condition) == StaticType::Bool;
+    return emitJump(proven ? OpCode::JUMP_IF_FALSE_UNCHECKED : OpCode::JUMP_IF_FALSE);
+}
+
+void Compiler::patchJump(size_t at) {
+    state->proto->code[at].a = static_cast<uint32_t>(state->proto->code.size());
+}
+
+void Compiler::emitFail(const std::string& message) {
+    state->proto->messages.push_back(message);
+    emit(OpCode::FAIL, static_cast<uint32_t>(state->proto->messages.size() - 1));
+}
+
+void Compiler::adjustStack(int delta) {
+    state->depth += delta;
+    if (state->depth > static_cast<int>(state->proto->maxStack)) {
+        state->proto->maxStack = static_cast<size_t>(state->depth);
+    }
+}
+
+uint32_t Compiler::constant(const Value& value) {
+    state->proto->constants.push_back(value);
+    return static_cast<uint32_t>(state->proto->constants.size() - 1);
+}
+
+uint32_t Compiler::name(SymbolId identifier) {
+    auto entry = state->nameIndex.emplace(identifier, static_cast<uint32_t>(state->proto->names.size()));
+    if (entry.second) {
+        state->proto->names.push_back(identifier);
+    }
+    return *entry.first;
+}
+
+uint32_t Compiler::inlineCache() {
+    state->proto->caches.emplace_back();
+    return static_cast<uint32_t>(state->proto->caches.size() - 1);
+}
+
+int Compiler::builtin(SymbolId identifier) const {
+    for (size_t i = 0; i < builtins.size(); ++i) {
+        if (builtins[i] == identifier) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
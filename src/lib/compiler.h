@@ -0,0 +1,70 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "ASTNodes.h"
+#include "Bytecode.h"
+#include "purity.h"
+#include "typeInference.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Translates the mParser AST into bytecode for the VM
+
+class Compiler {
+public:
+    explicit Compiler(const std::vector<std::string>& builtins);
+
+    std::shared_ptr<Prototype> compile(const ASTNode* program);
+
+private:
+    // Per-function compilation state
+    struct FunctionState {
+        Prototype* proto;
+        bool isScript;
+        SymbolMap<uint32_t> slots;
+        std::unordered_set<SymbolId> declared;
+        SymbolMap<uint32_t> nameIndex;
+        int depth;
+        TypeInference types;
+        std::unordered_set<SymbolId> persistent;    // variables kept in the closure's environment
+    };
+
+    bool compileFunction(Prototype* proto, const FunctionNode* node);
+    void deferFunction(Prototype* proto, const FunctionNode* node);
+    void compileStatement(const ASTNode* node);
+    void compileExpression(const ASTNode* node);
+    void compileIf(const IfNode* node);
+    void compileWhile(const WhileNode* node);
+    void compileAssignment(const AssignmentNode* node);
+    void compileCall(const CallNode* node, bool isTailCall = false);
+    void compileBinaryOperation(const BinaryOpNode* node);
+
+    explicit Compiler(std::vector<SymbolId> builtins);
+
+    void emitGet(SymbolId identifier);
+    void emitSet(SymbolId identifier);
+    void emitUnset(SymbolId identifier);
+    int slot(SymbolId identifier) const;
+
+    void emit(OpCode op, uint32_t a = 0, uint32_t b = 0);
+    size_t emitJump(OpCode op);
+    size_t emitConditionalJump(const ASTNode* condition);
+    void patchJump(size_t at);
+    void emitFail(const std::string& message);
+    void adjustStack(int delta);
+    uint32_t constant(const Value& value);
+    uint32_t name(SymbolId identifier);
+    uint32_t inlineCache();
+    int builtin(SymbolId identifier) const;
+
+    std::vector<SymbolId> builtins;
+    std::unordered_set<const FunctionNode*> pureFunctions;
+    // Globals assigned by the programs compiled so far, a script may be compiled a statement at a time
+    std::unordered_set<SymbolId> scriptDeclared;
+    FunctionState* state;
+};
+
+#endif // COMPILER_H
@@ -0,0 +1,890 @@
+#include "cppEmitter.h"
+#include "cppRuntime.h"
+#include <algorithm>
+#include <stdexcept>
+
+static bool isBuiltinName(const std::string& identifier) {
+    return identifier == "len" || identifier == "pop" || identifier == "push";
+}
+
+// Collects the variables a function body assigns, without entering nested functions
+static void collectAssigned(const ASTNode* node, std::vector<std::string>& names) {
+    if (!node) {
+        return;
+    }
+    switch (node->getType()) {
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            collectAssigned(binaryOpNode->left.get(), names);
+            collectAssigned(binaryOpNode->right.get(), names);
+            break;
+        }
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<const AssignmentNode*>(node);
+            if (assignmentNode->lhs->getType() == ASTNode::Type::VariableNode) {
+                names.push_back(static_cast<const VariableNode*>(assignmentNode->lhs.get())->identifier.text());
+            } else {
+                collectAssigned(assignmentNode->lhs.get(), names);
+            }
+            collectAssigned(assignmentNode->rhs.get(), names);
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            collectAssigned(static_cast<const PrintNode*>(node)->expression.get(), names);
+            break;
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<const IfNode*>(node);
+            collectAssigned(ifNode->condition.get(), names);
+            collectAssigned(ifNode->trueBranch.get(), names);
+            collectAssigned(ifNode->falseBranch.get(), names);
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<const WhileNode*>(node);
+            collectAssigned(whileNode->condition.get(), names);
+            collectAssigned(whileNode->body.get(), names);
+            break;
+        }
+        case ASTNode::Type::BlockNode:
+            for (const auto& stmt : static_cast<const BlockNode*>(node)->statements) {
+                collectAssigned(stmt.get(), names);
+            }
+            break;
+        case ASTNode::Type::FunctionNode:
+            names.push_back(static_cast<const FunctionNode*>(node)->name.text());
+            break;
+        case ASTNode::Type::ReturnNode:
+            collectAssigned(static_cast<const ReturnNode*>(node)->value.get(), names);
+            break;
+        case ASTNode::Type::CallNode: {
+            auto callNode = static_cast<const CallNode*>(node);
+            collectAssigned(callNode->callee.get(), names);
+            for (const auto& arg : callNode->arguments) {
+                collectAssigned(arg.get(), names);
+            }
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (const auto& element : static_cast<const ArrayLiteralNode*>(node)->elements) {
+                collectAssigned(element.get(), names);
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            collectAssigned(lookupNode->array.get(), names);
+            collectAssigned(lookupNode->index.get(), names);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Collects every identifier used inside function bodies, at any nesting depth
+static void collectFunctionNames(const ASTNode* node, bool inFunction, std::unordered_set<std::string>& names) {
+    if (!node) {
+        return;
+    }
+    switch (node->getType()) {
+        case ASTNode::Type::VariableNode:
+            if (inFunction) {
+                names.insert(static_cast<const VariableNode*>(node)->identifier.text());
+            }
+            break;
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            collectFunctionNames(binaryOpNode->left.get(), inFunction, names);
+            collectFunctionNames(binaryOpNode->right.get(), inFunction, names);
+            break;
+        }
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<const AssignmentNode*>(node);
+            collectFunctionNames(assignmentNode->lhs.get(), inFunction, names);
+            collectFunctionNames(assignmentNode->rhs.get(), inFunction, names);
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            collectFunctionNames(static_cast<const PrintNode*>(node)->expression.get(), inFunction, names);
+            break;
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<const IfNode*>(node);
+            collectFunctionNames(ifNode->condition.get(), inFunction, names);
+            collectFunctionNames(ifNode->trueBranch.get(), inFunction, names);
+            collectFunctionNames(ifNode->falseBranch.get(), inFunction, names);
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<const WhileNode*>(node);
+            collectFunctionNames(whileNode->condition.get(), inFunction, names);
+            collectFunctionNames(whileNode->body.get(), inFunction, names);
+            break;
+        }
+        case ASTNode::Type::BlockNode:
+            for (const auto& stmt : static_cast<const BlockNode*>(node)->statements) {
+                collectFunctionNames(stmt.get(), inFunction, names);
+            }
+            break;
+        case ASTNode::Type::FunctionNode: {
+            auto functionNode = static_cast<const FunctionNode*>(node);
+            names.insert(functionNode->name.text());
+            for (const auto& param : functionNode->parameters) {
+                names.insert(param.text());
+            }
+            collectFunctionNames(functionNode->body.get(), true, names);
+            break;
+        }
+        case ASTNode::Type::ReturnNode:
+            collectFunctionNames(static_cast<const ReturnNode*>(node)->value.get(), inFunction, names);
+            break;
+        case ASTNode::Type::CallNode: {
+            auto callNode = static_cast<const CallNode*>(node);
+            collectFunctionNames(callNode->callee.get(), inFunction, names);
+            for (const auto& arg : callNode->arguments) {
+                collectFunctionNames(arg.get(), inFunction, names);
+            }
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (const auto& element : static_cast<const ArrayLiteralNode*>(node)->elements) {
+                collectFunctionNames(element.get(), inFunction, names);
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            collectFunctionNames(lookupNode->array.get(), inFunction, names);
+            collectFunctionNames(lookupNode->index.get(), inFunction, names);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Which variables of a body only ever hold numbers, and whether it defines functions
+struct NumberScan {
+    const TypeInference& types;
+    std::unordered_set<std::string> assigned;
+    std::unordered_set<std::string> excluded;
+    bool definesFunctions;
+};
+
+static void scanNumbers(const ASTNode* node, NumberScan& scan) {
+    if (!node) {
+        return;
+    }
+    switch (node->getType()) {
+        case ASTNode::Type::VariableNode:
+            if (scan.types.typeOf(node) != StaticType::Number) {
+                scan.excluded.insert(static_cast<const VariableNode*>(node)->identifier.text());
+            }
+            break;
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            scanNumbers(binaryOpNode->left.get(), scan);
+            scanNumbers(binaryOpNode->right.get(), scan);
+            break;
+        }
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<const AssignmentNode*>(node);
+            if (assignmentNode->lhs->getType() == ASTNode::Type::VariableNode) {
+                const std::string& identifier = static_cast<const VariableNode*>(assignmentNode->lhs.get())->identifier.text();
+                scan.assigned.insert(identifier);
+                if (scan.types.typeOf(assignmentNode->rhs.get()) != StaticType::Number) {
+                    scan.excluded.insert(identifier);
+                }
+            } else if (assignmentNode->lhs->getType() == ASTNode::Type::ArrayLookupNode) {
+                auto lookupNode = static_cast<const ArrayLookupNode*>(assignmentNode->lhs.get());
+                if (lookupNode->array->getType() == ASTNode::Type::VariableNode) {
+                    scan.excluded.insert(static_cast<const VariableNode*>(lookupNode->array.get())->identifier.text());
+                }
+                scanNumbers(lookupNode->index.get(), scan);
+            }
+            scanNumbers(assignmentNode->rhs.get(), scan);
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            scanNumbers(static_cast<const PrintNode*>(node)->expression.get(), scan);
+            break;
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<const IfNode*>(node);
+            scanNumbers(ifNode->condition.get(), scan);
+            scanNumbers(ifNode->trueBranch.get(), scan);
+            scanNumbers(ifNode->falseBranch.get(), scan);
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<const WhileNode*>(node);
+            scanNumbers(whileNode->condition.get(), scan);
+            scanNumbers(whileNode->body.get(), scan);
+            break;
+        }
+        case ASTNode::Type::BlockNode:
+            for (const auto& stmt : static_cast<const BlockNode*>(node)->statements) {
+                scanNumbers(stmt.get(), scan);
+            }
+            break;
+        case ASTNode::Type::FunctionNode:
+            scan.excluded.insert(static_cast<const FunctionNode*>(node)->name.text());
+            scan.definesFunctions = true;
+            break;
+        case ASTNode::Type::ReturnNode:
+            scanNumbers(static_cast<const ReturnNode*>(node)->value.get(), scan);
+            break;
+        case ASTNode::Type::CallNode: {
+            auto callNode = static_cast<const CallNode*>(node);
+            scanNumbers(callNode->callee.get(), scan);
+            for (const auto& arg : callNode->arguments) {
+                scanNumbers(arg.get(), scan);
+            }
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (const auto& element : static_cast<const ArrayLiteralNode*>(node)->elements) {
+                scanNumbers(element.get(), scan);
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            scanNumbers(lookupNode->array.get(), scan);
+            scanNumbers(lookupNode->index.get(), scan);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// A C++ double literal that reads back as the same value
+static std::string numberLiteral(double value) {
+    std::ostringstream out;
+    out.precision(17);
+    out << value;
+    std::string literal = out.str();
+    if (literal.find_first_of(".e") == std::string::npos) {
+        literal += ".0";
+    }
+    return literal;
+}
+
+// A C++ string literal; identifiers only need the quotes
+static std::string quoted(const std::string& text) {
+    return "\"" + text + "\"";
+}
+
+CppEmitter::CppEmitter(std::ostream& os)
+        : os(os), temporaries(0), frameBytes(0), state(nullptr) {}
+
+/* Writes the runtime, the globals, one C++ function per script function and
+the top level block as the script function run by main.*/
+void CppEmitter::emit(const ASTNode* program) {
+    const char* builtinNames[] = {"len", "pop", "push"};
+    for (const char* name : builtinNames) {
+        globals.emplace(name, globals.size());
+    }
+    std::vector<std::string> assigned;
+    collectAssigned(program, assigned);
+    for (const auto& identifier : assigned) {
+        globals.emplace(identifier, globals.size());
+    }
+    collectFunctionNames(program, false, functionNames);
+
+    FunctionState script{nullptr, true, {}, {}, {}, {}, {}, {}, 1, false, 0};
+    state = &script;
+    script.types.analyze(program);
+    findNumbers(program);
+    globalNumbers = script.numbers;
+    emitStatement(program);
+    state = nullptr;
+
+    os << CPP_RUNTIME << "\n";
+    std::vector<std::string> names(globals.size());
+    for (const auto& entry : globals) {
+        names[entry.second] = entry.first;
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (i < 3) {
+            os << "Value g" << i << " = Value(" << names[i] << ");\n";
+        } else if (globalNumbers.count(names[i])) {
+            os << "double g" << i << " = 0;            // " << names[i] << "\n";
+        } else {
+            os << "Value g" << i << " = Value::undefined();   // " << names[i] << "\n";
+        }
+    }
+    os << "\n";
+    for (size_t i = 0; i < functions.size(); ++i) {
+        os << "Value f" << i << "(const Value& self, Value* args);\n";
+    }
+    for (const auto& function : functions) {
+        os << "\n" << function;
+    }
+    os << "\nvoid script() {\n" << script.body.str() << "}\n\n";
+    os << "} // namespace scrypt\n\n";
+    os << "int main(int argc, char* argv[]) {\n";
+    os << "    return scrypt::run(argc, argv, scrypt::script, " << frameBytes << ");\n";
+    os << "}\n";
+}
+
+/* Translates a function body. Parameters, the function itself and the
+variables the body assigns get a local like the slots of the compiled
+prototype, the variables the compiler keeps in the closure's environment go
+to its Env; a call of the function itself in tail position jumps back to the
+start of the body. Returns whether the function keeps any variables.*/
+bool CppEmitter::emitFunction(size_t index, const FunctionNode* node) {
+    FunctionState* enclosing = state;
+    FunctionState function{node, false, {}, {}, {}, {}, {}, {}, 1, false, 0};
+    state = &function;
+
+    for (const auto& param : node->parameters) {
+        function.slots[param.text()] = function.locals.size();
+        function.locals.push_back(param.text());
+        function.declared.insert(param.text());
+    }
+    function.locals.push_back(node->name.text());
+    function.types.analyzeFunction(node);
+    bool persistent = false;
+    std::vector<std::string> assigned;
+    collectAssigned(node->body.get(), assigned);
+    for (const auto& identifier : assigned) {
+        if (function.types.isPersistent(identifier)) {
+            persistent = true;
+        } else if (!function.slots.count(identifier)) {
+            function.slots[identifier] = function.locals.size();
+            function.locals.push_back(identifier);
+        }
+    }
+
+    findNumbers(node->body.get());
+    if (node->body) {
+        emitStatement(node->body.get());
+    }
+
+    std::ostringstream text;
+    text << "// " << node->name.text() << "\n";
+    text << "Value f" << index << "(const Value& self, Value* args) {\n";
+    text << "    Env* env = self.getFunction().env.get();\n";
+    text << "    (void)env;\n";
+    if (node->parameters.empty()) {
+        text << "    (void)args;\n";
+    }
+    size_t parameterCount = node->parameters.size();
+    for (size_t i = 0; i < function.locals.size(); ++i) {
+        const std::string& identifier = function.locals[i];
+        if (i < parameterCount) {
+            text << "    Value s" << i << " = std::move(args[" << i << "]);\n";
+        } else if (i == parameterCount) {
+            text << "    const Value& s" << i << " = self;\n";
+        } else if (function.numbers.count(identifier)) {
+            text << "    double s" << i << " = 0;\n";
+        } else {
+            text << "    Value s" << i << " = Value::undefined();\n";
+        }
+    }
+    if (function.tailLoop) {
+        text << "entry:\n";
+    }
+    text << function.body.str();
+    text << "    return Value();\n}\n";
+    functions[index] = text.str();
+    // Unoptimized builds give every local its own stack space, so bound each generously
+    frameBytes = std::max(frameBytes, (function.locals.size() + function.declarations) * 64 + 512);
+
+    state = enclosing;
+    return persistent;
+}
+
+void CppEmitter::emitStatement(const ASTNode* node) {
+    switch (node->getType()) {
+        case ASTNode::Type::IfNode:
+            emitIf(static_cast<const IfNode*>(node));
+            break;
+        case ASTNode::Type::WhileNode:
+            emitWhile(static_cast<const WhileNode*>(node));
+            break;
+        case ASTNode::Type::PrintNode: {
+            open("{");
+            Operand value = emitExpression(static_cast<const PrintNode*>(node)->expression.get());
+            line() << "println(" << value.code << ");\n";
+            close();
+            break;
+        }
+        case ASTNode::Type::AssignmentNode:
+            open("{");
+            emitAssignment(static_cast<const AssignmentNode*>(node));
+            close();
+            break;
+        case ASTNode::Type::BlockNode:
+            for (const auto& stmt : static_cast<const BlockNode*>(node)->statements) {
+                emitStatement(stmt.get());
+            }
+            break;
+        case ASTNode::Type::FunctionNode:
+            open("{");
+            emitFunctionValue(static_cast<const FunctionNode*>(node));
+            close();
+            break;
+        case ASTNode::Type::ReturnNode:
+            open("{");
+            emitReturn(static_cast<const ReturnNode*>(node));
+            close();
+            break;
+        case ASTNode::Type::CallNode:
+            open("{");
+            emitCall(static_cast<const CallNode*>(node));
+            close();
+            break;
+        default:
+            line() << "fail(\"Unknown Node Type in evaluateStatement\");\n";
+            break;
+    }
+}
+
+CppEmitter::Operand CppEmitter::emitExpression(const ASTNode* node) {
+    if (!node) {
+        throw std::runtime_error("Null expression node");
+    }
+    switch (node->getType()) {
+        case ASTNode::Type::NumberNode:
+            return {numberLiteral(static_cast<const NumberNode*>(node)->value.number()), Repr::Double};
+        case ASTNode::Type::BooleanNode:
+            return {static_cast<const BooleanNode*>(node)->value.type == TokenType::BOOLEAN_TRUE ? "true" : "false", Repr::Bool};
+        case ASTNode::Type::NullNode:
+            return {"Value()", Repr::Value};
+        case ASTNode::Type::VariableNode:
+            return emitVariable(static_cast<const VariableNode*>(node));
+        case ASTNode::Type::BinaryOpNode:
+            return emitBinaryOperation(static_cast<const BinaryOpNode*>(node));
+        case ASTNode::Type::AssignmentNode:
+            return emitAssignment(static_cast<const AssignmentNode*>(node));
+        case ASTNode::Type::CallNode:
+            return emitCall(static_cast<const CallNode*>(node));
+        case ASTNode::Type::ArrayLiteralNode: {
+            // Elements are all evaluated before any of them is copied into the array
+            auto arrayNode = static_cast<const ArrayLiteralNode*>(node);
+            std::vector<Operand> elements;
+            for (const auto& element : arrayNode->elements) {
+                elements.push_back(emitExpression(element.get()));
+            }
+            std::string vector = fresh();
+            line() << "std::vector<Value> " << vector << ";\n";
+            line() << vector << ".reserve(" << elements.size() << ");\n";
+            for (const auto& element : elements) {
+                if (element.repr == Repr::Value) {
+                    line() << vector << ".push_back(" << element.code << ".deepCopy());\n";
+                } else {
+                    line() << vector << ".push_back(" << asValue(element) << ");\n";
+                }
+            }
+            return {temporary(Repr::Value, "Value(std::move(" + vector + "))"), Repr::Value};
+        }
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            Operand array = emitExpression(lookupNode->array.get());
+            Operand index = emitExpression(lookupNode->index.get());
+            return {temporary(Repr::Value, "element(" + asValue(array) + ", " + asValue(index) + ")"), Repr::Value};
+        }
+        default:
+            line() << "fail(\"Unknown expression node type\");\n";
+            return {"Value()", Repr::Value};
+    }
+}
+
+void CppEmitter::emitIf(const IfNode* node) {
+    open("{");
+    std::string test = condition(node->condition.get());
+    open("if (" + test + ") {");
+    emitStatement(node->trueBranch.get());
+    if (node->falseBranch) {
+        close("} else {");
+        ++state->indent;
+        emitStatement(node->falseBranch.get());
+    }
+    close();
+    close();
+}
+
+/* Variables first assigned inside the body are unbound again at the end of
+every iteration, like the compiler's UNSET instructions do. Variables held in
+doubles are never read unless they are certainly assigned, so they need not be.*/
+void CppEmitter::emitWhile(const WhileNode* node) {
+    open("while (true) {");
+    std::string test = condition(node->condition.get());
+    line() << "if (!(" << test << ")) break;\n";
+
+    std::unordered_set<std::string> outer = state->declared;
+    emitStatement(node->body.get());
+    for (const auto& identifier : state->declared) {
+        if (!outer.count(identifier)) {
+            emitUnset(identifier);
+        }
+    }
+    state->declared = std::move(outer);
+    close();
+}
+
+void CppEmitter::emitReturn(const ReturnNode* node) {
+    if (state->isScript) {
+        if (node->value) {
+            emitExpression(node->value.get());
+        }
+        line() << "fail(\"Runtime error: unexpected return.\");\n";
+    } else if (node->value && node->value->getType() == ASTNode::Type::CallNode) {
+        emitCall(static_cast<const CallNode*>(node->value.get()), true);
+    } else if (node->value) {
+        Operand value = emitExpression(node->value.get());
+        line() << "return " << asValue(value) << ";\n";
+    } else {
+        line() << "return Value();\n";
+    }
+}
+
+CppEmitter::Operand CppEmitter::emitAssignment(const AssignmentNode* node) {
+    Operand value = emitExpression(node->rhs.get());
+
+    if (node->lhs->getType() == ASTNode::Type::VariableNode) {
+        const std::string& identifier = static_cast<const VariableNode*>(node->lhs.get())->identifier.text();
+        emitSet(identifier, value);
+        state->declared.insert(identifier);
+    } else if (node->lhs->getType() == ASTNode::Type::ArrayLookupNode) {
+        // Assigning an array literal to an element has always been a no-op
+        if (node->rhs->getType() == ASTNode::Type::ArrayLiteralNode) {
+            return value;
+        }
+        auto lookupNode = static_cast<const ArrayLookupNode*>(node->lhs.get());
+        if (lookupNode->array->getType() != ASTNode::Type::VariableNode) {
+            line() << "fail(\"Runtime error: not an array.\");\n";
+            return value;
+        }
+        Operand index = emitExpression(lookupNode->index.get());
+        const std::string& identifier = static_cast<const VariableNode*>(lookupNode->array.get())->identifier.text();
+        std::string target;
+        int local = slot(identifier);
+        if (local >= 0) {
+            std::string slotName = "s" + std::to_string(local);
+            if (static_cast<size_t>(local) == state->node->parameters.size()) {
+                slotName = "const_cast<Value&>(" + slotName + ")";
+            }
+            target = "(" + slotName + ".isUndefined() ? find(env, " + quoted(identifier) + ", " +
+                     globalPointer(identifier) + ") : &" + slotName + ")";
+        } else {
+            target = std::string("find(") + (state->isScript ? "nullptr" : "env") + ", " + quoted(identifier) + ", " +
+                     globalPointer(identifier) + ")";
+        }
+        line() << "setIndex(" << target << ", " << asValue(index) << ", " << asValue(value) << ");\n";
+    } else {
+        line() << "fail(\"Runtime error: invalid assignee.\");\n";
+    }
+    return value;
+}
+
+/* Arguments are evaluated before the callee is looked up, and len, pop and
+push are called directly by name like the compiler's CALL_BUILTIN.*/
+CppEmitter::Operand CppEmitter::emitCall(const CallNode* node, bool isTailCall) {
+    std::vector<Operand> arguments;
+    for (const auto& arg : node->arguments) {
+        arguments.push_back(emitExpression(arg.get()));
+    }
+    std::string argc = std::to_string(arguments.size());
+
+    if (node->callee->getType() == ASTNode::Type::VariableNode) {
+        const std::string& identifier = static_cast<const VariableNode*>(node->callee.get())->identifier.text();
+        if (isBuiltinName(identifier)) {
+            std::string args = argumentArray(arguments);
+            std::string call = identifier + "(" + args + ", " + argc + ")";
+            if (isTailCall) {
+                line() << "return " << call << ";\n";
+                return {"Value()", Repr::Value};
+            }
+            return {temporary(Repr::Value, call), Repr::Value};
+        }
+        // A function calling itself in tail position restarts its body with the new arguments
+        if (isTailCall && identifier == state->node->name.text() &&
+            slot(identifier) == static_cast<int>(state->node->parameters.size()) &&
+            arguments.size() == state->node->parameters.size()) {
+            std::string args = argumentArray(arguments);
+            for (size_t i = 0; i < state->locals.size(); ++i) {
+                if (i < arguments.size()) {
+                    line() << "s" << i << " = std::move(" << args << "[" << i << "]);\n";
+                } else if (i > arguments.size() && !state->numbers.count(state->locals[i])) {
+                    line() << "s" << i << " = Value::undefined();\n";
+                }
+            }
+            line() << "goto entry;\n";
+            state->tailLoop = true;
+            return {"Value()", Repr::Value};
+        }
+    }
+    Operand callee = emitExpression(node->callee.get());
+    std::string args = argumentArray(arguments);
+    if (isTailCall) {
+        line() << "return tailCall(" << asValue(callee) << ", " << args << ", " << argc << ");\n";
+        return {"Value()", Repr::Value};
+    }
+    return {temporary(Repr::Value, "call(" + asValue(callee) + ", " + args + ", " + argc + ")"), Repr::Value};
+}
+
+/* Operators whose operands the type inference proved to be numbers (or bools
+for the logical operators) compile to the plain C++ operators.*/
+CppEmitter::Operand CppEmitter::emitBinaryOperation(const BinaryOpNode* node) {
+    Operand left = emitExpression(node->left.get());
+    Operand right = emitExpression(node->right.get());
+
+    bool numbers = state->types.typeOf(node->left.get()) == StaticType::Number &&
+                   state->types.typeOf(node->right.get()) == StaticType::Number;
+    bool bools = state->types.typeOf(node->left.get()) == StaticType::Bool &&
+                 state->types.typeOf(node->right.get()) == StaticType::Bool;
+    std::string l = numbers ? asDouble(left) : bools ? asBool(left) : asValue(left);
+    std::string r = numbers ? asDouble(right) : bools ? asBool(right) : asValue(right);
+
+    auto arithmetic = [&](const char* op, const char* function) {
+        return Operand{temporary(Repr::Double, numbers ? l + " " + op + " " + r : std::string(function) + "(" + l + ", " + r + ")"), Repr::Double};
+    };
+    auto comparison = [&](const char* op, const char* function) {
+        return Operand{temporary(Repr::Bool, numbers ? l + " " + op + " " + r : std::string(function) + "(" + l + ", " + r + ")"), Repr::Bool};
+    };
+    auto logical = [&](const char* op, const char* function) {
+        return Operand{temporary(Repr::Bool, bools ? l + " " + op + " " + r : std::string(function) + "(" + l + ", " + r + ")"), Repr::Bool};
+    };
+
+    switch (node->op.type) {
+        case TokenType::ADD:           return arithmetic("+", "add");
+        case TokenType::SUBTRACT:      return arithmetic("-", "subtract");
+        case TokenType::MULTIPLY:      return arithmetic("*", "multiply");
+        case TokenType::DIVIDE:
+            return {temporary(Repr::Double, "divide(" + l + ", " + r + ")"), Repr::Double};
+        case TokenType::MODULO:
+            return {temporary(Repr::Double, "modulo(" + l + ", " + r + ")"), Repr::Double};
+        case TokenType::LESS:          return comparison("<", "less");
+        case TokenType::LESS_EQUAL:    return comparison("<=", "lessEqual");
+        case TokenType::GREATER:       return comparison(">", "greater");
+        case TokenType::GREATER_EQUAL: return comparison(">=", "greaterEqual");
+        case TokenType::EQUAL:
+            return {temporary(Repr::Bool, numbers || bools ? l + " == " + r : l + ".equals(" + r + ")"), Repr::Bool};
+        case TokenType::NOT_EQUAL:
+            return {temporary(Repr::Bool, numbers || bools ? l + " != " + r : "!" + l + ".equals(" + r + ")"), Repr::Bool};
+        case TokenType::LOGICAL_AND:   return logical("&&", "logicalAnd");
+        case TokenType::LOGICAL_XOR:   return logical("!=", "logicalXor");
+        case TokenType::LOGICAL_OR:    return logical("||", "logicalOr");
+        default:
+            line() << "fail(\"Unsupported binary operator in evaluateBinaryOperation\");\n";
+            return {"Value()", Repr::Value};
+    }
+}
+
+/* Reads a variable. Locals and globals the type inference saw assigned are
+read directly, others fall back to the enclosing scopes by name and report
+unknown identifiers the way the VM does.*/
+CppEmitter::Operand CppEmitter::emitVariable(const VariableNode* node) {
+    const std::string& identifier = node->identifier.text();
+    StaticType type = state->types.typeOf(node);
+
+    std::string storage;
+    if (state->isScript) {
+        if (!globals.count(identifier)) {
+            return {temporary(Repr::Value, "lookup(nullptr, " + quoted(identifier) + ", nullptr)"), Repr::Value};
+        }
+        storage = global(identifier);
+        if (type == StaticType::Unknown) {
+            return {temporary(Repr::Value, "lookup(nullptr, " + quoted(identifier) + ", &" + storage + ")"), Repr::Value};
+        }
+    } else {
+        int local = slot(identifier);
+        if (local < 0) {
+            return {temporary(Repr::Value, "lookup(env, " + quoted(identifier) + ", " + globalPointer(identifier) + ")"), Repr::Value};
+        }
+        storage = "s" + std::to_string(local);
+        // Parameters and the function itself are bound from the start and never unset
+        bool bound = static_cast<size_t>(local) <= state->node->parameters.size();
+        if (type == StaticType::Unknown && !bound) {
+            return {temporary(Repr::Value, "local(" + storage + ", env, " + quoted(identifier) + ", " +
+                                           globalPointer(identifier) + ")"), Repr::Value};
+        }
+    }
+
+    if (state->numbers.count(identifier)) {
+        return {temporary(Repr::Double, storage), Repr::Double};
+    }
+    switch (type) {
+        case StaticType::Number:
+            return {temporary(Repr::Double, storage + ".getDouble()"), Repr::Double};
+        case StaticType::Bool:
+            return {temporary(Repr::Bool, storage + ".getBool()"), Repr::Bool};
+        default:
+            return {temporary(Repr::Value, storage), Repr::Value};
+    }
+}
+
+/* Top level functions see the globals, nested functions capture the locals
+assigned so far, chained to the scope their enclosing function captured.*/
+void CppEmitter::emitFunctionValue(const FunctionNode* node) {
+    size_t index = functions.size();
+    functions.emplace_back();
+    bool persistent = emitFunction(index, node);
+
+    std::string function = "f" + std::to_string(index);
+    std::string arity = std::to_string(node->parameters.size());
+    std::string value;
+    if (state->isScript) {
+        value = temporary(Repr::Value, "makeFunction(" + function + ", " + arity + ", std::make_shared<Env>())");
+    } else {
+        std::string scope = fresh();
+        line() << "auto " << scope << " = std::make_shared<Env>();\n";
+        line() << scope << "->parent = self.getFunction().env;\n";
+        for (size_t i = 0; i < state->locals.size(); ++i) {
+            line() << "if (!s" << i << ".isUndefined()) " << scope << "->variables[" << quoted(state->locals[i])
+                   << "] = s" << i << ";\n";
+        }
+        if (persistent) {
+            std::string environment = fresh();
+            line() << "auto " << environment << " = std::make_shared<Env>();\n";
+            line() << environment << "->parent = " << scope << ";\n";
+            scope = environment;
+        }
+        value = temporary(Repr::Value, "makeFunction(" + function + ", " + arity + ", " + scope + ")");
+    }
+    emitSet(node->name.text(), {value, Repr::Value});
+    state->declared.insert(node->name.text());
+}
+
+// Assignments inside a function target its locals, or its Env for the variables kept there
+void CppEmitter::emitSet(const std::string& identifier, const Operand& value) {
+    if (state->types.isPersistent(identifier)) {
+        line() << "env->variables[" << quoted(identifier) << "] = " << asValue(value) << ";\n";
+        return;
+    }
+    std::string storage = state->isScript ? global(identifier) : "s" + std::to_string(slot(identifier));
+    if (state->numbers.count(identifier)) {
+        line() << storage << " = " << asDouble(value) << ";\n";
+    } else {
+        line() << storage << " = " << asValue(value) << ";\n";
+    }
+}
+
+void CppEmitter::emitUnset(const std::string& identifier) {
+    if (state->numbers.count(identifier)) {
+        return;
+    }
+    if (state->isScript) {
+        line() << global(identifier) << " = Value::undefined();\n";
+    } else if (state->types.isPersistent(identifier)) {
+        line() << "if (!find(env->parent.get(), " << quoted(identifier) << ", " << globalPointer(identifier)
+               << ")) env->variables.erase(" << quoted(identifier) << ");\n";
+    } else {
+        // Names that already existed outside of the loop stay bound
+        std::string storage = "s" + std::to_string(slot(identifier));
+        line() << "if (!find(env, " << quoted(identifier) << ", " << globalPointer(identifier) << ")) "
+               << storage << " = Value::undefined();\n";
+    }
+}
+
+/* Picks the variables of the current body that can live in plain doubles:
+every assignment stores a number and every read is proven to find one.
+Functions that define closures keep all their locals as values, so do
+globals that any function refers to.*/
+void CppEmitter::findNumbers(const ASTNode* body) {
+    NumberScan scan{state->types, {}, {}, false};
+    scanNumbers(body, scan);
+    if (!state->isScript && scan.definesFunctions) {
+        return;
+    }
+    for (const auto& identifier : scan.assigned) {
+        if (scan.excluded.count(identifier) || state->types.isPersistent(identifier)) {
+            continue;
+        }
+        if (state->isScript && (functionNames.count(identifier) || isBuiltinName(identifier))) {
+            continue;
+        }
+        if (!state->isScript && slot(identifier) <= static_cast<int>(state->node->parameters.size())) {
+            continue;
+        }
+        state->numbers.insert(identifier);
+    }
+}
+
+// Slot of a local variable, or -1 for names that live in an enclosing scope
+int CppEmitter::slot(const std::string& identifier) const {
+    if (state->isScript || state->types.isPersistent(identifier)) {
+        return -1;
+    }
+    auto it = state->slots.find(identifier);
+    if (it != state->slots.end()) {
+        return static_cast<int>(it->second);
+    }
+    if (identifier == state->node->name.text()) {
+        return static_cast<int>(state->node->parameters.size());
+    }
+    return -1;
+}
+
+std::string CppEmitter::global(const std::string& identifier) const {
+    return "g" + std::to_string(globals.at(identifier));
+}
+
+// The global a name falls back to, for names the script can bind
+std::string CppEmitter::globalPointer(const std::string& identifier) const {
+    if (!globals.count(identifier) || globalNumbers.count(identifier)) {
+        return "nullptr";
+    }
+    return "&" + global(identifier);
+}
+
+std::string CppEmitter::fresh() {
+    ++state->declarations;
+    return "t" + std::to_string(temporaries++);
+}
+
+// Stores an intermediate result in a new local, which fixes its evaluation order
+std::string CppEmitter::temporary(Repr repr, const std::string& code) {
+    std::string name = fresh();
+    const char* type = repr == Repr::Double ? "double" : repr == Repr::Bool ? "bool" : "Value";
+    line() << type << " " << name << " = " << code << ";\n";
+    return name;
+}
+
+std::string CppEmitter::asValue(const Operand& operand) const {
+    return operand.repr == Repr::Value ? operand.code : "Value(" + operand.code + ")";
+}
+
+std::string CppEmitter::asDouble(const Operand& operand) const {
+    return operand.repr == Repr::Value ? operand.code + ".getDouble()" : operand.code;
+}
+
+std::string CppEmitter::asBool(const Operand& operand) const {
+    return operand.repr == Repr::Value ? operand.code + ".getBool()" : operand.code;
+}
+
+// A condition, which must be a bool unless the type inference proved it is one
+std::string CppEmitter::condition(const ASTNode* node) {
+    Operand test = emitExpression(node);
+    if (state->types.typeOf(node) == StaticType::Bool) {
+        return asBool(test);
+    }
+    return asValue(test) + ".asBool()";
+}
+
+// Gathers the arguments of a call in an array the callee takes them from
+std::string CppEmitter::argumentArray(const std::vector<Operand>& arguments) {
+    if (arguments.empty()) {
+        return "nullptr";
+    }
+    std::string name = fresh();
+    std::ostream& out = line() << "Value " << name << "[] = {";
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        out << (i > 0 ? ", " : "") << asValue(arguments[i]);
+    }
+    out << "};\n";
+    return name;
+}
+
+std::ostream& CppEmitter::line() {
+    return state->body << std::string(4 * state->indent, ' ');
+}
+
+void CppEmitter::open(const std::string& text) {
+    line() << text << "\n";
+    ++state->indent;
+}
+
+void CppEmitter::close(const std::string& text) {
+    --state->indent;
+    line() << text << "\n";
+}
@@ -0,0 +1,88 @@
+#ifndef CPP_EMITTER_H
+#define CPP_EMITTER_H
+
+#include "ASTNodes.h"
+#include "typeInference.h"
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/* Translates a Scrypt program into a self-contained C++ translation unit that
+behaves like running it on the VM: same output, same errors and exit codes.
+Every script function becomes a C++ function over the runtime's Value type,
+while variables and operators the type inference proves to be numbers or bools
+are plain doubles and bools.*/
+
+class CppEmitter {
+public:
+    explicit CppEmitter(std::ostream& os);
+
+    void emit(const ASTNode* program);
+
+private:
+    // How the C++ expression of an operand holds its value
+    enum class Repr { Value, Double, Bool };
+
+    struct Operand {
+        std::string code;
+        Repr repr;
+    };
+
+    // Per-function translation state, mirroring the compiler's slot layout
+    struct FunctionState {
+        const FunctionNode* node;
+        bool isScript;
+        std::unordered_map<std::string, size_t> slots;
+        std::vector<std::string> locals;
+        std::unordered_set<std::string> declared;
+        std::unordered_set<std::string> numbers;    // variables held in plain doubles
+        TypeInference types;
+        std::ostringstream body;
+        int indent;
+        bool tailLoop;
+        size_t declarations;    // temporaries the body declares
+    };
+
+    bool emitFunction(size_t index, const FunctionNode* node);
+    void emitStatement(const ASTNode* node);
+    Operand emitExpression(const ASTNode* node);
+    void emitIf(const IfNode* node);
+    void emitWhile(const WhileNode* node);
+    void emitReturn(const ReturnNode* node);
+    Operand emitAssignment(const AssignmentNode* node);
+    Operand emitCall(const CallNode* node, bool isTailCall = false);
+    Operand emitBinaryOperation(const BinaryOpNode* node);
+    Operand emitVariable(const VariableNode* node);
+    void emitFunctionValue(const FunctionNode* node);
+    void emitSet(const std::string& identifier, const Operand& value);
+    void emitUnset(const std::string& identifier);
+    void findNumbers(const ASTNode* body);
+
+    int slot(const std::string& identifier) const;
+    std::string global(const std::string& identifier) const;
+    std::string globalPointer(const std::string& identifier) const;
+    std::string fresh();
+    std::string temporary(Repr repr, const std::string& code);
+    std::string asValue(const Operand& operand) const;
+    std::string asDouble(const Operand& operand) const;
+    std::string asBool(const Operand& operand) const;
+    std::string condition(const ASTNode* node);
+    std::string argumentArray(const std::vector<Operand>& arguments);
+    std::ostream& line();
+    void open(const std::string& text);
+    void close(const std::string& text = "}");
+
+    std::ostream& os;
+    std::unordered_map<std::string, size_t> globals;
+    std::unordered_set<std::string> globalNumbers;
+    std::unordered_set<std::string> functionNames;     // identifiers used inside any function
+    std::vector<std::string> functions;
+    size_t temporaries;
+    size_t frameBytes;      // stack bound for the largest function's frame
+    FunctionState* state;
+};
+
+#endif // CPP_EMITTER_H
@@ -0,0 +1,517 @@
+#include "cppRuntime.h"
+
+const char* const CPP_RUNTIME = R"RUNTIME(// Generated by scrypt --emit-cpp
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace scrypt {
+
+class Value;
+struct Env;
+using Builtin = Value (*)(Value* args, size_t count);
+using Code = Value (*)(const Value& self, Value* args);
+
+// A function value: its translated body and the scope it closes over
+struct Closure {
+    Code code;
+    size_t arity;
+    std::shared_ptr<Env> env;     // lookups past the end of its chain go to the globals
+};
+
+// The Value of value.cpp, plus a marker a function returns to request a tail call
+class Value {
+public:
+    enum class Type { Double, Bool, Function, Null, Array, BuiltinFunction, Undefined, TailCall };
+
+    Value() : type(Type::Null) {}
+    Value(double value) : type(Type::Double), doubleValue(value) {}
+    Value(bool value) : type(Type::Bool), boolValue(value) {}
+    Value(std::shared_ptr<Closure> function) : type(Type::Function) {
+        new (&functionValue) std::shared_ptr<Closure>(std::move(function));
+    }
+    Value(std::vector<Value> array) : type(Type::Array) {
+        new (&arrayValue) std::shared_ptr<std::vector<Value>>(std::make_shared<std::vector<Value>>(std::move(array)));
+    }
+    Value(Builtin function) : type(Type::BuiltinFunction), builtinFunction(function) {}
+    Value(const Value& other) { copyFrom(other); }
+    Value(Value&& other) noexcept { moveFrom(std::move(other)); }
+    Value& operator=(const Value& other) {
+        if (this != &other) {
+            cleanUp();
+            copyFrom(other);
+        }
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            cleanUp();
+            moveFrom(std::move(other));
+        }
+        return *this;
+    }
+    ~Value() { cleanUp(); }
+
+    static Value undefined() {
+        Value value;
+        value.type = Type::Undefined;
+        return value;
+    }
+    static Value tailCall() {
+        Value value;
+        value.type = Type::TailCall;
+        return value;
+    }
+
+    Type getType() const { return type; }
+    bool isUndefined() const { return type == Type::Undefined; }
+    double getDouble() const { return doubleValue; }
+    bool getBool() const { return boolValue; }
+
+    double asDouble() const {
+        if (type != Type::Double) {
+            throw std::runtime_error("Runtime error: invalid operand type.");
+        }
+        return doubleValue;
+    }
+    bool asBool() const {
+        if (type != Type::Bool) {
+            throw std::runtime_error("Runtime error: condition is not a bool.");
+        }
+        return boolValue;
+    }
+    const Closure& asFunction() const {
+        if (type != Type::Function) {
+            throw std::runtime_error("Runtime error: not a function.");
+        }
+        return *functionValue;
+    }
+    const Closure& getFunction() const { return *functionValue; }
+    bool isArray() const { return type == Type::Array; }
+    std::vector<Value>& asArray() const {
+        if (type != Type::Array) {
+            throw std::runtime_error("Runtime error: not an array.");
+        }
+        return *arrayValue;
+    }
+
+    bool equals(const Value& other) const {
+        if (type != other.type) return false;
+        switch (type) {
+            case Type::Null:
+                return true;
+            case Type::Bool:
+                return boolValue == other.boolValue;
+            case Type::Double:
+                return doubleValue == other.doubleValue;
+            case Type::Array: {
+                const auto& thisArray = *arrayValue;
+                const auto& otherArray = *other.arrayValue;
+                if (thisArray.size() != otherArray.size()) {
+                    return false;
+                }
+                for (size_t i = 0; i < thisArray.size(); ++i) {
+                    if (!thisArray[i].equals(otherArray[i])) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            case Type::BuiltinFunction:
+                return builtinFunction == other.builtinFunction;
+            default:
+                throw std::runtime_error("Unsupported type in Value::equals");
+        }
+    }
+
+    Value deepCopy() const {
+        switch (type) {
+            case Type::Double:
+            case Type::Bool:
+            case Type::Null:
+                return *this;
+            case Type::Array: {
+                std::vector<Value> copied;
+                copied.reserve(arrayValue->size());
+                for (const auto& element : *arrayValue) {
+                    copied.push_back(element.deepCopy());
+                }
+                return Value(std::move(copied));
+            }
+            default:
+                throw std::runtime_error("Unknown or unsupported type for deepCopy");
+        }
+    }
+
+private:
+    Type type;
+    union {
+        double doubleValue;
+        bool boolValue;
+        std::shared_ptr<Closure> functionValue;
+        std::shared_ptr<std::vector<Value>> arrayValue;
+        Builtin builtinFunction;
+    };
+
+    void cleanUp() {
+        if (type == Type::Function) {
+            functionValue.~shared_ptr();
+        } else if (type == Type::Array) {
+            arrayValue.~shared_ptr();
+        }
+        type = Type::Null;
+    }
+    void copyFrom(const Value& other) {
+        type = other.type;
+        switch (type) {
+            case Type::Function:
+                new (&functionValue) std::shared_ptr<Closure>(other.functionValue);
+                break;
+            case Type::Array:
+                new (&arrayValue) std::shared_ptr<std::vector<Value>>(other.arrayValue);
+                break;
+            case Type::BuiltinFunction:
+                builtinFunction = other.builtinFunction;
+                break;
+            default:
+                doubleValue = other.doubleValue;
+                break;
+        }
+    }
+    void moveFrom(Value&& other) {
+        type = other.type;
+        switch (type) {
+            case Type::Function:
+                new (&functionValue) std::shared_ptr<Closure>(std::move(other.functionValue));
+                other.functionValue.~shared_ptr();
+                break;
+            case Type::Array:
+                new (&arrayValue) std::shared_ptr<std::vector<Value>>(std::move(other.arrayValue));
+                other.arrayValue.~shared_ptr();
+                break;
+            case Type::BuiltinFunction:
+                builtinFunction = other.builtinFunction;
+                break;
+            default:
+                doubleValue = other.doubleValue;
+                break;
+        }
+        other.type = Type::Null;
+    }
+};
+
+/* The variables a function keeps from call to call, or the locals a nested
+function captured when it was defined, chained to the enclosing function's
+scope.*/
+struct Env {
+    std::shared_ptr<Env> parent;
+    std::unordered_map<std::string, Value> variables;
+};
+
+[[noreturn]] inline void fail(const char* message) {
+    throw std::runtime_error(message);
+}
+
+// Finds a variable in a captured scope chain, then in the globals
+inline Value* find(Env* env, const char* name, Value* global) {
+    for (; env; env = env->parent.get()) {
+        auto it = env->variables.find(name);
+        if (it != env->variables.end()) {
+            return &it->second;
+        }
+    }
+    return global && !global->isUndefined() ? global : nullptr;
+}
+
+inline const Value& lookup(Env* env, const char* name, Value* global) {
+    Value* value = find(env, name, global);
+    if (!value) {
+        throw std::runtime_error(std::string("Runtime error: unknown identifier ") + name);
+    }
+    return *value;
+}
+
+// Reads a local slot, which falls back to the enclosing scopes while it is unassigned
+inline const Value& local(const Value& slot, Env* env, const char* name, Value* global) {
+    return slot.isUndefined() ? lookup(env, name, global) : slot;
+}
+
+// Generic semantics of the arithmetic and comparison operators
+inline double add(const Value& left, const Value& right) { return left.asDouble() + right.asDouble(); }
+inline double subtract(const Value& left, const Value& right) { return left.asDouble() - right.asDouble(); }
+inline double multiply(const Value& left, const Value& right) { return left.asDouble() * right.asDouble(); }
+inline double divide(double left, double right) {
+    if (right == 0) {
+        fail("Division by zero.");
+    }
+    return left / right;
+}
+inline double divide(const Value& left, const Value& right) {
+    if (right.asDouble() == 0) {
+        fail("Division by zero.");
+    }
+    return left.asDouble() / right.asDouble();
+}
+inline double modulo(double left, double right) {
+    if (right == 0) {
+        fail("Modulo by zero.");
+    }
+    return std::fmod(left, right);
+}
+inline double modulo(const Value& left, const Value& right) {
+    if (right.asDouble() == 0) {
+        fail("Modulo by zero.");
+    }
+    return std::fmod(left.asDouble(), right.asDouble());
+}
+inline bool less(const Value& left, const Value& right) { return left.asDouble() < right.asDouble(); }
+inline bool lessEqual(const Value& left, const Value& right) { return left.asDouble() <= right.asDouble(); }
+inline bool greater(const Value& left, const Value& right) { return left.asDouble() > right.asDouble(); }
+inline bool greaterEqual(const Value& left, const Value& right) { return left.asDouble() >= right.asDouble(); }
+inline bool logicalAnd(const Value& left, const Value& right) { return left.asBool() && right.asBool(); }
+inline bool logicalXor(const Value& left, const Value& right) { return left.asBool() != right.asBool(); }
+inline bool logicalOr(const Value& left, const Value& right) { return left.asBool() || right.asBool(); }
+
+// Checks an index operand and converts it to a position in the array
+inline size_t arrayIndex(const Value& indexValue, const Value& arrayValue) {
+    if (indexValue.getType() != Value::Type::Double) {
+        fail("Runtime error: index is not a number.");
+    }
+    double intPart;
+    if (std::modf(indexValue.getDouble(), &intPart) != 0.0) {
+        fail("Runtime error: index is not an integer.");
+    }
+    int index = static_cast<int>(intPart);
+    if (index < 0 || index >= static_cast<int>(arrayValue.asArray().size())) {
+        fail("Runtime error: index out of bounds.");
+    }
+    return static_cast<size_t>(index);
+}
+
+inline Value element(const Value& arrayValue, const Value& indexValue) {
+    size_t position = arrayIndex(indexValue, arrayValue);
+    return arrayValue.asArray()[position];
+}
+
+inline void setIndex(Value* arrayValue, const Value& indexValue, const Value& value) {
+    if (!arrayValue || !arrayValue->isArray()) {
+        fail("Runtime error: not an array.");
+    }
+    size_t position = arrayIndex(indexValue, *arrayValue);
+    arrayValue->asArray()[position] = value;
+}
+
+inline Value len(Value* args, size_t count) {
+    if (count != 1 || !args[0].isArray()) {
+        fail("Runtime error: incorrect argument count.");
+    }
+    return Value(static_cast<double>(args[0].asArray().size()));
+}
+
+inline Value pop(Value* args, size_t count) {
+    if (count != 1 || !args[0].isArray()) {
+        fail("Runtime error: incorrect argument count.");
+    }
+    auto& array = args[0].asArray();
+    if (array.empty()) {
+        fail("pop from an empty array.");
+    }
+    Value poppedValue = std::move(array.back());
+    array.pop_back();
+    return poppedValue;
+}
+
+inline Value push(Value* args, size_t count) {
+    if (count != 2 || !args[0].isArray()) {
+        fail("Runtime error: incorrect argument count.");
+    }
+    args[0].asArray().push_back(args[1]);
+    return Value();
+}
+
+inline void print(const Value& value) {
+    switch (value.getType()) {
+        case Value::Type::Double:
+            std::cout << value.getDouble();
+            break;
+        case Value::Type::Bool:
+            std::cout << std::boolalpha << value.getBool();
+            break;
+        case Value::Type::Null:
+            std::cout << "null";
+            break;
+        case Value::Type::Array: {
+            std::cout << "[";
+            const auto& array = value.asArray();
+            for (size_t i = 0; i < array.size(); ++i) {
+                if (i > 0) std::cout << ", ";
+                print(array[i]);
+            }
+            std::cout << "]";
+            break;
+        }
+        default:
+            std::cout << "/* Unsupported type */";
+            break;
+    }
+}
+
+inline void println(const Value& value) {
+    print(value);
+    std::cout << '\n';
+}
+
+inline void println(double value) {
+    std::cout << value << '\n';
+}
+
+inline void println(bool value) {
+    std::cout << std::boolalpha << value << '\n';
+}
+
+// Calls run on the native stack, the depth counts the script itself like the VM's frames do
+size_t callDepth = 1;
+size_t maxCallDepth = 1000000;
+
+/* Lowest native stack address a call may start at. Deep recursion fails here
+like it does at the depth limit when the stack turns out smaller than sized.*/
+const char* stackLimit = nullptr;
+
+struct PendingTailCall {
+    Value callee;
+    std::vector<Value> args;
+};
+PendingTailCall pendingTailCall;
+
+inline const Closure& checkCall(const Value& callee, size_t argc) {
+    const Closure& closure = callee.asFunction();
+    if (closure.arity != argc) {
+        fail("Runtime error: incorrect argument count.");
+    }
+    return closure;
+}
+
+// Runs a call, and the tail calls it ends in without growing the depth
+inline Value call(const Value& callee, Value* args, size_t argc) {
+    const Closure& closure = checkCall(callee, argc);
+    if (callDepth >= maxCallDepth || static_cast<const char*>(__builtin_frame_address(0)) < stackLimit) {
+        fail("Runtime error: stack overflow.");
+    }
+    ++callDepth;
+    Value result = closure.code(callee, args);
+    if (result.getType() == Value::Type::TailCall) {
+        Value next;
+        std::vector<Value> nextArgs;
+        do {
+            next = std::move(pendingTailCall.callee);
+            nextArgs.swap(pendingTailCall.args);
+            result = next.getFunction().code(next, nextArgs.data());
+        } while (result.getType() == Value::Type::TailCall);
+    }
+    --callDepth;
+    return result;
+}
+
+// Hands a call in tail position back to the caller's call loop
+inline Value tailCall(const Value& callee, Value* args, size_t argc) {
+    checkCall(callee, argc);
+    pendingTailCall.callee = callee;
+    pendingTailCall.args.clear();
+    for (size_t i = 0; i < argc; ++i) {
+        pendingTailCall.args.push_back(std::move(args[i]));
+    }
+    return Value::tailCall();
+}
+
+inline Value makeFunction(Code code, size_t arity, std::shared_ptr<Env> env) {
+    return Value(std::make_shared<Closure>(Closure{code, arity, std::move(env)}));
+}
+
+// Runtime errors that exit with code 3 instead of 2
+inline bool isExitThreeError(const std::string& message) {
+    return message == "Runtime error: condition is not a bool." ||
+           message == "Runtime error: incorrect argument count." ||
+           message == "Runtime error: not a function." ||
+           message == "Runtime error: unexpected return." ||
+           message == "Runtime error: stack overflow.";
+}
+
+struct Program {
+    void (*script)();
+    size_t stackSize;
+    size_t margin;
+    int exitCode;
+};
+
+inline void* runScript(void* argument) {
+    Program* program = static_cast<Program*>(argument);
+    stackLimit = static_cast<const char*>(__builtin_frame_address(0)) - program->stackSize + program->margin;
+    try {
+        program->script();
+    } catch (const std::runtime_error& e) {
+        std::cout << e.what() << std::endl;
+        program->exitCode = isExitThreeError(e.what()) ? 3 : 2;
+    } catch (...) {
+        std::cout << "Runtime error: unexpected return." << std::endl;
+        program->exitCode = 3;
+    }
+    return nullptr;
+}
+
+/* Runs the script on a thread whose stack is large enough for the deepest
+call the depth limit allows, given the largest frame the emitter counted. When
+the system can't provide that much, the stack guard in call reports the
+overflow instead.*/
+inline int run(int argc, char* argv[], void (*script)(), size_t frameBytes) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--max-depth=", 12) == 0) {
+            maxCallDepth = std::strtoull(argv[i] + 12, nullptr, 10);
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    // Room below the limit for one more frame and the runtime work it does
+    size_t margin = (256 << 10) + frameBytes;
+    size_t perCall = frameBytes + 512;
+    size_t stackSize = maxCallDepth < (SIZE_MAX - margin) / perCall ? margin + maxCallDepth * perCall : SIZE_MAX;
+    Program program{script, 0, margin, 0};
+    pthread_t thread;
+    bool started = false;
+    for (; !started && stackSize >= 2 * margin; stackSize /= 2) {
+        pthread_attr_t attributes;
+        pthread_attr_init(&attributes);
+        program.stackSize = stackSize;
+        started = pthread_attr_setstacksize(&attributes, stackSize) == 0 &&
+                  pthread_create(&thread, &attributes, runScript, &program) == 0;
+        pthread_attr_destroy(&attributes);
+    }
+    if (started) {
+        pthread_join(thread, nullptr);
+    } else {
+        // The main thread's stack, less what already runs on it
+        rlimit limit;
+        size_t mainStack = 8 << 20;
+        if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+            mainStack = limit.rlim_cur;
+        }
+        program.stackSize = mainStack / 2;
+        runScript(&program);
+    }
+    std::cout.flush();
+    return program.exitCode;
+}
+
+// The translated program follows, inside this namespace
+)RUNTIME";
@@ -0,0 +1,10 @@
+#ifndef CPP_RUNTIME_H
+#define CPP_RUNTIME_H
+
+/* Source of the runtime library that scrypt --emit-cpp writes at the top of
+every translated program: the Value and scope model of value.cpp and the VM,
+the builtins and the entry point with the interpreter's error reporting. It
+leaves namespace scrypt open for the translated program.*/
+extern const char* const CPP_RUNTIME;
+
+#endif // CPP_RUNTIME_H
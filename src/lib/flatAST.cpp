@@ -0,0 +1,116 @@
+#include "flatAST.h"
+
+FlatAST::FlatAST(const ASTNode* root) : rootIndex(NO_NODE) {
+    rootIndex = add(root);
+}
+
+FlatIndex FlatAST::addNode(ASTNode::Type type, TokenType op, uint32_t value) {
+    nodes.push_back({static_cast<uint8_t>(type), static_cast<uint8_t>(op), value, 0, 0});
+    return static_cast<FlatIndex>(nodes.size() - 1);
+}
+
+// Children are added after their parent, so a node's child range is appended once they are all known
+void FlatAST::setChildren(FlatIndex node, const std::vector<FlatIndex>& nodeChildren) {
+    nodes[node].firstChild = static_cast<uint32_t>(children.size());
+    nodes[node].childCount = static_cast<uint32_t>(nodeChildren.size());
+    children.insert(children.end(), nodeChildren.begin(), nodeChildren.end());
+}
+
+// Appends a subtree in preorder and returns the index of its root
+FlatIndex FlatAST::add(const ASTNode* node) {
+    if (!node) {
+        return NO_NODE;
+    }
+    std::vector<FlatIndex> nodeChildren;
+    FlatIndex index;
+    switch (node->getType()) {
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            index = addNode(node->getType(), binaryOpNode->op.type, binaryOpNode->op.symbol);
+            nodeChildren = {add(binaryOpNode->left.get()), add(binaryOpNode->right.get())};
+            break;
+        }
+        case ASTNode::Type::NumberNode: {
+            index = addNode(node->getType(), TokenType::NUMBER, static_cast<uint32_t>(numbers.size()));
+            numbers.push_back(static_cast<const NumberNode*>(node)->value.number());
+            break;
+        }
+        case ASTNode::Type::BooleanNode: {
+            const Token& value = static_cast<const BooleanNode*>(node)->value;
+            index = addNode(node->getType(), value.type, value.symbol);
+            break;
+        }
+        case ASTNode::Type::VariableNode:
+            index = addNode(node->getType(), TokenType::IDENTIFIER,
+                            static_cast<const VariableNode*>(node)->identifier.symbol);
+            break;
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<const AssignmentNode*>(node);
+            index = addNode(node->getType());
+            nodeChildren = {add(assignmentNode->lhs.get()), add(assignmentNode->rhs.get())};
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            index = addNode(node->getType());
+            nodeChildren = {add(static_cast<const PrintNode*>(node)->expression.get())};
+            break;
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<const IfNode*>(node);
+            index = addNode(node->getType());
+            nodeChildren = {add(ifNode->condition.get()), add(ifNode->trueBranch.get()),
+                            add(ifNode->falseBranch.get())};
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<const WhileNode*>(node);
+            index = addNode(node->getType());
+            nodeChildren = {add(whileNode->condition.get()), add(whileNode->body.get())};
+            break;
+        }
+        case ASTNode::Type::BlockNode:
+            index = addNode(node->getType());
+            for (const auto& stmt : static_cast<const BlockNode*>(node)->statements) {
+                nodeChildren.push_back(add(stmt.get()));
+            }
+            break;
+        case ASTNode::Type::FunctionNode: {
+            auto functionNode = static_cast<const FunctionNode*>(node);
+            index = addNode(node->getType(), TokenType::DEF, functionNode->name.symbol);
+            nodeChildren.push_back(add(functionNode->body.get()));
+            for (const auto& param : functionNode->parameters) {
+                nodeChildren.push_back(addNode(ASTNode::Type::VariableNode, TokenType::IDENTIFIER, param.symbol));
+            }
+            break;
+        }
+        case ASTNode::Type::ReturnNode:
+            index = addNode(node->getType());
+            nodeChildren = {add(static_cast<const ReturnNode*>(node)->value.get())};
+            break;
+        case ASTNode::Type::CallNode: {
+            auto callNode = static_cast<const CallNode*>(node);
+            index = addNode(node->getType());
+            nodeChildren.push_back(add(callNode->callee.get()));
+            for (const auto& arg : callNode->arguments) {
+                nodeChildren.push_back(add(arg.get()));
+            }
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            index = addNode(node->getType());
+            for (const auto& element : static_cast<const ArrayLiteralNode*>(node)->elements) {
+                nodeChildren.push_back(add(element.get()));
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            index = addNode(node->getType());
+            nodeChildren = {add(lookupNode->array.get()), add(lookupNode->index.get())};
+            break;
+        }
+        default:
+            index = addNode(node->getType());
+            break;
+    }
+    setChildren(index, nodeChildren);
+    return index;
+}
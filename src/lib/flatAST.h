@@ -0,0 +1,69 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include "ASTNodes.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using FlatIndex = uint32_t;
+
+// Index of a child that is absent, like the missing else branch of an if
+const FlatIndex NO_NODE = UINT32_MAX;
+
+// One node of a FlatAST, 16 bytes wide
+struct FlatNode {
+    uint8_t type;           // ASTNode::Type
+    uint8_t op;             // TokenType of the operator of a binary operation or of a boolean
+    uint32_t value;         // symbol of a name or index into the numbers side table
+    uint32_t firstChild;    // start of the node's range in the child table
+    uint32_t childCount;
+};
+
+/* Flat encoding of the mParser AST. Nodes are stored in one contiguous array
+in preorder and refer to each other by 32-bit index: the children of a node
+are a range of the child table, identifiers and operator spellings are
+symbols of the SymbolTable and number literals live in the numbers table.
+Traversals of large scripts walk a few arrays instead of chasing heap
+pointers.
+
+Children by node type:
+    BinaryOpNode        left, right
+    AssignmentNode      lhs, rhs
+    PrintNode           expression
+    IfNode              condition, true branch, false branch or NO_NODE
+    WhileNode           condition, body
+    BlockNode           statements
+    FunctionNode        body, then one VariableNode per parameter
+    ReturnNode          value or NO_NODE
+    CallNode            callee, arguments
+    ArrayLiteralNode    elements
+    ArrayLookupNode     array, index*/
+class FlatAST {
+public:
+    explicit FlatAST(const ASTNode* root);
+
+    FlatIndex root() const { return rootIndex; }
+    size_t size() const { return nodes.size(); }
+
+    ASTNode::Type type(FlatIndex node) const { return static_cast<ASTNode::Type>(nodes[node].type); }
+    TokenType op(FlatIndex node) const { return static_cast<TokenType>(nodes[node].op); }
+    // Identifier of a variable, name of a function or spelling of an operator
+    const std::string& name(FlatIndex node) const { return SymbolTable::name(nodes[node].value); }
+    SymbolId symbol(FlatIndex node) const { return nodes[node].value; }
+    double number(FlatIndex node) const { return numbers[nodes[node].value]; }
+    size_t childCount(FlatIndex node) const { return nodes[node].childCount; }
+    FlatIndex child(FlatIndex node, size_t i) const { return children[nodes[node].firstChild + i]; }
+
+private:
+    FlatIndex add(const ASTNode* node);
+    FlatIndex addNode(ASTNode::Type type, TokenType op = TokenType::UNKNOWN, uint32_t value = 0);
+    void setChildren(FlatIndex node, const std::vector<FlatIndex>& nodeChildren);
+
+    std::vector<FlatNode> nodes;
+    std::vector<FlatIndex> children;
+    std::vector<double> numbers;
+    FlatIndex rootIndex;
+};
+
+#endif // FLAT_AST_H
@@ -0,0 +1,265 @@
+#include "formatter.h"
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+// function to create an indentation string
+std::string indentString(int indentLevel) {
+    return std::string(indentLevel * 4, ' ');
+}
+
+// function to format NULL
+void formatNullNode(std::ostream& os, const FlatAST&, FlatIndex, int indent) {
+    os << indentString(indent) << "null";
+}
+
+// function to format operation types
+void formatBinaryOpNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int) {
+    os << '(';
+    formatAST(os, ast, ast.child(node, 0), 0, false);
+    os << ' ' << ast.name(node) << ' ';
+    formatAST(os, ast, ast.child(node, 1), 0, false);
+    os << ')';
+}
+
+// function to format numbers (especially doubles)
+void formatNumberNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent) {
+    double value = ast.number(node);
+    if (std::floor(value) == value) {
+        os << indentString(indent) << static_cast<long>(value);
+    } else {
+        if (std::abs(value) < 0.0001 || std::abs(value) > 9999) {
+            std::ostringstream tempStream;
+            tempStream << std::scientific << value;
+            std::string str = tempStream.str();
+            size_t ePos = str.find('e');
+            if (ePos != std::string::npos) {
+                size_t lastNonZeroPos = str.find_last_not_of('0', ePos - 1);
+                if (lastNonZeroPos != std::string::npos && lastNonZeroPos + 1 < ePos) {
+                    str.erase(lastNonZeroPos + 1, ePos - lastNonZeroPos - 1);
+                }
+            }
+            os << indentString(indent) << str;
+        } else {
+            std::ostringstream tempStream;
+            tempStream << std::fixed << std::setprecision(2) << value;
+            std::string str = tempStream.str();
+            str.erase(str.find_last_not_of('0') + 1, std::string::npos); 
+            if (str.back() == '.') {
+                str.pop_back(); 
+            }
+            os << indentString(indent) << str;
+        }
+    }
+}
+
+
+// function to format Booleans
+void formatBooleanNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent) {
+    os << indentString(indent) << ast.name(node);
+}
+
+// function to format Variables
+void formatVariableNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent) {
+    os << indentString(indent) << ast.name(node);
+}
+
+// function to format if nodes
+void formatIfNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent) {
+    os << indentString(indent) << "if ";
+    formatAST(os, ast, ast.child(node, 0), 0);
+    os << " {\n";
+    formatAST(os, ast, ast.child(node, 1), indent + 1);
+    if (ast.child(node, 2) != NO_NODE) {
+        os << "\n" << indentString(indent) << "}\n" << indentString(indent) << "else {\n";
+        formatAST(os, ast, ast.child(node, 2), indent + 1);
+    }
+    os << "\n" << indentString(indent) << "}";
+}
+
+// function to format assignment nodes
+void formatAssignmentNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent) {
+    os << indentString(indent) << "(";
+
+    formatAST(os, ast, ast.child(node, 0), 0, false);
+
+    os << " = ";
+
+    formatAST(os, ast, ast.child(node, 1), 0, false);
+
+    os << ")";
+    os << ";";
+}
+
+
+
+/*FormatWhileNode is a funciton that is used to format While nodes*/
+void formatWhileNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent) {
+    os << indentString(indent) << "while ";
+    formatAST(os, ast, ast.child(node, 0), 0);
+    os << " {\n";
+    formatAST(os, ast, ast.child(node, 1), indent + 1);
+    os << "\n" << indentString(indent) << "}";
+}
+
+/*FormatPrintNode is a function that is used to format Print nodes*/
+void formatPrintNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent) {
+    os << indentString(indent) << "print ";
+    formatAST(os, ast, ast.child(node, 0), 0, false);
+    os << ";";
+}
+
+// function to format block nodes
+void formatBlockNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent) {
+    bool isFirstStatement = true;
+    for (size_t i = 0; i < ast.childCount(node); ++i) {
+        if (!isFirstStatement) {
+            os << "\n";
+        }
+        formatAST(os, ast, ast.child(node, i), indent);
+        isFirstStatement = false;
+    }
+}
+
+/*This is the main format function. Formats and Prints the AST.*/
+void formatAST(std::ostream& os, const std::unique_ptr<ASTNode>& node, int indent, bool isOutermost)  {
+    if (!node) return;
+
+    FlatAST ast(node.get());
+    formatAST(os, ast, ast.root(), indent, isOutermost);
+}
+
+// Formats one node of the flat tree
+void formatAST(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent, bool isOutermost) {
+    if (node == NO_NODE) return;
+
+    switch (ast.type(node)) {
+        case ASTNode::Type::BinaryOpNode:
+            formatBinaryOpNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::NumberNode:
+            formatNumberNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::BooleanNode:
+            formatBooleanNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::VariableNode:
+            formatVariableNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::AssignmentNode:
+            formatAssignmentNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::PrintNode:
+            formatPrintNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::IfNode:
+            formatIfNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::WhileNode:
+            formatWhileNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::BlockNode:
+            formatBlockNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::FunctionNode:
+            formatFunctionNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::ReturnNode:
+            formatReturnNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::CallNode:
+            formatCallNode(os, ast, node, indent, isOutermost);
+            break;
+        case ASTNode::Type::NullNode:
+            formatNullNode(os, ast, node, indent);
+            break;
+        case ASTNode::Type::ArrayLiteralNode:
+            formatArrayLiteralNode(os, ast, node, indent, isOutermost);
+            break;
+        case ASTNode::Type::ArrayLookupNode:
+            formatArrayLookupNode(os, ast, node, indent, isOutermost);
+            break;
+        default:
+            os << indentString(indent) << "/* Unknown node type */";
+            break;
+    }
+}
+
+
+// Function to format FunctionNode (function definitions)
+void formatFunctionNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent) {
+    os << indentString(indent) << "def " << ast.name(node) << "(";
+    size_t parameterCount = ast.childCount(node) - 1;
+    for (size_t i = 0; i < parameterCount; ++i) {
+        os << ast.name(ast.child(node, i + 1));
+        if (i < parameterCount - 1) {
+            os << ", ";
+        }
+    }
+    os << ") {";
+    
+    FlatIndex body = ast.child(node, 0);
+    if (body != NO_NODE && ast.type(body) == ASTNode::Type::BlockNode && ast.childCount(body) > 0) {
+        os << "\n";
+        formatAST(os, ast, body, indent + 1);
+        os << "\n" << indentString(indent);
+    } else {
+        os << "\n" << indentString(indent);
+    }
+    os << "}";
+}
+
+
+
+
+// Function to format ReturnNode (return statements)
+void formatReturnNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent) {
+    os << indentString(indent) << "return";
+    if (ast.child(node, 0) != NO_NODE) {
+        os << " ";
+        formatAST(os, ast, ast.child(node, 0), 0);
+    }
+    os << ";";
+}
+
+
+// Function to format CallNode (function calls)
+void formatCallNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent, bool isOutermost) {
+    formatAST(os, ast, ast.child(node, 0), indent, false);
+    os << '(';
+    size_t argumentCount = ast.childCount(node) - 1;
+    for (size_t i = 0; i < argumentCount; ++i) {
+        formatAST(os, ast, ast.child(node, i + 1), 0, false);
+        if (i < argumentCount - 1) {
+            os << ", ";
+        }
+    }
+    os << ")";
+    if (isOutermost && indent == 0) {
+        os << ";";
+    }
+}
+
+// Function to format Array Literals
+void formatArrayLiteralNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent, bool isOutermost) {
+    os << indentString(indent) << "[";
+    for (size_t i = 0; i < ast.childCount(node); ++i) {
+        formatAST(os, ast, ast.child(node, i), 0, false);
+        if (i < ast.childCount(node) - 1) os << ", ";
+    }
+    os << "]";
+
+    if (isOutermost && indent == 0) {
+        os << ";";
+    }
+}
+// Function to format ArrayLookupNode (array access and what it returns)
+void formatArrayLookupNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent, bool isOutermost) {
+    formatAST(os, ast, ast.child(node, 0), indent, false);
+    os << "[";
+    formatAST(os, ast, ast.child(node, 1), 0, false);
+    os << "]";
+    if (isOutermost && indent == 0) {
+        os << ";";
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef FORMATTER_H
+#define FORMATTER_H
+
+#include "ASTNodes.h"
+#include "flatAST.h"
+#include <memory>
+#include <ostream>
+#include <string>
+
+// Pretty printer for the mParser AST, shared by format and scrypt --dump-ast.
+// It runs over the flat encoding of the tree.
+
+std::string indentString(int indentLevel);
+void formatAST(std::ostream& os, const std::unique_ptr<ASTNode>& node, int indent, bool isOutermost = true);
+void formatAST(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent, bool isOutermost = true);
+void formatCallNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent, bool isOutermost = true);
+void formatBinaryOpNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatNumberNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatBooleanNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatVariableNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatIfNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatAssignmentNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatWhileNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatPrintNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatBlockNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatFunctionNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatReturnNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatNullNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent);
+void formatArrayLiteralNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent, bool isOutermost);
+void formatArrayLookupNode(std::ostream& os, const FlatAST& ast, FlatIndex node, int indent, bool isOutermost);
+
+#endif // FORMATTER_H
@@ -41,7 +41,7 @@ Node* InfixParser::assignmentExpression(std::ostream& os) {
         if (op.type == TokenType::ASSIGN) {
             if (node->type != NodeType::IDENTIFIER) {
                 clearTree(node);
-                throw std::runtime_error("Unexpected token at line " + std::to_string(op.line) + " column " + std::to_string(op.column) + ": " + op.value + "\n");
+                throw std::runtime_error("Unexpected token at line " + std::to_string(op.line()) + " column " + std::to_string(op.column()) + ": " + op.text() + "\n");
             }
             currentTokenIndex++;
             valueNode = assignmentExpression(os);
@@ -273,11 +273,11 @@ Node* InfixParser::factor(std::ostream& os) {
 
     try {
         if (token.type == TokenType::NUMBER) {
-            node = new Node(NodeType::NUMBER, std::stod(token.value));
+            node = new Node(NodeType::NUMBER, token.number());
             currentTokenIndex++;
         } 
         else if (token.type == TokenType::IDENTIFIER) {
-            node = new Node(NodeType::IDENTIFIER, 0, token.value);
+            node = new Node(NodeType::IDENTIFIER, 0, token.text());
             currentTokenIndex++;
         } 
         else if (token.type == TokenType::LEFT_PAREN) {
@@ -286,7 +286,7 @@ Node* InfixParser::factor(std::ostream& os) {
             node = expression(os);
             if (currentToken().type != TokenType::RIGHT_PAREN) {
                 clearTree(node); 
-                throw std::runtime_error("Unexpected token at line " + std::to_string(currentToken().line) + " column " + std::to_string(currentToken().column) + ": " + currentToken().value + "\n");
+                throw std::runtime_error("Unexpected token at line " + std::to_string(currentToken().line()) + " column " + std::to_string(currentToken().column()) + ": " + currentToken().text() + "\n");
             }
             unmatchedParentheses--;
             currentTokenIndex++;
@@ -300,7 +300,7 @@ Node* InfixParser::factor(std::ostream& os) {
             currentTokenIndex++;
         }
         else {
-            throw std::runtime_error("Unexpected token at line " + std::to_string(currentToken().line) + " column " + std::to_string(currentToken().column) + ": " + currentToken().value + "\n");
+            throw std::runtime_error("Unexpected token at line " + std::to_string(currentToken().line()) + " column " + std::to_string(currentToken().column()) + ": " + currentToken().text() + "\n");
         }
     } catch (...) {
         clearTree(node);
@@ -315,13 +315,13 @@ Node* InfixParser::parse(std::ostream& os) {
     try {
         root = expression(os);
         if (unmatchedParentheses != 0) {
-            throw std::runtime_error("Unexpected token at line " + std::to_string(currentToken().line) + " column " + std::to_string(currentToken().column) + ": " + currentToken().value + "\n");
+            throw std::runtime_error("Unexpected token at line " + std::to_string(currentToken().line()) + " column " + std::to_string(currentToken().column()) + ": " + currentToken().text() + "\n");
         }
         if (currentToken().type == TokenType::ADD || currentToken().type == TokenType::SUBTRACT) {
-            throw std::runtime_error("Unexpected token at line " + std::to_string(currentToken().line) + " column " + std::to_string(currentToken().column) + ": " + currentToken().value + "\n");
+            throw std::runtime_error("Unexpected token at line " + std::to_string(currentToken().line()) + " column " + std::to_string(currentToken().column()) + ": " + currentToken().text() + "\n");
         }
-        if (currentToken().type != TokenType::END || currentToken().value != "END") {
-            throw std::runtime_error("Unexpected token at line " + std::to_string(currentToken().line) + " column " + std::to_string(currentToken().column) + ": " + currentToken().value + "\n");
+        if (currentToken().type != TokenType::END || currentToken().text() != "END") {
+            throw std::runtime_error("Unexpected token at line " + std::to_string(currentToken().line()) + " column " + std::to_string(currentToken().column()) + ": " + currentToken().text() + "\n");
         }
     } catch (const std::runtime_error& e) {
         throw;  
@@ -0,0 +1,634 @@
+#include "jit.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define SCRYPT_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// What the analysis knows about a local slot or an operand
+enum class Kind : uint8_t { Undefined, Double, Bool, Self, Conflict };
+
+Kind join(Kind left, Kind right) {
+    return left == right ? left : Kind::Conflict;
+}
+
+// Kinds of the slots and operands before an instruction, reached says whether it runs at all
+struct State {
+    bool reached = false;
+    std::vector<Kind> slots;
+    std::vector<Kind> stack;
+};
+
+bool isBinaryOperator(OpCode op) {
+    return op >= OpCode::ADD && op <= OpCode::NOT_EQUAL_UNCHECKED;
+}
+
+bool isArithmetic(OpCode generic) {
+    return generic == OpCode::ADD || generic == OpCode::SUBTRACT || generic == OpCode::MULTIPLY ||
+           generic == OpCode::DIVIDE || generic == OpCode::MODULO;
+}
+
+bool isEquality(OpCode generic) {
+    return generic == OpCode::EQUAL || generic == OpCode::NOT_EQUAL;
+}
+
+/* Abstract interpretation of a function body over the kinds of its values,
+assuming the parameters hold doubles and every call returns the given kind.
+Fails on anything the code generator cannot translate: a read of a slot that
+may be unassigned (which would fall back to the enclosing scope), operands of
+the wrong kind (which would raise a type error) and every instruction that
+touches arrays, names, other functions or output.*/
+bool analyze(const Prototype& proto, Kind returns, std::vector<State>& states, size_t& maxHeight) {
+    const std::vector<Instruction>& code = proto.code;
+    size_t params = proto.parameters.size();
+    states.assign(code.size(), State());
+    maxHeight = 0;
+
+    State& entry = states[0];
+    entry.reached = true;
+    entry.slots.assign(proto.locals.size(), Kind::Undefined);
+    std::fill(entry.slots.begin(), entry.slots.begin() + params, Kind::Double);
+    entry.slots[params] = Kind::Self;
+
+    std::deque<size_t> worklist{0};
+    auto flow = [&](size_t target, const State& state) {
+        if (target >= code.size()) {
+            return false;
+        }
+        State& known = states[target];
+        if (!known.reached) {
+            known = state;
+            known.reached = true;
+            worklist.push_back(target);
+            return true;
+        }
+        if (known.stack.size() != state.stack.size()) {
+            return false;
+        }
+        bool changed = false;
+        for (size_t i = 0; i < known.slots.size(); ++i) {
+            Kind joined = join(known.slots[i], state.slots[i]);
+            changed |= joined != known.slots[i];
+            known.slots[i] = joined;
+        }
+        for (size_t i = 0; i < known.stack.size(); ++i) {
+            Kind joined = join(known.stack[i], state.stack[i]);
+            changed |= joined != known.stack[i];
+            known.stack[i] = joined;
+        }
+        if (changed) {
+            worklist.push_back(target);
+        }
+        return true;
+    };
+
+    while (!worklist.empty()) {
+        size_t pc = worklist.front();
+        worklist.pop_front();
+        State state = states[pc];
+        std::vector<Kind>& stack = state.stack;
+        // Superinstructions only speed up the interpreter, their sequences are still in place
+        Instruction in = {unfusedForm(code[pc].op), code[pc].a, code[pc].b};
+
+        if (isBinaryOperator(in.op) || (in.op >= OpCode::LOGICAL_AND && in.op <= OpCode::LOGICAL_OR_UNCHECKED)) {
+            if (stack.size() < 2) {
+                return false;
+            }
+            Kind right = stack.back();
+            stack.pop_back();
+            Kind left = stack.back();
+            stack.pop_back();
+            if (!isBinaryOperator(in.op)) {
+                if (left != Kind::Bool || right != Kind::Bool) {
+                    return false;
+                }
+                stack.push_back(Kind::Bool);
+            } else if (isEquality(genericForm(in.op)) && left == Kind::Bool && right == Kind::Bool) {
+                stack.push_back(Kind::Bool);
+            } else if (left == Kind::Double && right == Kind::Double) {
+                stack.push_back(isArithmetic(genericForm(in.op)) ? Kind::Double : Kind::Bool);
+            } else {
+                return false;
+            }
+            maxHeight = std::max(maxHeight, stack.size() + 1);
+            if (!flow(pc + 1, state)) {
+                return false;
+            }
+            continue;
+        }
+
+        switch (in.op) {
+            case OpCode::CONSTANT: {
+                Value::Type type = proto.constants[in.a].getType();
+                if (type != Value::Type::Double && type != Value::Type::Bool) {
+                    return false;
+                }
+                stack.push_back(type == Value::Type::Double ? Kind::Double : Kind::Bool);
+                break;
+            }
+            case OpCode::GET_LOCAL: {
+                Kind kind = state.slots[in.a];
+                if (kind == Kind::Undefined || kind == Kind::Conflict) {
+                    return false;
+                }
+                stack.push_back(kind);
+                break;
+            }
+            case OpCode::SET_LOCAL:
+                if (stack.empty()) {
+                    return false;
+                }
+                state.slots[in.a] = stack.back();
+                break;
+            case OpCode::UNSET_LOCAL:
+                // The slot keeps its value when the name exists outside, only known at run time
+                state.slots[in.a] = join(state.slots[in.a], Kind::Undefined);
+                break;
+            case OpCode::POP:
+                if (stack.empty()) {
+                    return false;
+                }
+                stack.pop_back();
+                break;
+            case OpCode::JUMP:
+                if (!flow(in.a, state)) {
+                    return false;
+                }
+                continue;
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::JUMP_IF_FALSE_UNCHECKED:
+                if (stack.empty() || stack.back() != Kind::Bool) {
+                    return false;
+                }
+                stack.pop_back();
+                if (!flow(in.a, state)) {
+                    return false;
+                }
+                break;
+            case OpCode::CALL:
+            case OpCode::TAIL_CALL: {
+                // Only calls of the function itself stay in machine code
+                if (stack.size() < in.a + 1 || stack.back() != Kind::Self || in.a != params) {
+                    return false;
+                }
+                for (size_t i = stack.size() - 1 - in.a; i < stack.size() - 1; ++i) {
+                    if (stack[i] != Kind::Double) {
+                        return false;
+                    }
+                }
+                if (in.op == OpCode::TAIL_CALL) {
+                    continue;   // restarts the body in the entry state
+                }
+                stack.resize(stack.size() - 1 - in.a);
+                stack.push_back(returns);
+                break;
+            }
+            case OpCode::RETURN:
+                if (stack.empty() || stack.back() != returns) {
+                    return false;
+                }
+                continue;
+            default:
+                return false;
+        }
+        maxHeight = std::max(maxHeight, stack.size());
+        if (!flow(pc + 1, state)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef SCRYPT_JIT_X86_64
+
+// Native stack the compiled code runs on, reserved lazily by the kernel
+const size_t NATIVE_STACK_SIZE = size_t(1) << 30;
+// Room kept free for fmod and the trampoline
+const size_t NATIVE_STACK_RESERVE = 64 * 1024;
+// Bytes a native frame takes besides its slots: return address, rbp, rbx, r12, r13, r14
+const size_t FRAME_OVERHEAD = 48;
+
+/* Emits x86-64 machine code. All slots and operands of a frame are addressed
+relative to rbx, r12 holds the remaining call depth and r13 the result pointer.*/
+class Assembler {
+public:
+    std::vector<uint8_t> code;
+
+    void bytes(std::initializer_list<uint8_t> values) {
+        code.insert(code.end(), values);
+    }
+
+    void imm32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void imm64(uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    // Instruction with a [rbx + disp32] memory operand, modrm carries the register field
+    void frameOperand(std::initializer_list<uint8_t> opcode, uint8_t modrm, size_t displacement) {
+        bytes(opcode);
+        code.push_back(modrm);
+        imm32(static_cast<uint32_t>(displacement));
+    }
+
+    void loadRax(size_t displacement)   { frameOperand({0x48, 0x8B}, 0x83, displacement); }
+    void storeRax(size_t displacement)  { frameOperand({0x48, 0x89}, 0x83, displacement); }
+    void loadXmm0(size_t displacement)  { frameOperand({0xF2, 0x0F, 0x10}, 0x83, displacement); }
+    void loadXmm1(size_t displacement)  { frameOperand({0xF2, 0x0F, 0x10}, 0x8B, displacement); }
+    void storeXmm0(size_t displacement) { frameOperand({0xF2, 0x0F, 0x11}, 0x83, displacement); }
+
+    // Jump or call with a rel32 operand, returns the position of the operand for patching
+    size_t branch(std::initializer_list<uint8_t> opcode) {
+        bytes(opcode);
+        imm32(0);
+        return code.size() - 4;
+    }
+
+    void patch(size_t at, size_t target) {
+        uint32_t rel = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&code[at], &rel, 4);
+    }
+};
+
+/* Translates a function whose analysis succeeded. The native signature is
+uint64_t f(const uint64_t* args, uint64_t* result, uint64_t depthLeft), it
+returns 0 with the result bits stored, or 1 when the interpreter has to run
+the call instead.*/
+std::vector<uint8_t> generate(const Prototype& proto, const std::vector<State>& states,
+                              size_t maxHeight, size_t& frameSize) {
+    size_t slotCount = proto.locals.size();
+    size_t params = proto.parameters.size();
+    frameSize = ((slotCount + maxHeight) * 8 + 15) & ~size_t(15);
+    auto slot = [](size_t index) { return index * 8; };
+    auto operand = [&](size_t index) { return (slotCount + index) * 8; };
+
+    Assembler as;
+    as.bytes({0x55});                               // push rbp
+    as.bytes({0x48, 0x89, 0xE5});                   // mov rbp, rsp
+    as.bytes({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56}); // push rbx, r12, r13, r14
+    as.bytes({0x48, 0x81, 0xEC});                   // sub rsp, frameSize
+    as.imm32(static_cast<uint32_t>(frameSize));
+    as.bytes({0x48, 0x89, 0xE3});                   // mov rbx, rsp
+    as.bytes({0x49, 0x89, 0xD4});                   // mov r12, rdx
+    as.bytes({0x49, 0x89, 0xF5});                   // mov r13, rsi
+    for (size_t i = 0; i < params; ++i) {
+        as.bytes({0x48, 0x8B, 0x87});               // mov rax, [rdi + 8i]
+        as.imm32(static_cast<uint32_t>(8 * i));
+        as.storeRax(slot(i));
+    }
+    size_t body = as.code.size();
+
+    std::vector<size_t> offsets(proto.code.size(), 0);
+    std::vector<std::pair<size_t, size_t>> jumps;   // operand position, target instruction
+    std::vector<size_t> bails;
+    std::vector<size_t> exits;
+
+    for (size_t pc = 0; pc < proto.code.size(); ++pc) {
+        const State& state = states[pc];
+        if (!state.reached) {
+            continue;
+        }
+        offsets[pc] = as.code.size();
+        Instruction in = {unfusedForm(proto.code[pc].op), proto.code[pc].a, proto.code[pc].b};
+        size_t height = state.stack.size();
+
+        if (isBinaryOperator(in.op)) {
+            OpCode generic = genericForm(in.op);
+            size_t left = operand(height - 2);
+            size_t right = operand(height - 1);
+            if (state.stack[height - 1] == Kind::Bool) {
+                as.loadRax(left);
+                as.frameOperand({0x48, 0x3B}, 0x83, right);             // cmp rax, [right]
+                as.bytes({0x0F, static_cast<uint8_t>(generic == OpCode::EQUAL ? 0x94 : 0x95), 0xC0});
+                as.bytes({0x0F, 0xB6, 0xC0});                            // movzx eax, al
+                as.storeRax(left);
+                continue;
+            }
+            as.loadXmm0(left);
+            as.loadXmm1(right);
+            switch (generic) {
+                case OpCode::ADD:      as.bytes({0xF2, 0x0F, 0x58, 0xC1}); break;
+                case OpCode::SUBTRACT: as.bytes({0xF2, 0x0F, 0x5C, 0xC1}); break;
+                case OpCode::MULTIPLY: as.bytes({0xF2, 0x0F, 0x59, 0xC1}); break;
+                case OpCode::DIVIDE:
+                case OpCode::MODULO:
+                    // A zero divisor raises an error, which the interpreter reports
+                    as.bytes({0x66, 0x0F, 0x57, 0xD2});                  // xorpd xmm2, xmm2
+                    as.bytes({0x66, 0x0F, 0x2E, 0xCA});                  // ucomisd xmm1, xmm2
+                    as.bytes({0x7A, 0x06});                              // jp +6
+                    bails.push_back(as.branch({0x0F, 0x84}));            // je bail
+                    if (generic == OpCode::DIVIDE) {
+                        as.bytes({0xF2, 0x0F, 0x5E, 0xC1});              // divsd xmm0, xmm1
+                    } else {
+                        double (*remainder)(double, double) = std::fmod;
+                        as.bytes({0x48, 0xB8});                          // mov rax, fmod
+                        as.imm64(reinterpret_cast<uint64_t>(remainder));
+                        as.bytes({0xFF, 0xD0});                          // call rax
+                    }
+                    break;
+                default: {
+                    // Flags of ucomisd: a < b and a <= b are tested as b > a and b >= a
+                    bool swap = generic == OpCode::LESS || generic == OpCode::LESS_EQUAL;
+                    as.bytes({0x66, 0x0F, 0x2E, static_cast<uint8_t>(swap ? 0xC8 : 0xC1)});
+                    switch (generic) {
+                        case OpCode::LESS:
+                        case OpCode::GREATER:
+                            as.bytes({0x0F, 0x97, 0xC0});                // seta al
+                            break;
+                        case OpCode::LESS_EQUAL:
+                        case OpCode::GREATER_EQUAL:
+                            as.bytes({0x0F, 0x93, 0xC0});                // setae al
+                            break;
+                        case OpCode::EQUAL:
+                            as.bytes({0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1}); // sete al, setnp cl
+                            as.bytes({0x20, 0xC8});                      // and al, cl
+                            break;
+                        default:
+                            as.bytes({0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1}); // setne al, setp cl
+                            as.bytes({0x08, 0xC8});                      // or al, cl
+                            break;
+                    }
+                    as.bytes({0x0F, 0xB6, 0xC0});                        // movzx eax, al
+                    as.storeRax(left);
+                    continue;
+                }
+            }
+            as.storeXmm0(left);
+            continue;
+        }
+
+        switch (in.op) {
+            case OpCode::CONSTANT: {
+                const Value& constant = proto.constants[in.a];
+                uint64_t bits = 0;
+                if (constant.isDouble()) {
+                    double number = constant.getDouble();
+                    std::memcpy(&bits, &number, sizeof(bits));
+                } else {
+                    bits = constant.getBool() ? 1 : 0;
+                }
+                as.bytes({0x48, 0xB8});                                  // mov rax, bits
+                as.imm64(bits);
+                as.storeRax(operand(height));
+                break;
+            }
+            case OpCode::GET_LOCAL:
+                if (state.slots[in.a] != Kind::Self) {
+                    as.loadRax(slot(in.a));
+                    as.storeRax(operand(height));
+                }
+                break;
+            case OpCode::SET_LOCAL:
+                as.loadRax(operand(height - 1));
+                as.storeRax(slot(in.a));
+                break;
+            case OpCode::UNSET_LOCAL:
+            case OpCode::POP:
+                break;
+            case OpCode::LOGICAL_AND:
+            case OpCode::LOGICAL_AND_UNCHECKED:
+            case OpCode::LOGICAL_XOR:
+            case OpCode::LOGICAL_XOR_UNCHECKED:
+            case OpCode::LOGICAL_OR:
+            case OpCode::LOGICAL_OR_UNCHECKED: {
+                uint8_t opcode = in.op == OpCode::LOGICAL_AND || in.op == OpCode::LOGICAL_AND_UNCHECKED ? 0x23
+                               : in.op == OpCode::LOGICAL_OR || in.op == OpCode::LOGICAL_OR_UNCHECKED ? 0x0B
+                               : 0x33;
+                as.loadRax(operand(height - 2));
+                as.frameOperand({0x48, opcode}, 0x83, operand(height - 1)); // and/or/xor rax, [right]
+                as.storeRax(operand(height - 2));
+                break;
+            }
+            case OpCode::JUMP:
+                jumps.emplace_back(as.branch({0xE9}), in.a);
+                break;
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::JUMP_IF_FALSE_UNCHECKED:
+                as.loadRax(operand(height - 1));
+                as.bytes({0x48, 0x85, 0xC0});                            // test rax, rax
+                jumps.emplace_back(as.branch({0x0F, 0x84}), in.a);       // jz target
+                break;
+            case OpCode::CALL: {
+                size_t args = operand(height - 1 - in.a);
+                as.bytes({0x4D, 0x85, 0xE4});                            // test r12, r12
+                bails.push_back(as.branch({0x0F, 0x84}));                // jz bail
+                as.frameOperand({0x48, 0x8D}, 0xBB, args);               // lea rdi, [args]
+                as.bytes({0x48, 0x89, 0xFE});                            // mov rsi, rdi
+                as.bytes({0x49, 0x8D, 0x54, 0x24, 0xFF});                // lea rdx, [r12 - 1]
+                as.patch(as.branch({0xE8}), 0);                          // call entry
+                as.bytes({0x48, 0x85, 0xC0});                            // test rax, rax
+                bails.push_back(as.branch({0x0F, 0x85}));                // jnz bail
+                break;
+            }
+            case OpCode::TAIL_CALL:
+                for (size_t i = 0; i < in.a; ++i) {
+                    as.loadRax(operand(height - 1 - in.a + i));
+                    as.storeRax(slot(i));
+                }
+                as.patch(as.branch({0xE9}), body);                       // jmp body
+                break;
+            case OpCode::RETURN:
+                as.loadRax(operand(height - 1));
+                as.bytes({0x49, 0x89, 0x45, 0x00});                      // mov [r13], rax
+                as.bytes({0x31, 0xC0});                                  // xor eax, eax
+                exits.push_back(as.branch({0xE9}));                      // jmp epilogue
+                break;
+            default:
+                break;
+        }
+    }
+
+    size_t bail = as.code.size();
+    as.bytes({0xB8, 0x01, 0x00, 0x00, 0x00});                            // mov eax, 1
+    size_t epilogue = as.code.size();
+    as.bytes({0x48, 0x8D, 0x65, 0xE0});                                  // lea rsp, [rbp - 32]
+    as.bytes({0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D, 0xC3});    // pop r14, r13, r12, rbx, rbp; ret
+
+    for (const auto& jump : jumps) {
+        as.patch(jump.first, offsets[jump.second]);
+    }
+    for (size_t at : bails) {
+        as.patch(at, bail);
+    }
+    for (size_t at : exits) {
+        as.patch(at, epilogue);
+    }
+    return as.code;
+}
+
+using Trampoline = uint64_t (*)(const void* entry, const uint64_t* args, uint64_t* result,
+                                uint64_t depthLeft, void* stackTop);
+
+#endif
+
+} // namespace
+
+Jit::Jit() : trampoline(nullptr), trampolineSize(0), stack(nullptr), stackSize(0) {
+#ifdef SCRYPT_JIT_X86_64
+    // Switches to the JIT's own stack, so deep native recursion cannot overflow the process stack
+    std::vector<uint8_t> code = {
+        0x55,                   // push rbp
+        0x48, 0x89, 0xE5,       // mov rbp, rsp
+        0x4C, 0x89, 0xC4,       // mov rsp, r8
+        0x48, 0x89, 0xF8,       // mov rax, rdi
+        0x48, 0x89, 0xF7,       // mov rdi, rsi
+        0x48, 0x89, 0xD6,       // mov rsi, rdx
+        0x48, 0x89, 0xCA,       // mov rdx, rcx
+        0xFF, 0xD0,             // call rax
+        0x48, 0x89, 0xEC,       // mov rsp, rbp
+        0x5D,                   // pop rbp
+        0xC3                    // ret
+    };
+    trampoline = allocate(code, trampolineSize);
+    void* memory = mmap(nullptr, NATIVE_STACK_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory != MAP_FAILED) {
+        stack = static_cast<uint8_t*>(memory);
+        stackSize = NATIVE_STACK_SIZE;
+    }
+#endif
+}
+
+Jit::~Jit() {
+#ifdef SCRYPT_JIT_X86_64
+    for (const auto& entry : compiled) {
+        munmap(entry.second.entry, entry.second.size);
+    }
+    if (trampoline) {
+        munmap(trampoline, trampolineSize);
+    }
+    if (stack) {
+        munmap(stack, stackSize);
+    }
+#endif
+}
+
+bool Jit::isSupported() {
+#ifdef SCRYPT_JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* Compiles a prototype if its body qualifies, and attaches the machine code to
+it. Functions returning doubles are tried first, then functions returning bools.*/
+bool Jit::compile(const Prototype& proto) {
+#ifdef SCRYPT_JIT_X86_64
+    if (!trampoline || !stack || proto.code.empty()) {
+        return false;
+    }
+    std::vector<State> states;
+    size_t maxHeight = 0;
+    Kind returns = Kind::Double;
+    if (!analyze(proto, returns, states, maxHeight)) {
+        returns = Kind::Bool;
+        if (!analyze(proto, returns, states, maxHeight)) {
+            return false;
+        }
+    }
+    size_t frameSize = 0;
+    std::vector<uint8_t> code = generate(proto, states, maxHeight, frameSize);
+    size_t size = 0;
+    void* entry = allocate(code, size);
+    if (!entry) {
+        return false;
+    }
+
+    auto existing = compiled.find(&proto);
+    if (existing != compiled.end()) {
+        munmap(existing->second.entry, existing->second.size);
+    }
+    NativeCode& native = compiled[&proto];
+    native = {entry, size, frameSize + FRAME_OVERHEAD,
+              returns == Kind::Double ? Value::Type::Double : Value::Type::Bool};
+    proto.native = &native;
+    addPerfMapEntry(entry, code.size(), proto.name);
+    return true;
+#else
+    (void)proto;
+    return false;
+#endif
+}
+
+/* Runs the machine code of a prototype on double arguments given as their
+bits. When the code gives up the prototype goes back to the interpreter for
+good, and the caller runs the call there.*/
+bool Jit::run(const Prototype& proto, const uint64_t* args, size_t depthLeft, Value& result) {
+#ifdef SCRYPT_JIT_X86_64
+    const NativeCode* native = proto.native;
+    size_t stackDepth = (stackSize - NATIVE_STACK_RESERVE) / native->frameBytes;
+    uint64_t bits = 0;
+    auto enter = reinterpret_cast<Trampoline>(trampoline);
+    if (enter(native->entry, args, &bits, std::min(depthLeft, stackDepth), stack + stackSize) != 0) {
+        proto.native = nullptr;
+        return false;
+    }
+    if (native->result == Value::Type::Double) {
+        double number;
+        std::memcpy(&number, &bits, sizeof(number));
+        result = Value(number);
+    } else {
+        result = Value(bits != 0);
+    }
+    return true;
+#else
+    (void)proto;
+    (void)args;
+    (void)depthLeft;
+    (void)result;
+    return false;
+#endif
+}
+
+// Copies machine code into fresh pages and makes them executable
+void* Jit::allocate(const std::vector<uint8_t>& code, size_t& size) {
+#ifdef SCRYPT_JIT_X86_64
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size = (code.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+    return memory;
+#else
+    (void)code;
+    size = 0;
+    return nullptr;
+#endif
+}
+
+// Lets perf attribute samples in JIT code to the script function
+void Jit::addPerfMapEntry(const void* start, size_t size, const std::string& name) {
+#ifdef SCRYPT_JIT_X86_64
+    char path[64];
+    std::snprintf(path, sizeof(path), "/tmp/perf-%d.map", static_cast<int>(getpid()));
+    if (FILE* file = std::fopen(path, "a")) {
+        std::fprintf(file, "%lx %zx scrypt:%s\n", reinterpret_cast<unsigned long>(start), size, name.c_str());
+        std::fclose(file);
+    }
+#else
+    (void)start;
+    (void)size;
+    (void)name;
+#endif
+}
@@ -0,0 +1,50 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "Bytecode.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Machine code of one prototype and what its frames need
+struct NativeCode {
+    void* entry;
+    size_t size;
+    size_t frameBytes;           // native stack one activation takes
+    Value::Type result;          // Double or Bool
+};
+
+/* Compiles hot script functions to x86-64 machine code. Only numeric kernels
+qualify: functions whose parameters are doubles and whose body only reads and
+writes its own locals, computes with doubles and bools, branches and calls
+itself. Such a function has no side effects, so when the machine code meets
+anything it does not handle (a division by zero, the call depth limit) it
+gives up and the interpreter runs the whole call again and reports the error.
+Every compiled function is listed in /tmp/perf-<pid>.map for perf.*/
+class Jit {
+public:
+    static const uint32_t DEFAULT_THRESHOLD = 100;
+
+    Jit();
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    static bool isSupported();
+    bool compile(const Prototype& proto);
+    bool run(const Prototype& proto, const uint64_t* args, size_t depthLeft, Value& result);
+
+private:
+    void* allocate(const std::vector<uint8_t>& code, size_t& size);
+    void addPerfMapEntry(const void* start, size_t size, const std::string& name);
+
+    std::unordered_map<const Prototype*, NativeCode> compiled;
+    void* trampoline;
+    size_t trampolineSize;
+    uint8_t* stack;              // separate native stack the compiled code runs on
+    size_t stackSize;
+};
+
+#endif // JIT_H
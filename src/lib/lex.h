@@ -1,8 +1,12 @@
 #ifndef LEX_H
 #define LEX_H
+#include <cstddef>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <sstream>
 #include "Token.h"
 
 // Lexer Header Definition
@@ -10,21 +14,49 @@
 class Lexer {
 public:
     Lexer(const std::string& input);
+    // Lexes a stream as it is read, see nextToken
+    explicit Lexer(std::istream& input);
     std::vector<Token> tokenize();
+    // Lexes a string on several threads, with the same result as tokenize()
+    std::vector<Token> tokenizeParallel(unsigned threads);
+    Token nextToken();
     void increaseLine(int line_count);
     bool isSyntaxError(std::vector<Token>& tokens);
+    void releaseRead();
     std::vector<std::string> errors;
 
 private:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+    static const size_t MIN_PIECE_SIZE = 256 * 1024;    // smallest piece worth a thread in tokenizeParallel
+
+    struct PieceSymbols;
+
+    Lexer(const std::string& piece, uint32_t base, PieceSymbols* symbols);
+    SymbolId intern(std::string_view text);
+    SymbolId internNumber(std::string_view text);
+
     char consume();
-    bool isDigit(char c);
-    bool isOperator(char c);
     Token number();
     Token op();
-    std::istringstream inputStream;
-    int line;
-    int col;
+    Token fixed(TokenType type, size_t start) const;
+    bool readChunk();
+    void addChunk();
+    std::istream* stream;               // null when lexing a string
+    std::string chunk;                  // the part of the input being lexed
+    size_t position;                    // of the next character in the chunk
+    bool started;
+    bool stopped;                       // after a malformed number
+    int line;                           // number of the first line of the next chunk
+    uint32_t base;                      // offset of the chunk in the SourcePositions
+    uint32_t releasedBase;              // chunks before this one go at the next releaseRead
+    PieceSymbols* pieceSymbols;         // where a piece of tokenizeParallel interns its text, else null
+
+};
 
+// The error a token the lexer could not make sense of is reported with
+class SyntaxError : public std::runtime_error {
+public:
+    explicit SyntaxError(const Token& token);
 };
 
 #endif
\ No newline at end of file
@@ -1,40 +1,391 @@
 #include "lex.h"
-#include <cctype>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
 #include <iostream>
 #include <iomanip>
+#include <optional>
 #include <sstream>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCRYPT_LEX_SIMD 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCRYPT_LEX_SIMD 16
+#endif
 
 using namespace std;
 
-Lexer::Lexer(const string& input) : inputStream(input), line(1), col(1) {}
+namespace {
+
+/* What a byte can start or continue. Only ASCII letters, digits and
+whitespace count, the same as the "C" locale, so the lexer does not change
+with the locale and bytes past 127 are always OTHER.*/
+enum CharClass : uint8_t { OTHER, SPACE, DIGIT, DOT, LETTER, PUNCTUATION, OPERATOR };
+
+struct CharTable {
+    std::array<CharClass, 256> classes{};
+    std::array<TokenType, 256> punctuation{};   // type of the single character tokens
+};
+
+constexpr CharTable makeCharTable() {
+    CharTable table;
+    for (auto& type : table.punctuation) {
+        type = TokenType::UNKNOWN;
+    }
+    for (unsigned char c : std::string_view(" \t\n\v\f\r")) {
+        table.classes[c] = SPACE;
+    }
+    for (int c = '0'; c <= '9'; ++c) {
+        table.classes[c] = DIGIT;
+    }
+    for (int c = 'a'; c <= 'z'; ++c) {
+        table.classes[c] = LETTER;
+        table.classes[c - 'a' + 'A'] = LETTER;
+    }
+    table.classes['_'] = LETTER;
+    table.classes['.'] = DOT;
+    const std::pair<char, TokenType> punctuation[] = {
+        {'(', TokenType::LEFT_PAREN}, {')', TokenType::RIGHT_PAREN},
+        {'{', TokenType::LEFT_BRACE}, {'}', TokenType::RIGHT_BRACE},
+        {';', TokenType::SEMICOLON}, {',', TokenType::COMMA},
+        {'[', TokenType::LBRACK}, {']', TokenType::RBRACK},
+    };
+    for (const auto& entry : punctuation) {
+        table.classes[static_cast<unsigned char>(entry.first)] = PUNCTUATION;
+        table.punctuation[static_cast<unsigned char>(entry.first)] = entry.second;
+    }
+    for (unsigned char c : std::string_view("+-*/%<>=!&^|")) {
+        table.classes[c] = OPERATOR;
+    }
+    return table;
+}
+
+constexpr CharTable charTable = makeCharTable();
+
+inline CharClass classOf(char c) {
+    return charTable.classes[static_cast<unsigned char>(c)];
+}
+
+/* The operator DFA. Operators are one character or one followed by '=', so
+the first character leads to a state that either accepts on its own or moves
+on '=' to the state of the two character operator. UNKNOWN means the state
+does not accept ('!' on its own).*/
+struct OperatorState {
+    TokenType alone = TokenType::UNKNOWN;
+    TokenType withEquals = TokenType::UNKNOWN;
+};
+
+constexpr std::array<OperatorState, 256> makeOperatorStates() {
+    std::array<OperatorState, 256> states{};
+    const std::pair<char, OperatorState> operators[] = {
+        {'+', {TokenType::ADD, TokenType::UNKNOWN}},
+        {'-', {TokenType::SUBTRACT, TokenType::UNKNOWN}},
+        {'*', {TokenType::MULTIPLY, TokenType::UNKNOWN}},
+        {'/', {TokenType::DIVIDE, TokenType::UNKNOWN}},
+        {'%', {TokenType::MODULO, TokenType::UNKNOWN}},
+        {'<', {TokenType::LESS, TokenType::LESS_EQUAL}},
+        {'>', {TokenType::GREATER, TokenType::GREATER_EQUAL}},
+        {'=', {TokenType::ASSIGN, TokenType::EQUAL}},
+        {'!', {TokenType::UNKNOWN, TokenType::NOT_EQUAL}},
+        {'&', {TokenType::LOGICAL_AND, TokenType::UNKNOWN}},
+        {'^', {TokenType::LOGICAL_XOR, TokenType::UNKNOWN}},
+        {'|', {TokenType::LOGICAL_OR, TokenType::UNKNOWN}},
+    };
+    for (const auto& entry : operators) {
+        states[static_cast<unsigned char>(entry.first)] = entry.second;
+    }
+    return states;
+}
+
+constexpr std::array<OperatorState, 256> operatorStates = makeOperatorStates();
+
+/* Keywords by a perfect hash of their length and first and last characters,
+so telling a keyword from an identifier takes one probe and one compare.
+makeKeywordTable fails to compile if two keywords ever share a slot.*/
+struct Keyword {
+    std::string_view spelling;
+    TokenType type = TokenType::IDENTIFIER;
+};
+
+const size_t KEYWORD_SLOTS = 32;
+
+constexpr size_t keywordSlot(std::string_view word) {
+    return (word.size() + static_cast<unsigned char>(word.front()) +
+            (static_cast<size_t>(static_cast<unsigned char>(word.back())) << 4)) & (KEYWORD_SLOTS - 1);
+}
+
+constexpr std::array<Keyword, KEYWORD_SLOTS> makeKeywordTable() {
+    std::array<Keyword, KEYWORD_SLOTS> table{};
+    const Keyword keywords[] = {
+        {"true", TokenType::BOOLEAN_TRUE}, {"false", TokenType::BOOLEAN_FALSE},
+        {"if", TokenType::IF}, {"while", TokenType::WHILE}, {"print", TokenType::PRINT},
+        {"else", TokenType::ELSE}, {"def", TokenType::DEF}, {"return", TokenType::RETURN},
+        {"null", TokenType::NULL_TOKEN}, {"len", TokenType::LEN}, {"pop", TokenType::POP},
+        {"push", TokenType::PUSH},
+    };
+    for (const auto& keyword : keywords) {
+        Keyword& slot = table[keywordSlot(keyword.spelling)];
+        if (!slot.spelling.empty()) {
+            throw std::logic_error("keyword hash collision");
+        }
+        slot = keyword;
+    }
+    return table;
+}
+
+constexpr std::array<Keyword, KEYWORD_SLOTS> keywordTable = makeKeywordTable();
+
+// The type of a word: its keyword's or IDENTIFIER
+inline TokenType keywordType(std::string_view word) {
+    const Keyword& keyword = keywordTable[keywordSlot(word)];
+    return keyword.spelling == word ? keyword.type : TokenType::IDENTIFIER;
+}
+
+/* Runs of whitespace, digits and identifier characters are skipped a block
+of 16 (SSE2) or 32 (AVX2, when built with -mavx2) bytes at a time: the
+bytes of a block are classified with a few compares, the match mask is moved
+into an integer and its first zero bit is where the run ends. Only the tail
+of the chunk shorter than a block goes through the table. Bytes past 127 are
+negative as signed chars, so they never fall in the ASCII ranges below.*/
+#ifdef SCRYPT_LEX_SIMD
+#if SCRYPT_LEX_SIMD == 32
+using Block = __m256i;
+inline Block load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline Block splat(char c) { return _mm256_set1_epi8(c); }
+inline Block equal(Block a, Block b) { return _mm256_cmpeq_epi8(a, b); }
+inline Block greater(Block a, Block b) { return _mm256_cmpgt_epi8(a, b); }
+inline Block both(Block a, Block b) { return _mm256_and_si256(a, b); }
+inline Block either(Block a, Block b) { return _mm256_or_si256(a, b); }
+inline uint32_t bits(Block b) { return static_cast<uint32_t>(_mm256_movemask_epi8(b)); }
+const uint32_t ALL_BITS = 0xFFFFFFFFu;
+#else
+using Block = __m128i;
+inline Block load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline Block splat(char c) { return _mm_set1_epi8(c); }
+inline Block equal(Block a, Block b) { return _mm_cmpeq_epi8(a, b); }
+inline Block greater(Block a, Block b) { return _mm_cmpgt_epi8(a, b); }
+inline Block both(Block a, Block b) { return _mm_and_si128(a, b); }
+inline Block either(Block a, Block b) { return _mm_or_si128(a, b); }
+inline uint32_t bits(Block b) { return static_cast<uint32_t>(_mm_movemask_epi8(b)); }
+const uint32_t ALL_BITS = 0xFFFFu;
+#endif
+
+// Bytes from low to high
+inline Block inRange(Block c, char low, char high) {
+    return both(greater(c, splat(static_cast<char>(low - 1))), greater(splat(static_cast<char>(high + 1)), c));
+}
+
+struct SpaceBytes {
+    Block operator()(Block c) const { return either(equal(c, splat(' ')), inRange(c, '\t', '\r')); }
+};
+
+struct DigitBytes {
+    Block operator()(Block c) const { return inRange(c, '0', '9'); }
+};
+
+struct WordBytes {
+    Block operator()(Block c) const {
+        return either(either(inRange(c, 'a', 'z'), inRange(c, 'A', 'Z')),
+                      either(inRange(c, '0', '9'), equal(c, splat('_'))));
+    }
+};
+#else
+struct SpaceBytes {};
+struct DigitBytes {};
+struct WordBytes {};
+#endif
+
+// The position of the first character from position on that is not in one of the classes
+template <typename Bytes>
+size_t skipRun(const std::string& text, size_t position, CharClass first, CharClass second) {
+#ifdef SCRYPT_LEX_SIMD
+    Bytes matches;
+    while (position + SCRYPT_LEX_SIMD <= text.size()) {
+        uint32_t ends = ~bits(matches(load(text.data() + position))) & ALL_BITS;
+        if (ends) {
+            return position + __builtin_ctz(ends);
+        }
+        position += SCRYPT_LEX_SIMD;
+    }
+#endif
+    while (position < text.size() && (classOf(text[position]) == first || classOf(text[position]) == second)) {
+        ++position;
+    }
+    return position;
+}
+
+inline size_t skipSpaces(const std::string& text, size_t position) { return skipRun<SpaceBytes>(text, position, SPACE, SPACE); }
+inline size_t skipDigits(const std::string& text, size_t position) { return skipRun<DigitBytes>(text, position, DIGIT, DIGIT); }
+inline size_t skipWord(const std::string& text, size_t position) { return skipRun<WordBytes>(text, position, LETTER, DIGIT); }
+
+// Appends the position after every newline of the text to lineStarts
+void findLineStarts(const std::string& text, std::vector<uint32_t>& lineStarts) {
+    size_t i = 0;
+#ifdef SCRYPT_LEX_SIMD
+    const Block newline = splat('\n');
+    for (; i + SCRYPT_LEX_SIMD <= text.size(); i += SCRYPT_LEX_SIMD) {
+        for (uint32_t found = bits(equal(load(text.data() + i), newline)); found; found &= found - 1) {
+            lineStarts.push_back(static_cast<uint32_t>(i + __builtin_ctz(found) + 1));
+        }
+    }
+#endif
+    for (; i < text.size(); ++i) {
+        if (text[i] == '\n') {
+            lineStarts.push_back(static_cast<uint32_t>(i + 1));
+        }
+    }
+}
+
+}
+
+Lexer::Lexer(const string& input)
+    : stream(nullptr), chunk(input), position(0), started(false), stopped(false), line(1), base(0), releasedBase(0),
+      pieceSymbols(nullptr) {}
+
+Lexer::Lexer(std::istream& input)
+    : stream(&input), position(0), started(false), stopped(false), line(1), base(0), releasedBase(0),
+      pieceSymbols(nullptr) {}
+
+// A piece of a string lexed by tokenizeParallel, whose positions are already recorded
+Lexer::Lexer(const std::string& piece, uint32_t base, PieceSymbols* symbols)
+    : stream(nullptr), chunk(piece), position(0), started(true), stopped(false), line(1), base(base),
+      releasedBase(0), pieceSymbols(symbols) {}
+
+/* The symbols of a piece lexed on a worker thread. Workers stay away from
+the process-wide SymbolTable: each interns into a table of its own, and the
+IDs of its tokens are swapped for SymbolTable IDs after the pieces are joined.*/
+struct Lexer::PieceSymbols {
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, SymbolId> ids;
+    std::vector<std::optional<double>> numbers;
+
+    SymbolId intern(std::string_view text) {
+        auto it = ids.find(text);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        SymbolId symbol = static_cast<SymbolId>(names.size());
+        names.emplace_back(text);
+        ids.emplace(names.back(), symbol);
+        numbers.emplace_back();
+        return symbol;
+    }
+};
+
+SymbolId Lexer::intern(std::string_view text) {
+    return pieceSymbols ? pieceSymbols->intern(text) : SymbolTable::intern(text);
+}
+
+SymbolId Lexer::internNumber(std::string_view text) {
+    if (!pieceSymbols) {
+        return SymbolTable::internNumber(text);
+    }
+    SymbolId symbol = pieceSymbols->intern(text);
+    if (!pieceSymbols->numbers[symbol]) {
+        pieceSymbols->numbers[symbol] = parseNumber(text);
+    }
+    return symbol;
+}
+
+// Interned text of the tokens whose spelling is fixed, looked up once
+static SymbolId spellingOf(TokenType type) {
+    static const std::vector<SymbolId> spellings = [] {
+        const std::pair<TokenType, const char*> fixed[] = {
+            {TokenType::LEFT_PAREN, "("}, {TokenType::RIGHT_PAREN, ")"},
+            {TokenType::LEFT_BRACE, "{"}, {TokenType::RIGHT_BRACE, "}"},
+            {TokenType::SEMICOLON, ";"}, {TokenType::COMMA, ","},
+            {TokenType::LBRACK, "["}, {TokenType::RBRACK, "]"},
+            {TokenType::ADD, "+"}, {TokenType::SUBTRACT, "-"}, {TokenType::MULTIPLY, "*"},
+            {TokenType::DIVIDE, "/"}, {TokenType::MODULO, "%"},
+            {TokenType::LESS, "<"}, {TokenType::LESS_EQUAL, "<="},
+            {TokenType::GREATER, ">"}, {TokenType::GREATER_EQUAL, ">="},
+            {TokenType::EQUAL, "=="}, {TokenType::NOT_EQUAL, "!="},
+            {TokenType::LOGICAL_AND, "&"}, {TokenType::LOGICAL_XOR, "^"}, {TokenType::LOGICAL_OR, "|"},
+            {TokenType::ASSIGN, "="},
+            {TokenType::BOOLEAN_TRUE, "true"}, {TokenType::BOOLEAN_FALSE, "false"},
+            {TokenType::IF, "if"}, {TokenType::WHILE, "while"}, {TokenType::PRINT, "print"},
+            {TokenType::ELSE, "else"}, {TokenType::DEF, "def"}, {TokenType::RETURN, "return"},
+            {TokenType::NULL_TOKEN, "null"}, {TokenType::LEN, "len"}, {TokenType::POP, "pop"},
+            {TokenType::PUSH, "push"}, {TokenType::END, "END"},
+        };
+        std::vector<SymbolId> table(static_cast<size_t>(TokenType::PUSH) + 1, NO_SYMBOL);
+        for (const auto& spelling : fixed) {
+            table[static_cast<size_t>(spelling.first)] = SymbolTable::intern(spelling.second);
+        }
+        return table;
+    }();
+    return spellings[static_cast<size_t>(type)];
+}
+
+// A token with a fixed spelling that starts at the given position of the chunk
+Token Lexer::fixed(TokenType type, size_t start) const {
+    return {type, spellingOf(type), base + static_cast<uint32_t>(start)};
+}
 
 // Outputs the Error Code when there is an incorrect S expression
 
 bool Lexer::isSyntaxError(std::vector<Token>& tokens) {
     for (const auto& token : tokens) {
-        if (token.type == TokenType::UNKNOWN && token.value != "END") {
-            std::cout << "Syntax error on line " << token.line << " column " << token.column << "." << std::endl;
+        if (token.type == TokenType::UNKNOWN && token.text() != "END") {
+            std::cout << SyntaxError(token).what() << std::endl;
             return true;
         }
     }
     return false;
 }
 
-//Reads the current character from the stream and keeps track of the column and line.
+//Reads the current character of the chunk.
 char Lexer::consume() {
-    char current = inputStream.get();
-    if (current == '\n') {
-        line++;
-        col = 1;
-    } else {
-        col++;
+    return chunk[position++];
+}
+
+/* Reads the next lines of the stream into the chunk: at least one, then the
+ones already buffered up to about CHUNK_SIZE bytes, so a slowly written script
+runs as its lines arrive. Like the drivers reading a whole script, every line
+read ends with a newline, so no token spans two chunks. Returns false at the
+end of the stream, leaving the last chunk in place.*/
+bool Lexer::readChunk() {
+    std::string next;
+    std::string text;
+    while (next.size() < CHUNK_SIZE && (next.empty() || stream->rdbuf()->in_avail() > 0) &&
+           std::getline(*stream, text)) {
+        next += text;
+        next += '\n';
+    }
+    if (next.empty()) {
+        return false;
     }
-    return current;
+    chunk = std::move(next);
+    position = 0;
+    return true;
+}
+
+// Gives the chunk its offsets and records where its lines start
+void Lexer::addChunk() {
+    base = SourcePositions::reserve(chunk.size());
+    std::vector<uint32_t> lineStarts{0};
+    findLineStarts(chunk, lineStarts);
+    int firstLine = line;
+    line += static_cast<int>(lineStarts.size()) - 1;
+    SourcePositions::addSource(base, firstLine, std::move(lineStarts));
 }
 
-//Checks if the character is a valid Digit.
-bool Lexer::isDigit(char c) {
-    return isdigit(c) || c == '.';
+/* Lets go of the positions and number literals of what a stream's reader has
+finished with. Called between statements, it keeps the chunk the last token
+came from, and what was read since the previous call, as the parser still
+holds the token it looked ahead to and the last token of the statement it
+returned.*/
+void Lexer::releaseRead() {
+    SourcePositions::release(releasedBase);
+    SymbolTable::releaseNumbers();
+    releasedBase = base;
 }
 
 void Lexer::increaseLine(int line_count) {
@@ -42,166 +393,196 @@ void Lexer::increaseLine(int line_count) {
         line++;
     }
 }
-//Checks if the character is a valid operator. 
-bool Lexer::isOperator(char c) {
-    return c == '+' || c == '-' || c == '*' || c == '/' || c == '%' || 
-           c == '<' || c == '>' || c == '=' || c == '!' || c == '&' || 
-           c == '^' || c == '|';
-}
-
 /*Handles the tokenization of a numerical value. Specifically, if the number 
 follows the criteria for a valid number. It checks if the current character is a valid numeric value.
 It checks the decimals to see what kinda of number it is - Integer or Float*/
 Token Lexer::number() {
-    int startCol = col;
-    string num;
-    bool hasDecimal = false;
-    while (isDigit(inputStream.peek())) {
-        char c = consume();
-        if (c == '.') {
-            if (hasDecimal) {
-                return {TokenType::UNKNOWN, num + c, line, col - 1};
-            }
-            hasDecimal = true;
-            if (!isdigit(inputStream.peek())) {
-                return {TokenType::UNKNOWN, num + c, line, col};
-            }
+    size_t start = position;
+    position = skipDigits(chunk, position);
+    if (position < chunk.size() && chunk[position] == '.') {
+        ++position;
+        if (position == chunk.size() || classOf(chunk[position]) != DIGIT) {
+            return {TokenType::UNKNOWN, intern(std::string_view(chunk.data() + start, position - start)),
+                    base + static_cast<uint32_t>(position)};
+        }
+        position = skipDigits(chunk, position);
+        if (position < chunk.size() && chunk[position] == '.') {
+            ++position;
+            return {TokenType::UNKNOWN, intern(std::string_view(chunk.data() + start, position - start)),
+                    base + static_cast<uint32_t>(position - 1)};
         }
-        num += c;
     }
-    if (num.front() == '.' || num.back() == '.') {
-        return {TokenType::UNKNOWN, num, line, startCol};
+    std::string_view num(chunk.data() + start, position - start);
+    if (num.front() == '.') {
+        return {TokenType::UNKNOWN, intern(num), base + static_cast<uint32_t>(start)};
     }
-    return {TokenType::NUMBER, num, line, startCol};
+    return {TokenType::NUMBER, internNumber(num), base + static_cast<uint32_t>(start)};
 
 }
 
 
-//Responsible for creating and tokenizing operators.
+//Responsible for creating and tokenizing operators, one step of the operator DFA per character.
 Token Lexer::op() {
-    int startCol = col;
+    size_t start = position;
     char op1 = consume();
-    char op2 = inputStream.peek(); 
-    
-    if (op1 == '<' && op2 == '=') {
-        consume(); 
-        return {TokenType::LESS_EQUAL, "<=", line, startCol};
-    }
-    if (op1 == '>' && op2 == '=') {
+    const OperatorState& state = operatorStates[static_cast<unsigned char>(op1)];
+    if (state.withEquals != TokenType::UNKNOWN && position < chunk.size() && chunk[position] == '=') {
         consume();
-        return {TokenType::GREATER_EQUAL, ">=", line, startCol};
-    }
-    if (op1 == '=' && op2 == '=') {
-        consume(); 
-        return {TokenType::EQUAL, "==", line, startCol};
+        return fixed(state.withEquals, start);
     }
-    if (op1 == '!' && op2 == '=') {
-        consume(); 
-        return {TokenType::NOT_EQUAL, "!=", line, startCol};
-    }
-
-
-    switch (op1) {
-        case '+': return {TokenType::ADD, "+", line, startCol};
-        case '-': return {TokenType::SUBTRACT, "-", line, startCol};
-        case '*': return {TokenType::MULTIPLY, "*", line, startCol};
-        case '/': return {TokenType::DIVIDE, "/", line, startCol};
-        case '%': return {TokenType::MODULO, "%", line, startCol};
-        case '<': return {TokenType::LESS, "<", line, startCol};
-        case '>': return {TokenType::GREATER, ">", line, startCol};
-        case '&': return {TokenType::LOGICAL_AND, "&", line, startCol};
-        case '^': return {TokenType::LOGICAL_XOR, "^", line, startCol};
-        case '|': return {TokenType::LOGICAL_OR, "|", line, startCol};
-        case '=': return {TokenType::ASSIGN, "=", line, startCol};
-        default: return {TokenType::UNKNOWN, std::string(1, op1), line, startCol};
+    if (state.alone == TokenType::UNKNOWN) {
+        return {TokenType::UNKNOWN, intern(std::string_view(chunk.data() + start, 1)), base + static_cast<uint32_t>(start)};
     }
+    return fixed(state.alone, start);
 }
 /*Is responsible for tokenizing the input stream. Classifies the differnet tokens
 and puts them in a vector.*/
 std::vector<Token> Lexer::tokenize() {
     std::vector<Token> tokens;
-    while (inputStream.peek() != EOF) {
-        char c = inputStream.peek();
-        if (isspace(c)) {
-            consume();
-        } else if (c == '(') {
-            tokens.push_back({TokenType::LEFT_PAREN, "(", line, col});
-            consume();
-        } else if (c == ')') {
-            tokens.push_back({TokenType::RIGHT_PAREN, ")", line, col});
-            consume();
-        } 
-        else if (c == '{') {
-            tokens.push_back({TokenType::LEFT_BRACE, "{", line, col});
-            consume();
-        } else if (c == '}') {
-            tokens.push_back({TokenType::RIGHT_BRACE, "}", line, col});
-            consume();
-        } else if (c == ';') {
-            tokens.push_back({TokenType::SEMICOLON, ";", line, col});
-            consume();
-        } else if (c == ',') {
-            tokens.push_back({TokenType::COMMA, ",", line, col});
-            consume();
-        } else if (c == '[') {
-            tokens.push_back({TokenType::LBRACK, "[", line, col});
-            consume();
-        } else if (c == ']') {
-            tokens.push_back({TokenType::RBRACK, "]", line, col});
-            consume();
-        } else if (isDigit(c)) {
-            Token numToken = number();
-            if (numToken.type == TokenType::UNKNOWN) {
-                tokens.push_back(numToken);
-                return tokens;
-            }
-            tokens.push_back(numToken);
-        } else if (isOperator(c)) {
-            tokens.push_back(op());
-        } else if (isalpha(c) || c == '_') {
-            std::string identifier;
-            int identifierStartCol = col;
-            while (isalnum(inputStream.peek()) || inputStream.peek() == '_') {
-                identifier += consume();
-            }
-            if (identifier == "true" || identifier == "false") {
-                if (identifier == "true"){
-                    tokens.push_back({TokenType::BOOLEAN_TRUE, identifier, line, identifierStartCol});
-                }
-                else{
-                    tokens.push_back({TokenType::BOOLEAN_FALSE, identifier, line, identifierStartCol});
-                }
-            } 
-            else if (identifier == "if") {
-                tokens.push_back({TokenType::IF, identifier, line, identifierStartCol});
-            } else if (identifier == "while") {
-                tokens.push_back({TokenType::WHILE, identifier, line, identifierStartCol});
-            } else if (identifier == "print") {
-                tokens.push_back({TokenType::PRINT, identifier, line, identifierStartCol});
-            } else if (identifier == "else") {
-                tokens.push_back({TokenType::ELSE, identifier, line, identifierStartCol});
+    do {
+        tokens.push_back(nextToken());
+    } while (tokens.back().type != TokenType::END && !stopped);
+    return tokens;
+}
+
+/* Lexes a string on up to the given number of threads. The input is cut
+into pieces at newlines, which no token spans, and the pieces are lexed by a
+small pool of threads taking the next unclaimed piece until none is left.
+The positions of the whole input are recorded up front, so each piece only
+needs its offset in it. The tokens are then joined in order, up to the first
+piece that stopped at a malformed number, which gives the same tokens and so
+the same first syntax error as tokenize().*/
+std::vector<Token> Lexer::tokenizeParallel(unsigned threads) {
+    size_t pieceCount = std::min<size_t>(static_cast<size_t>(threads) * 4, chunk.size() / MIN_PIECE_SIZE);
+    if (stream || started || threads <= 1 || pieceCount <= 1) {
+        return tokenize();
+    }
+    started = true;
+    addChunk();
+    spellingOf(TokenType::END);     // fills the table of fixed spellings before the workers read it
+
+    std::vector<size_t> cuts{0};
+    size_t pieceSize = chunk.size() / pieceCount;
+    while (cuts.back() + pieceSize < chunk.size()) {
+        size_t newline = chunk.find('\n', cuts.back() + pieceSize);
+        if (newline == std::string::npos || newline + 1 == chunk.size()) {
+            break;
+        }
+        cuts.push_back(newline + 1);
+    }
+    cuts.push_back(chunk.size());
+
+    struct Piece {
+        std::vector<Token> tokens;
+        PieceSymbols symbols;
+        bool stopped = false;
+    };
+    std::vector<Piece> pieces(cuts.size() - 1);
+    std::atomic<size_t> nextPiece{0};
+    std::atomic<size_t> firstStopped{pieces.size()};   // pieces after it are never joined
+    auto work = [&]() {
+        for (size_t i = nextPiece++; i < pieces.size(); i = nextPiece++) {
+            if (i > firstStopped) {
+                continue;
             }
-            else if (identifier == "def") {
-                tokens.push_back({TokenType::DEF, identifier, line, identifierStartCol});
-            } else if (identifier == "return") {
-                tokens.push_back({TokenType::RETURN, identifier, line, identifierStartCol});
-            } else if (identifier == "null") {
-                tokens.push_back({TokenType::NULL_TOKEN, identifier, line, identifierStartCol});
-            } else if (identifier == "len") {
-        tokens.push_back({TokenType::LEN, identifier, line, identifierStartCol});
-            } else if (identifier == "pop") {
-                tokens.push_back({TokenType::POP, identifier, line, identifierStartCol});
-            } else if (identifier == "push") {
-                tokens.push_back({TokenType::PUSH, identifier, line, identifierStartCol});
+            Lexer lexer(chunk.substr(cuts[i], cuts[i + 1] - cuts[i]), base + static_cast<uint32_t>(cuts[i]),
+                        &pieces[i].symbols);
+            pieces[i].tokens = lexer.tokenize();
+            pieces[i].stopped = lexer.stopped;
+            size_t seen = firstStopped;
+            while (lexer.stopped && i < seen && !firstStopped.compare_exchange_weak(seen, i)) {
             }
-            else {
-                tokens.push_back({TokenType::IDENTIFIER, identifier, line, identifierStartCol});
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < std::min<size_t>(threads, pieces.size()); ++i) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    std::vector<Token> tokens;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        Piece& piece = pieces[i];
+        std::vector<SymbolId> symbols(piece.symbols.names.size());
+        for (size_t j = 0; j < symbols.size(); ++j) {
+            const std::optional<double>& number = piece.symbols.numbers[j];
+            symbols[j] = number ? SymbolTable::internNumber(piece.symbols.names[j], *number)
+                                : SymbolTable::intern(piece.symbols.names[j]);
+        }
+        // Every piece but the last ends with an END token of its own
+        if (!piece.stopped && i + 1 < pieces.size()) {
+            piece.tokens.pop_back();
+        }
+        for (Token& token : piece.tokens) {
+            if (token.type == TokenType::IDENTIFIER || token.type == TokenType::NUMBER ||
+                token.type == TokenType::UNKNOWN) {
+                token.symbol = symbols[token.symbol];
             }
-        } else {
-            tokens.push_back({TokenType::UNKNOWN, std::string(1, c), line, col});
-            consume();
+        }
+        tokens.insert(tokens.end(), piece.tokens.begin(), piece.tokens.end());
+        if (piece.stopped) {
+            stopped = true;
+            break;
         }
     }
-    tokens.push_back({TokenType::END, "END", line, col});
+    position = chunk.size();
     return tokens;
 }
+
+/* Reads the next token of the input. A stream is lexed a chunk at a time, so
+only the current chunk is held in memory. After a malformed number, which
+ends tokenizing, and at the end of the input the result is END.*/
+Token Lexer::nextToken() {
+    if (!started) {
+        started = true;
+        if (stream) {
+            readChunk();
+        }
+        addChunk();
+    }
+    while (!stopped) {
+        position = skipSpaces(chunk, position);
+        if (position < chunk.size() || !stream || !readChunk()) {
+            break;
+        }
+        addChunk();
+    }
+    if (stopped || position == chunk.size()) {
+        return fixed(TokenType::END, position);
+    }
+
+    size_t start = position;
+    switch (classOf(chunk[position])) {
+    case PUNCTUATION:
+        return fixed(charTable.punctuation[static_cast<unsigned char>(consume())], start);
+    case DIGIT:
+    case DOT: {
+        Token numToken = number();
+        if (numToken.type == TokenType::UNKNOWN) {
+            stopped = true;
+        }
+        return numToken;
+    }
+    case OPERATOR:
+        return op();
+    case LETTER: {
+        position = skipWord(chunk, position);
+        std::string_view word(chunk.data() + start, position - start);
+        TokenType type = keywordType(word);
+        if (type != TokenType::IDENTIFIER) {
+            return fixed(type, start);
+        }
+        return {TokenType::IDENTIFIER, intern(word), base + static_cast<uint32_t>(start)};
+    }
+    default:
+        consume();
+        return {TokenType::UNKNOWN, intern(std::string_view(chunk.data() + start, 1)), base + static_cast<uint32_t>(start)};
+    }
+}
+
+SyntaxError::SyntaxError(const Token& token)
+    : std::runtime_error("Syntax error on line " + std::to_string(token.line()) + " column " +
+                         std::to_string(token.column()) + ".") {}
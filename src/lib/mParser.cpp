@@ -1,392 +1,612 @@
-
 #include "mParser.h"
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <ostream>
 
 // Constructor
 Parser::Parser(const std::vector<Token> &tokens)
-        : tokens(tokens), current(0) {}
+        : tokens(&tokens), lexer(nullptr), next(0), currentToken(TokenType::END, NO_SYMBOL, 0), previousToken(currentToken), pending(true),
+          depth(0), maxDepth(DEFAULT_MAX_DEPTH), level(0), deepest(0), lazyFunctions(false) {}
+
+// Pulls the tokens from the lexer as the parse needs them instead
+Parser::Parser(Lexer &lexer)
+        : tokens(nullptr), lexer(&lexer), next(0), currentToken(TokenType::END, NO_SYMBOL, 0), previousToken(currentToken), pending(true),
+          depth(0), maxDepth(DEFAULT_MAX_DEPTH), level(0), deepest(0), lazyFunctions(false) {}
+
+// Parses the block at begin the way the parser that skipped it would have
+class Parser::SkippedBody : public LazyBody {
+public:
+    SkippedBody(const Parser& parser, size_t begin)
+            : tokens(parser.tokens), begin(begin), maxDepth(parser.maxDepth) {}
+
+    std::unique_ptr<ASTNode> parse() const override {
+        size_t deepest = 0;
+        return parse(deepest);
+    }
+
+    std::unique_ptr<ASTNode> parse(size_t& deepest) const {
+        Parser parser(*tokens);
+        parser.next = begin;
+        parser.maxDepth = maxDepth;
+        std::unique_ptr<ASTNode> body = parser.parseBlock();
+        deepest = parser.deepest;
+        return body;
+    }
+
+private:
+    const std::vector<Token>* tokens;
+    size_t begin;               // index of the opening brace
+    size_t maxDepth;
+};
 
 // Parse the tokens and return the root node of the AST
 std::unique_ptr<ASTNode> Parser::parse() {
     std::vector<std::unique_ptr<ASTNode>> statements;
+    size_t deepestStatement = 0;
 
+    try {
+        while (std::unique_ptr<ASTNode> stmt = parseNext()) {
+            deepestStatement = std::max(deepestStatement, deepest);
+            statements.push_back(std::move(stmt));
+        }
+    } catch (...) {
+        // The bodies skipped so far come before the statement that failed
+        checkSkipped();
+        throw;
+    }
+    checkSkipped();
+    deepest = std::max(deepest, deepestStatement) + 1;
+
+    return std::make_unique<BlockNode>(std::move(statements));
+}
+
+// Parses the next top level statement, or returns nullptr at the end of the input
+std::unique_ptr<ASTNode> Parser::parseNext() {
+    deepest = 0;
     while (!isAtEnd()) {
         try {
             std::unique_ptr<ASTNode> stmt = parseStatement();
             if (stmt != nullptr) {
-                statements.push_back(std::move(stmt));
+                return stmt;
             }
         } catch (...) {
             synchronize();
             throw;
         }
     }
-
-    return std::make_unique<BlockNode>(std::move(statements));
+    return nullptr;
 }
 
-
-// Parse function for each rule
-std::unique_ptr<ASTNode> Parser::parseStatement()
+/* The token after the current one. Lexer errors stop a pulled parse right
+away, they are only reported before parsing when the tokens come as a vector.*/
+Token Parser::pull() const
 {
-    std::unique_ptr<ASTNode> stmt;   
-    if (match(TokenType::IF))
-    {
-        stmt = parseIfStatement();
-    }
-    else if (match(TokenType::WHILE))
-    {
-        stmt = parseWhileStatement();
-    }
-    else if (match(TokenType::PRINT))
-    {
-        stmt = parsePrintStatement();
-    }
-    else if (match(TokenType::LEFT_BRACE))
-    {
-        stmt = parseBlock();
-    }
-    else if (match(TokenType::DEF)) {
-        return parseFunctionDefinition();
-    }
-    else if (match(TokenType::RETURN)) {
-        return parseReturnStatement();
+    if (lexer) {
+        Token token = lexer->nextToken();
+        if (token.type == TokenType::UNKNOWN) {
+            throw SyntaxError(token);
+        }
+        return token;
     }
-    else
-    {
-        
-        stmt = parseExpressionStatement();
+    if (next < tokens->size()) {
+        return (*tokens)[next++];
     }
-    return stmt;
-
+    return Token(TokenType::END, "END", tokens->empty() ? 0 : tokens->back().offset);
 }
 
-// Parses Function Definitions
-std::unique_ptr<ASTNode> Parser::parseFunctionDefinition() {
-    Token name = consume(TokenType::IDENTIFIER);
-    consume(TokenType::LEFT_PAREN);
-
-    std::vector<Token> parameters;
-    if (!check(TokenType::RIGHT_PAREN)) {
-        do {
-            parameters.push_back(consume(TokenType::IDENTIFIER));
-        } while (match(TokenType::COMMA));
-    }
-
-    consume(TokenType::RIGHT_PAREN);
-    std::unique_ptr<ASTNode> body = parseBlock();
 
-    return std::make_unique<FunctionNode>(name, std::move(parameters), std::move(body));
+std::unique_ptr<ASTNode> Parser::parseStatement() {
+    return parseRule(Start::Statement);
 }
 
-// Parses the Return of Functions
-std::unique_ptr<ASTNode> Parser::parseReturnStatement() {
-    std::unique_ptr<ASTNode> value = nullptr;
-    if (!check(TokenType::SEMICOLON)) {
-        value = parseExpression();
-    }
-    consume(TokenType::SEMICOLON);
-    return std::make_unique<ReturnNode>(std::move(value));
+std::unique_ptr<ASTNode> Parser::parseBlock() {
+    return parseRule(Start::Block);
 }
 
-//Parses Function Calls
-std::unique_ptr<ASTNode> Parser::parseCall(std::unique_ptr<ASTNode> callee) {
-    std::vector<std::unique_ptr<ASTNode>> arguments;
-    if (!check(TokenType::RIGHT_PAREN)) {
-        do {
-            arguments.push_back(parseExpression());
-        } while (match(TokenType::COMMA));
+/* Destroys trees without recursing into them, the tree a failed parse leaves
+behind can be deeper than the native stack holds.*/
+static void dropTrees(std::vector<std::unique_ptr<ASTNode>> trees) {
+    while (!trees.empty()) {
+        std::unique_ptr<ASTNode> node = std::move(trees.back());
+        trees.pop_back();
+        if (!node) {
+            continue;
+        }
+        std::vector<std::unique_ptr<ASTNode>>* children = nullptr;
+        switch (node->getType()) {
+        case ASTNode::Type::BinaryOpNode: {
+            auto* binary = static_cast<BinaryOpNode*>(node.get());
+            trees.push_back(std::move(binary->left));
+            trees.push_back(std::move(binary->right));
+            break;
+        }
+        case ASTNode::Type::AssignmentNode: {
+            auto* assignment = static_cast<AssignmentNode*>(node.get());
+            trees.push_back(std::move(assignment->lhs));
+            trees.push_back(std::move(assignment->rhs));
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            trees.push_back(std::move(static_cast<PrintNode*>(node.get())->expression));
+            break;
+        case ASTNode::Type::IfNode: {
+            auto* ifNode = static_cast<IfNode*>(node.get());
+            trees.push_back(std::move(ifNode->condition));
+            trees.push_back(std::move(ifNode->trueBranch));
+            trees.push_back(std::move(ifNode->falseBranch));
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto* whileNode = static_cast<WhileNode*>(node.get());
+            trees.push_back(std::move(whileNode->condition));
+            trees.push_back(std::move(whileNode->body));
+            break;
+        }
+        case ASTNode::Type::BlockNode:
+            children = &static_cast<BlockNode*>(node.get())->statements;
+            break;
+        case ASTNode::Type::FunctionNode:
+            trees.push_back(std::move(static_cast<FunctionNode*>(node.get())->body));
+            break;
+        case ASTNode::Type::ReturnNode:
+            trees.push_back(std::move(static_cast<ReturnNode*>(node.get())->value));
+            break;
+        case ASTNode::Type::CallNode: {
+            auto* call = static_cast<CallNode*>(node.get());
+            trees.push_back(std::move(call->callee));
+            children = &call->arguments;
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            children = &static_cast<ArrayLiteralNode*>(node.get())->elements;
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto* lookup = static_cast<ArrayLookupNode*>(node.get());
+            trees.push_back(std::move(lookup->array));
+            trees.push_back(std::move(lookup->index));
+            break;
+        }
+        default:
+            break;
+        }
+        if (children) {
+            for (auto& child : *children) {
+                trees.push_back(std::move(child));
+            }
+        }
     }
-    consume(TokenType::RIGHT_PAREN);
-    return std::make_unique<CallNode>(std::move(callee), std::move(arguments));
 }
 
-
-// Parses if statements & blocks
-std::unique_ptr<ASTNode> Parser::parseIfStatement()
-{
-    
-    auto condition = parseExpression();
-    
-    auto trueBranch = parseBlock();
-    
-    std::unique_ptr<ASTNode> elseBranch = nullptr;
-    if (match(TokenType::ELSE))
-    {
-        while (match(TokenType::NEWLINE)) {  
-        }
-       
-
-        if (check(TokenType::IF))
-        {
-            advance();
-            elseBranch = parseIfStatement();
+/* Parses a statement, a block or an expression. Each rule that has to parse
+a part of itself first pushes a frame and starts on the part, and the node of
+the part is then handed to the frame on top by finish. Nesting therefore costs
+a frame on the heap per level, and the only limit is maxDepth on the blocks,
+parentheses, brackets and argument lists open at once.*/
+std::unique_ptr<ASTNode> Parser::parseRule(Start start) {
+    std::vector<Frame> frames;
+    std::unique_ptr<ASTNode> node;
+    depth = 0;
+    level = 0;
+    try {
+        for (;;) {
+            if (node) {
+                if (frames.empty()) {
+                    return node;
+                }
+                finish(frames, start, node);
+                continue;
+            }
+            switch (start) {
+            case Start::Statement:
+                startStatement(frames, start, node);
+                break;
+            case Start::Block:
+                consume(TokenType::LEFT_BRACE);
+                enter(frames, Rule::Block, true);
+                nextStatement(frames, start, node);
+                break;
+            case Start::Expression:
+                enter(frames, Rule::Assignment, false);
+                enter(frames, Rule::Binary, false, 1);
+                start = Start::Primary;
+                break;
+            case Start::Primary:
+                startPrimary(frames, start, node);
+                break;
+            }
         }
-        else
-        {
-            elseBranch = parseBlock();
+    } catch (...) {
+        std::vector<std::unique_ptr<ASTNode>> parts;
+        parts.push_back(std::move(node));
+        for (Frame& frame : frames) {
+            parts.push_back(std::move(frame.node));
+            parts.push_back(std::move(frame.branch));
+            for (auto& part : frame.nodes) {
+                parts.push_back(std::move(part));
+            }
         }
-
+        dropTrees(std::move(parts));
+        throw;
     }
-    return std::make_unique<IfNode>(std::move(condition), std::move(trueBranch), std::move(elseBranch));
 }
 
-// parses while statements and blocks
-std::unique_ptr<ASTNode> Parser::parseWhileStatement()
-{
-    while (match(TokenType::NEWLINE))
-    {
-        // consuming the newline
-
+// Pushes the frame of a rule, counting it towards maxDepth when it opens a bracket or brace
+Parser::Frame& Parser::enter(std::vector<Frame>& frames, Rule rule, bool nested, int precedence) {
+    if (nested) {
+        if (depth == maxDepth) {
+            const Token& token = previous();
+            throw std::runtime_error("Nesting too deep at line " + std::to_string(token.line()) + " column " + std::to_string(token.column()) + ": " + token.text());
+        }
+        ++depth;
     }
+    deepest = std::max(deepest, ++level);
+    frames.emplace_back(rule, nested, precedence);
+    return frames.back();
+}
 
-    auto condition = parseExpression(); 
-   
-    while (match(TokenType::NEWLINE))
-    {
-        //consuming the newline
-
-    }
- 
-    auto body = parseBlock();
-    return std::make_unique<WhileNode>(std::move(condition), std::move(body));
+void Parser::leave(std::vector<Frame>& frames) {
+    const Frame& frame = frames.back();
+    depth -= frame.nested ? 1 : 0;
+    level -= 1 + frame.folds;
+    frames.pop_back();
 }
 
-// parses print statements
-std::unique_ptr<ASTNode> Parser::parsePrintStatement() {
-    auto expression = parseExpression();
-    if (peek().type == TokenType::LEFT_PAREN) {
-        advance();
-        expression = parseCall(std::move(expression));
-        if (!match(TokenType::SEMICOLON)) {
-            throw std::runtime_error("Expected ';' after print statement");
+// Starts on a statement, a definition with a skipped body and an empty return are done at once
+void Parser::startStatement(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node) {
+    start = Start::Expression;
+    if (match(TokenType::IF)) {
+        enter(frames, Rule::If, false);
+    } else if (match(TokenType::WHILE)) {
+        while (match(TokenType::NEWLINE)) {
+            // consuming the newline
         }
-    } else {
-        if (!match(TokenType::SEMICOLON)) {
-            throw std::runtime_error("Expected ';' after print statement");
+        enter(frames, Rule::While, false);
+    } else if (match(TokenType::PRINT)) {
+        enter(frames, Rule::Print, false);
+    } else if (match(TokenType::LEFT_BRACE)) {
+        start = Start::Block;
+    } else if (match(TokenType::DEF)) {
+        Token name = consume(TokenType::IDENTIFIER);
+        consume(TokenType::LEFT_PAREN);
+        std::vector<Token> parameters;
+        if (!check(TokenType::RIGHT_PAREN)) {
+            do {
+                parameters.push_back(consume(TokenType::IDENTIFIER));
+            } while (match(TokenType::COMMA));
+        }
+        consume(TokenType::RIGHT_PAREN);
+        if (lazyFunctions && tokens && frames.empty()) {
+            if (std::shared_ptr<const LazyBody> lazyBody = skipBody()) {
+                auto function = std::make_unique<FunctionNode>(name, std::move(parameters), nullptr);
+                function->lazyBody = std::move(lazyBody);
+                node = std::move(function);
+                return;
+            }
         }
+        Frame& frame = enter(frames, Rule::Def, false);
+        frame.token = name;
+        frame.parameters = std::move(parameters);
+        start = Start::Block;
+    } else if (match(TokenType::RETURN)) {
+        if (check(TokenType::SEMICOLON)) {
+            consume(TokenType::SEMICOLON);
+            node = std::make_unique<ReturnNode>(nullptr);
+        } else {
+            enter(frames, Rule::Return, false);
+        }
+    } else {
+        enter(frames, Rule::ExpressionStatement, false);
     }
-
-    return std::make_unique<PrintNode>(std::move(expression));
 }
 
-
-
-// parses block nodes
-std::unique_ptr<ASTNode> Parser::parseBlock()
-{
-    consume(TokenType::LEFT_BRACE);
-    std::vector<std::unique_ptr<ASTNode>> statements;
-
-    while (!check(TokenType::RIGHT_BRACE) && !isAtEnd())
-    {
-        while (match(TokenType::NEWLINE))
-        {
-            //consuming the newline
+// Starts on the next statement of the block on top, or closes the block at its brace
+void Parser::nextStatement(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node) {
+    if (!check(TokenType::RIGHT_BRACE) && !isAtEnd()) {
+        while (match(TokenType::NEWLINE)) {
+            // consuming the newline
         }
-        statements.push_back(parseStatement());
-        
+        start = Start::Statement;
+        return;
     }
-
     consume(TokenType::RIGHT_BRACE);
-    while (match(TokenType::NEWLINE))
-    {
-        //consuming the newline
+    while (match(TokenType::NEWLINE)) {
+        // consuming the newline
     }
-    
-    return std::make_unique<BlockNode>(std::move(statements));
+    node = std::make_unique<BlockNode>(std::move(frames.back().nodes));
+    leave(frames);
 }
 
-// main parse for expression statements (NOT BLOCKS)
-std::unique_ptr<ASTNode> Parser::parseExpressionStatement()
-{
-    auto expression = parseExpression();
-
-   
-    if (peek().type != TokenType::RIGHT_BRACE && 
-        peek().type != TokenType::ELSE &&
-        !isAtEnd()) {
-        consume(TokenType::SEMICOLON);
+// Starts on the next item of the array literal or call on top, returns true once its closing token is consumed
+bool Parser::nextItem(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& item, TokenType closing) {
+    if (item) {
+        frames.back().nodes.push_back(std::move(item));
+        if (match(TokenType::COMMA)) {
+            start = Start::Expression;
+            return false;
+        }
+    } else if (!check(closing)) {
+        start = Start::Expression;
+        return false;
     }
-
-    return expression;
-}
-
-// parse for all expressions
-std::unique_ptr<ASTNode> Parser::parseExpression()
-{
-    return parseAssignment();
+    consume(closing);
+    return true;
 }
 
-// parses assignment
-std::unique_ptr<ASTNode> Parser::parseAssignment() {
-    auto node = parseLogicalOr();
-    if (match(TokenType::ASSIGN)) {
-        auto value = parseAssignment();
-        return std::make_unique<AssignmentNode>(std::move(node), std::move(value));
+// Builds the call on top once its arguments are in, stage 1 marks a call that can be indexed
+void Parser::closeCall(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node) {
+    Frame& frame = frames.back();
+    bool indexed = frame.stage == 1;
+    node = std::make_unique<CallNode>(std::move(frame.node), std::move(frame.nodes));
+    leave(frames);
+    if (indexed) {
+        postfix(frames, start, node);
     }
-    return node;
 }
 
-
-std::unique_ptr<ASTNode> Parser::parseArrayLiteral() {
-    std::vector<std::unique_ptr<ASTNode>> elements;
-    if (!check(TokenType::RBRACK)) {
-        do {
-            elements.push_back(parseExpression());
-        } while (match(TokenType::COMMA));
+// Starts on the index of an array lookup following node, if there is one
+void Parser::postfix(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node) {
+    if (check(TokenType::LBRACK)) {
+        advance();
+        std::unique_ptr<ASTNode> array = std::move(node);
+        enter(frames, Rule::ArrayLookup, true).node = std::move(array);
+        start = Start::Expression;
     }
-
-    consume(TokenType::RBRACK);
-    return std::make_unique<ArrayLiteralNode>(std::move(elements));
-}
-
-
-std::unique_ptr<ASTNode> Parser::parseArrayLookup(std::unique_ptr<ASTNode> array) {
-    auto index = parseExpression();
-    consume(TokenType::RBRACK);
-    
-    return std::make_unique<ArrayLookupNode>(std::move(array), std::move(index));
 }
 
-std::unique_ptr<ASTNode> Parser::parsePrimary() {
-    std::unique_ptr<ASTNode> node;
-
+void Parser::startPrimary(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node) {
+    start = Start::Expression;
     if (match(TokenType::NUMBER)) {
         node = std::make_unique<NumberNode>(previous());
-    }  else if (match(TokenType::NULL_TOKEN)) {
-        return std::make_unique<NullNode>();
-    }
-    else if (match(TokenType::LEFT_PAREN)) {
-        node = parseExpression();
-        consume(TokenType::RIGHT_PAREN);
+    } else if (match(TokenType::NULL_TOKEN)) {
+        node = std::make_unique<NullNode>();
+        return;
+    } else if (match(TokenType::LEFT_PAREN)) {
+        enter(frames, Rule::Parenthesis, true);
+        return;
     } else if (match(TokenType::LBRACK)) {
-        node = parseArrayLiteral();
+        enter(frames, Rule::ArrayLiteral, true);
+        if (!nextItem(frames, start, node, TokenType::RBRACK)) {
+            return;
+        }
+        node = std::make_unique<ArrayLiteralNode>(std::move(frames.back().nodes));
+        leave(frames);
     } else if (match(TokenType::IDENTIFIER) || match(TokenType::PUSH) || match(TokenType::POP) || match(TokenType::LEN)) {
         Token identifier = previous();
-        if (check(TokenType::LEFT_PAREN)) {
-            advance();
-            node = parseCall(std::make_unique<VariableNode>(identifier));
-        } else {
+        if (!check(TokenType::LEFT_PAREN)) {
             node = std::make_unique<VariableNode>(identifier);
+        } else {
+            advance();
+            Frame& call = enter(frames, Rule::Call, true);
+            call.node = std::make_unique<VariableNode>(identifier);
+            call.stage = 1;
+            if (nextItem(frames, start, node, TokenType::RIGHT_PAREN)) {
+                closeCall(frames, start, node);
+            }
+            return;
         }
-    } else if (match(TokenType::BOOLEAN_TRUE) || match(TokenType::BOOLEAN_FALSE) || match(TokenType::NULL_TOKEN)) {
+    } else if (match(TokenType::BOOLEAN_TRUE) || match(TokenType::BOOLEAN_FALSE)) {
         node = std::make_unique<BooleanNode>(previous());
     } else {
-        throw std::runtime_error("Unexpected token at line " + std::to_string(tokens[current].line) + " column " + std::to_string(tokens[current].column) + ": " + tokens[current].value);
+        throw std::runtime_error("Unexpected token at line " + std::to_string(lookahead().line()) + " column " + std::to_string(lookahead().column()) + ": " + lookahead().text());
     }
-
-    while (check(TokenType::LBRACK)) {
-        advance();
-        auto index = parseExpression();
-        consume(TokenType::RBRACK);
-        node = std::make_unique<ArrayLookupNode>(std::move(node), std::move(index));
-    }
-
-    return node;
+    postfix(frames, start, node);
 }
 
-
-/* From here to parse primary, each function parses each type of logical operation or expresion. 
-It is coded to use precedence from track A
-*/
-std::unique_ptr<ASTNode> Parser::parseLogicalOr() {
-    try {
-        auto node = parseLogicalXor();
-        while (match(TokenType::LOGICAL_OR)) {
-            Token op = previous();
-            auto right = parseLogicalXor();
-            node = std::make_unique<BinaryOpNode>(op, std::move(node), std::move(right));
+/* Moves past the body of a function by matching its braces and returns the
+body for a later parse. A body without its closing brace is left to parseBlock,
+which reports the error, and so is a body of a single return, which the
+optimizer may inline into its callers.*/
+std::shared_ptr<const LazyBody> Parser::skipBody() {
+    const std::vector<Token>& all = *tokens;
+    size_t begin = pending ? next : next - 1;
+    if (begin >= all.size() || all[begin].type != TokenType::LEFT_BRACE) {
+        return nullptr;
+    }
+    size_t open = 0;
+    size_t semicolons = 0;
+    size_t end = begin;
+    for (; end < all.size(); ++end) {
+        TokenType type = all[end].type;
+        if (type == TokenType::LEFT_BRACE) {
+            ++open;
+        } else if (type == TokenType::RIGHT_BRACE && --open == 0) {
+            break;
+        } else if (type == TokenType::SEMICOLON) {
+            ++semicolons;
         }
-        return node;
-    } catch (...) {
-        throw;
     }
-}
-
-std::unique_ptr<ASTNode> Parser::parseLogicalXor() {
-    try {
-        auto node = parseLogicalAnd();
-        while (match(TokenType::LOGICAL_XOR)) {
-            Token op = previous();
-            auto right = parseLogicalAnd();
-            node = std::make_unique<BinaryOpNode>(op, std::move(node), std::move(right));
-        }
-        return node;
-    } catch (...) {
-        throw;
+    if (end == all.size() ||
+        (semicolons == 1 && all[begin + 1].type == TokenType::RETURN && all[end - 1].type == TokenType::SEMICOLON)) {
+        return nullptr;
     }
-}
 
-std::unique_ptr<ASTNode> Parser::parseLogicalAnd() {
-    try {
-        auto node = parseEquality();
-        while (match(TokenType::LOGICAL_AND)) {
-            Token op = previous();
-            auto right = parseEquality();
-            node = std::make_unique<BinaryOpNode>(op, std::move(node), std::move(right));
-        }
-        return node;
-    } catch (...) {
-        throw;
-    }
+    auto body = std::make_shared<const SkippedBody>(*this, begin);
+    skipped.push_back(body);
+    previousToken = all[end];
+    next = end + 1;
+    pending = true;
+    return body;
 }
 
-std::unique_ptr<ASTNode> Parser::parseEquality() {
-    try {
-        auto node = parseComparison();
-        while (match(TokenType::EQUAL) || match(TokenType::NOT_EQUAL)) {
-            Token op = previous();
-            auto right = parseComparison();
-            node = std::make_unique<BinaryOpNode>(op, std::move(node), std::move(right));
-        }
-        return node;
-    } catch (...) {
-        throw;
+/* Parses every skipped body once, in input order, so a lazy parse reports the
+same syntax error as a full one. The trees are dropped rather than kept for
+the whole run, a body is parsed again when its function is first called.*/
+void Parser::checkSkipped() {
+    std::vector<std::shared_ptr<const SkippedBody>> bodies = std::move(skipped);
+    skipped.clear();
+    for (const auto& body : bodies) {
+        size_t bodyDepth = 0;
+        std::vector<std::unique_ptr<ASTNode>> trees;
+        trees.push_back(body->parse(bodyDepth));
+        dropTrees(std::move(trees));
+        deepest = std::max(deepest, bodyDepth + 1);
     }
 }
 
-std::unique_ptr<ASTNode> Parser::parseAddition() {
-    try {
-        auto node = parseMultiplication();
-        while (match(TokenType::ADD) || match(TokenType::SUBTRACT)) {
-            Token op = previous();
-            auto right = parseMultiplication();
-            node = std::make_unique<BinaryOpNode>(op, std::move(node), std::move(right));
+/* Binding power of each binary operator, from | (loosest) to * / % (tightest),
+following the precedence from track A. 0 marks tokens that end an expression.*/
+static const std::array<int, static_cast<size_t>(TokenType::PUSH) + 1> precedences = [] {
+    std::array<int, static_cast<size_t>(TokenType::PUSH) + 1> table{};
+    const std::pair<TokenType, int> operators[] = {
+        {TokenType::LOGICAL_OR, 1},
+        {TokenType::LOGICAL_XOR, 2},
+        {TokenType::LOGICAL_AND, 3},
+        {TokenType::EQUAL, 4}, {TokenType::NOT_EQUAL, 4},
+        {TokenType::LESS, 5}, {TokenType::LESS_EQUAL, 5}, {TokenType::GREATER, 5}, {TokenType::GREATER_EQUAL, 5},
+        {TokenType::ADD, 6}, {TokenType::SUBTRACT, 6},
+        {TokenType::MULTIPLY, 7}, {TokenType::DIVIDE, 7}, {TokenType::MODULO, 7},
+    };
+    for (const auto& entry : operators) {
+        table[static_cast<size_t>(entry.first)] = entry.second;
+    }
+    return table;
+}();
+
+/* Hands the node just parsed to the rule on top, which either starts on its
+next part or is complete, leaving its own node to be handed on.
+
+Binary operations are parsed by precedence climbing: a Binary takes operators
+binding at least as tightly as its precedence, and the right operand of each
+one is a Binary that only takes operators binding tighter. That makes every
+level left associative with the tree one function per level would build, and
+a chain of operators folds into the frame it started in.*/
+void Parser::finish(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node) {
+    Frame& frame = frames.back();
+    switch (frame.rule) {
+    case Rule::If:
+        if (frame.stage == 0) {
+            frame.node = std::move(node);
+            frame.stage = 1;
+            start = Start::Block;
+        } else if (frame.stage == 1) {
+            frame.branch = std::move(node);
+            if (!match(TokenType::ELSE)) {
+                node = std::make_unique<IfNode>(std::move(frame.node), std::move(frame.branch), nullptr);
+                leave(frames);
+                return;
+            }
+            while (match(TokenType::NEWLINE)) {
+            }
+            frame.stage = 2;
+            start = Start::Block;
+            if (check(TokenType::IF)) {
+                advance();
+                enter(frames, Rule::If, false);
+                start = Start::Expression;
+            }
+        } else {
+            node = std::make_unique<IfNode>(std::move(frame.node), std::move(frame.branch), std::move(node));
+            leave(frames);
         }
-        return node;
-    } catch (...) {
-        throw;
-    }
-}
-
-std::unique_ptr<ASTNode> Parser::parseComparison() {
-    try {
-        auto node = parseAddition();
-        while (match(TokenType::LESS) || match(TokenType::LESS_EQUAL) ||
-               match(TokenType::GREATER) || match(TokenType::GREATER_EQUAL)) {
-            Token op = previous();
-            auto right = parseAddition();
-            node = std::make_unique<BinaryOpNode>(op, std::move(node), std::move(right));
-        }
-        return node;
-    } catch (...) {
-        throw;
+        return;
+    case Rule::While:
+        if (frame.stage == 0) {
+            frame.node = std::move(node);
+            while (match(TokenType::NEWLINE)) {
+                //consuming the newline
+            }
+            frame.stage = 1;
+            start = Start::Block;
+        } else {
+            node = std::make_unique<WhileNode>(std::move(frame.node), std::move(node));
+            leave(frames);
+        }
+        return;
+    case Rule::Print:
+        if (frame.stage == 0 && peek().type == TokenType::LEFT_PAREN) {
+            advance();
+            frame.stage = 1;
+            std::unique_ptr<ASTNode> callee = std::move(node);
+            enter(frames, Rule::Call, true).node = std::move(callee);
+            if (nextItem(frames, start, node, TokenType::RIGHT_PAREN)) {
+                closeCall(frames, start, node);
+            }
+            return;
+        }
+        if (!match(TokenType::SEMICOLON)) {
+            throw std::runtime_error("Expected ';' after print statement");
+        }
+        node = std::make_unique<PrintNode>(std::move(node));
+        leave(frames);
+        return;
+    case Rule::Def:
+        node = std::make_unique<FunctionNode>(frame.token, std::move(frame.parameters), std::move(node));
+        leave(frames);
+        return;
+    case Rule::Return:
+        consume(TokenType::SEMICOLON);
+        node = std::make_unique<ReturnNode>(std::move(node));
+        leave(frames);
+        return;
+    case Rule::ExpressionStatement:
+        if (peek().type != TokenType::RIGHT_BRACE &&
+            peek().type != TokenType::ELSE &&
+            !isAtEnd()) {
+            consume(TokenType::SEMICOLON);
+        }
+        leave(frames);
+        return;
+    case Rule::Block:
+        frame.nodes.push_back(std::move(node));
+        nextStatement(frames, start, node);
+        return;
+    case Rule::Assignment:
+        if (frame.stage == 0) {
+            if (match(TokenType::ASSIGN)) {
+                frame.node = std::move(node);
+                frame.stage = 1;
+                start = Start::Expression;
+                return;
+            }
+        } else {
+            node = std::make_unique<AssignmentNode>(std::move(frame.node), std::move(node));
+        }
+        leave(frames);
+        return;
+    case Rule::Binary: {
+        if (frame.stage == 0) {
+            frame.node = std::move(node);
+        } else {
+            frame.node = std::make_unique<BinaryOpNode>(frame.token, std::move(frame.node), std::move(node));
+            ++frame.folds;
+            deepest = std::max(deepest, ++level);
+        }
+        int binding = precedences[static_cast<size_t>(peek().type)];
+        if (binding == 0 || binding < frame.precedence) {
+            node = std::move(frame.node);
+            leave(frames);
+            return;
+        }
+        frame.token = advance();
+        frame.stage = 1;
+        enter(frames, Rule::Binary, false, binding + 1);
+        start = Start::Primary;
+        return;
     }
-}
-
-std::unique_ptr<ASTNode> Parser::parseMultiplication() {
-    try {
-        auto node = parsePrimary();
-        while (match(TokenType::MULTIPLY) || match(TokenType::DIVIDE) || match(TokenType::MODULO)) {
-            Token op = previous();
-            auto right = parsePrimary();
-            node = std::make_unique<BinaryOpNode>(op, std::move(node), std::move(right));
+    case Rule::Parenthesis:
+        consume(TokenType::RIGHT_PAREN);
+        leave(frames);
+        postfix(frames, start, node);
+        return;
+    case Rule::ArrayLookup:
+        consume(TokenType::RBRACK);
+        node = std::make_unique<ArrayLookupNode>(std::move(frame.node), std::move(node));
+        leave(frames);
+        postfix(frames, start, node);
+        return;
+    case Rule::ArrayLiteral:
+        if (nextItem(frames, start, node, TokenType::RBRACK)) {
+            node = std::make_unique<ArrayLiteralNode>(std::move(frames.back().nodes));
+            leave(frames);
+            postfix(frames, start, node);
         }
-        return node;
-    } catch (...) {
-        throw;
+        return;
+    case Rule::Call:
+        if (nextItem(frames, start, node, TokenType::RIGHT_PAREN)) {
+            closeCall(frames, start, node);
+        }
+        return;
     }
 }
 
@@ -395,12 +615,7 @@ std::unique_ptr<ASTNode> Parser::parseMultiplication() {
 //Retrieves the current token without advancing the parser
 const Token &Parser::peek() const
 {
-    if (isAtEnd())
-    {
-        static const Token eofToken(TokenType::END, "END", tokens[current].line, tokens[current].column); 
-        return eofToken;
-    }
-    return tokens[current];
+    return lookahead();
 }
 
 // Advances the parser until a stopping point of a newline
@@ -436,17 +651,17 @@ bool Parser::match(TokenType type)
 }
 
 //Retrieves the previous token
-Token Parser::previous()
+const Token& Parser::previous()
 {
-    return tokens.at(current - 1);
+    return previousToken;
 }
 
 //Consumes a token of the given type
-Token Parser::consume(TokenType type)
+const Token& Parser::consume(TokenType type)
 {
     if (check(type)) 
         return advance();
-    throw std::runtime_error("Unexpected token at line " + std::to_string(tokens[current].line) + " column " + std::to_string(tokens[current].column) + ": " + tokens[current].value);
+    throw std::runtime_error("Unexpected token at line " + std::to_string(lookahead().line()) + " column " + std::to_string(lookahead().column()) + ": " + lookahead().text());
 }
 
 //Checks if the current token is of the given type.
@@ -454,24 +669,32 @@ bool Parser::check(TokenType type) const
 {
     if (isAtEnd())
         return false;
-    return tokens.at(current).type == type;
+    return lookahead().type == type;
 }
 
 //Advances to the next token
-Token Parser::advance()
+const Token& Parser::advance()
 {
-    if (!isAtEnd())
-        current++;
-
-    
-    Token token = previous();
-
-    
-    return token;
+    if (!isAtEnd()) {
+        previousToken = currentToken;
+        pending = true;
+    }
+    return previous();
 }
 
 //Checks if the parser has reached the end of the tokens.
 bool Parser::isAtEnd() const
 {
-    return current >= tokens.size() || tokens.at(current).type == TokenType::END;
+    return lookahead().type == TokenType::END;
+}
+
+/* The current token. It is only pulled once the parse looks at it, so a
+statement can be run before the input after it has arrived.*/
+const Token& Parser::lookahead() const
+{
+    if (pending) {
+        currentToken = pull();
+        pending = false;
+    }
+    return currentToken;
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "Token.h"
 #include "ASTNodes.h"
+#include "lex.h"
 #include <vector>
 #include <memory>
 #include<ostream>
@@ -11,62 +12,93 @@
 class Parser {
 public:
    
+    // Default limit of nested blocks, parentheses, brackets and argument lists
+    static const size_t DEFAULT_MAX_DEPTH = 100000;
+
     Parser(const std::vector<Token> &tokens);
+    explicit Parser(Lexer &lexer);
+    // Input nested deeper than this is a syntax error
+    void setMaxDepth(size_t limit) { maxDepth = limit; }
+    // How many levels deep the trees of the last parse or parseNext can be, for the passes that walk them recursively
+    size_t treeDepth() const { return deepest; }
+    // Brace-matches top level function bodies instead of parsing them, the tokens must outlive the tree
+    void setLazyFunctions(bool enabled) { lazyFunctions = enabled; }
 
     
     std::unique_ptr<ASTNode> parse();
+    std::unique_ptr<ASTNode> parseNext();
     bool isAtEnd() const;
     bool match(TokenType type);
     bool match(const std::initializer_list<TokenType>& types);
 
 
 private:
-    const std::vector<Token>& tokens; 
-    size_t current; 
+    const std::vector<Token>* tokens;  // null when the tokens are pulled from the lexer
+    Lexer* lexer;
+    mutable size_t next;                // index of the token after the current one
+    mutable Token currentToken;
+    Token previousToken;
+    mutable bool pending;               // currentToken has not been pulled yet
+    size_t depth;                       // blocks, parentheses, brackets and argument lists open
+    size_t maxDepth;
+    size_t level;                       // bound on the depth of the tree being built
+    size_t deepest;                     // largest level reached
+    bool lazyFunctions;
 
-    
-  
-    std::unique_ptr<ASTNode> parseStatement();
-    std::unique_ptr<ASTNode> parseTerm();
-    std::unique_ptr<ASTNode> parseFactor();
+    // A function body skipped by a lazy parse, parsed from the token vector when needed
+    class SkippedBody;
+    std::vector<std::shared_ptr<const SkippedBody>> skipped;    // not yet checked for syntax errors
 
-    
-    std::unique_ptr<ASTNode> parseBinaryExpression(int precedence);
+    // The rules the parser is in the middle of, each waiting for the node of a rule it started
+    enum class Rule { If, While, Print, Def, Return, ExpressionStatement, Block, Assignment, Binary, Parenthesis,
+                      ArrayLiteral, ArrayLookup, Call };
 
-   
-    std::unique_ptr<ASTNode> parseIfStatement();
-    std::unique_ptr<ASTNode> parseWhileStatement();
-    std::unique_ptr<ASTNode> parsePrintStatement();
-    std::unique_ptr<ASTNode> parseBlock();
-    std::unique_ptr<ASTNode> parseExpressionStatement();
-    std::unique_ptr<ASTNode> parseStatementOrExpression();
+    struct Frame {
+        Rule rule;
+        int stage;                      // how far the rule has got
+        int precedence;                 // the loosest operator a Binary takes
+        bool nested;                    // counts towards depth
+        size_t folds;                   // operators a Binary has folded into node
+        Token token;                    // operator of a Binary, name of a Def
+        std::unique_ptr<ASTNode> node;  // the part built so far
+        std::unique_ptr<ASTNode> branch;                    // the true branch of an If
+        std::vector<std::unique_ptr<ASTNode>> nodes;        // statements, elements or arguments
+        std::vector<Token> parameters;                      // of a Def
 
-    
-    std::unique_ptr<ASTNode> parseExpression();
-    std::unique_ptr<ASTNode> parseAssignment();
-    std::unique_ptr<ASTNode> parseLogicalOr();
-    std::unique_ptr<ASTNode> parseLogicalXor();
-    std::unique_ptr<ASTNode> parseLogicalAnd();
-    std::unique_ptr<ASTNode> parseEquality();
-    std::unique_ptr<ASTNode> parseComparison();
-    std::unique_ptr<ASTNode> parseAddition();
-    std::unique_ptr<ASTNode> parseMultiplication();
-    std::unique_ptr<ASTNode> parsePrimary();
+        Frame(Rule rule, bool nested, int precedence = 0)
+            : rule(rule), stage(0), precedence(precedence), nested(nested), folds(0),
+              token(TokenType::END, NO_SYMBOL, 0) {}
+    };
+
+    // What the parser starts on next, once the current node has been handed to its rule
+    enum class Start { Statement, Block, Expression, Primary };
 
-    std::unique_ptr<ASTNode>parseFunctionDefinition();
-    std::unique_ptr<ASTNode>parseReturnStatement();
-    std::unique_ptr<ASTNode> parseCall(std::unique_ptr<ASTNode> callee);
+    /* The statement and expression rules run on a stack of frames instead of
+    calling each other, so nesting takes heap rather than native stack.*/
+    std::unique_ptr<ASTNode> parseRule(Start start);
+    void startStatement(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node);
+    void startPrimary(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node);
+    void finish(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node);
+    Frame& enter(std::vector<Frame>& frames, Rule rule, bool nested, int precedence = 0);
+    void leave(std::vector<Frame>& frames);
+    void nextStatement(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node);
+    bool nextItem(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& item, TokenType closing);
+    void closeCall(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node);
+    void postfix(std::vector<Frame>& frames, Start& start, std::unique_ptr<ASTNode>& node);
 
-    std::unique_ptr<ASTNode> parseArrayLiteral();
-    std::unique_ptr<ASTNode> parseArrayLookup(std::unique_ptr<ASTNode> array);
-    std::unique_ptr<ASTNode> parseArrayAssignment(std::unique_ptr<ASTNode> array, std::unique_ptr<ASTNode> index);
+    std::unique_ptr<ASTNode> parseStatement();
+    std::unique_ptr<ASTNode> parseBlock();
+    std::shared_ptr<const LazyBody> skipBody();
+    void checkSkipped();
 
    
-    Token consume(TokenType type);
+    const Token& consume(TokenType type);
     bool check(TokenType type) const;
-    Token advance();
+    const Token& advance();
     const Token& peek() const;
-    Token previous();
+    const Token& previous();
+    const Token& lookahead() const;
+    Token pull() const;
     void synchronize();
 };
 
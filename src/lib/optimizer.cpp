@@ -0,0 +1,1133 @@
+#include "optimizer.h"
+#include "ScryptComponents.h"
+#include "typeInference.h"
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+static void optimizeStatement(std::unique_ptr<ASTNode>& node);
+static void optimizeExpression(std::unique_ptr<ASTNode>& node);
+
+static const SymbolId LEN = SymbolTable::intern("len");
+static const SymbolId POP = SymbolTable::intern("pop");
+static const SymbolId PUSH = SymbolTable::intern("push");
+
+// Reads the value of a literal node, returns false for anything else
+static bool literalValue(const ASTNode* node, Value& value) {
+    switch (node->getType()) {
+        case ASTNode::Type::NumberNode:
+            value = Value(static_cast<const NumberNode*>(node)->value.number());
+            return true;
+        case ASTNode::Type::BooleanNode:
+            value = Value(static_cast<const BooleanNode*>(node)->value.type == TokenType::BOOLEAN_TRUE);
+            return true;
+        case ASTNode::Type::NullNode:
+            value = Value();
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Shortest text that reads back as exactly the same double
+static std::string numberText(double value) {
+    std::ostringstream text;
+    for (int precision = 15; precision <= 17; ++precision) {
+        text.str("");
+        text << std::setprecision(precision) << value;
+        if (parseNumber(text.str()) == value) {
+            break;
+        }
+    }
+    return text.str();
+}
+
+// Builds the literal node for a folded value, positioned at the operator
+static std::unique_ptr<ASTNode> literalNode(const Value& value, const Token& at) {
+    if (value.getType() == Value::Type::Bool) {
+        bool truth = value.asBool();
+        return std::make_unique<BooleanNode>(Token(truth ? TokenType::BOOLEAN_TRUE : TokenType::BOOLEAN_FALSE,
+                                                   truth ? "true" : "false", at.offset));
+    }
+    double number = value.asDouble();
+    return std::make_unique<NumberNode>(
+        Token(TokenType::NUMBER, SymbolTable::internNumber(numberText(number), number), at.offset));
+}
+
+/* Evaluates an operator on two literals the same way the evaluators do.
+Returns false when the operation would fail at runtime or has no literal
+form, so the original expression is kept.*/
+static bool foldOperation(TokenType op, const Value& left, const Value& right, Value& result) {
+    try {
+        switch (op) {
+            case TokenType::ADD:           result = Value(left.asDouble() + right.asDouble()); break;
+            case TokenType::SUBTRACT:      result = Value(left.asDouble() - right.asDouble()); break;
+            case TokenType::MULTIPLY:      result = Value(left.asDouble() * right.asDouble()); break;
+            case TokenType::DIVIDE:
+                if (right.asDouble() == 0) {
+                    return false;
+                }
+                result = Value(left.asDouble() / right.asDouble());
+                break;
+            case TokenType::MODULO:
+                if (right.asDouble() == 0) {
+                    return false;
+                }
+                result = Value(fmod(left.asDouble(), right.asDouble()));
+                break;
+            case TokenType::LESS:          result = Value(left.asDouble() < right.asDouble()); break;
+            case TokenType::LESS_EQUAL:    result = Value(left.asDouble() <= right.asDouble()); break;
+            case TokenType::GREATER:       result = Value(left.asDouble() > right.asDouble()); break;
+            case TokenType::GREATER_EQUAL: result = Value(left.asDouble() >= right.asDouble()); break;
+            case TokenType::EQUAL:         result = Value(left.equals(right)); break;
+            case TokenType::NOT_EQUAL:     result = Value(!left.equals(right)); break;
+            case TokenType::LOGICAL_AND:   result = Value(left.asBool() && right.asBool()); break;
+            case TokenType::LOGICAL_XOR:   result = Value(left.asBool() != right.asBool()); break;
+            case TokenType::LOGICAL_OR:    result = Value(left.asBool() || right.asBool()); break;
+            default:
+                return false;
+        }
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return result.getType() != Value::Type::Double || std::isfinite(result.asDouble());
+}
+
+// Whether an expression always produces a number (or fails before producing anything)
+static bool isNumeric(const ASTNode* node) {
+    if (node->getType() == ASTNode::Type::NumberNode) {
+        return true;
+    }
+    if (node->getType() != ASTNode::Type::BinaryOpNode) {
+        return false;
+    }
+    switch (static_cast<const BinaryOpNode*>(node)->op.type) {
+        case TokenType::ADD: case TokenType::SUBTRACT: case TokenType::MULTIPLY:
+        case TokenType::DIVIDE: case TokenType::MODULO:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Whether an expression always produces a bool (or fails before producing anything)
+static bool isBoolean(const ASTNode* node) {
+    if (node->getType() == ASTNode::Type::BooleanNode) {
+        return true;
+    }
+    if (node->getType() != ASTNode::Type::BinaryOpNode) {
+        return false;
+    }
+    switch (static_cast<const BinaryOpNode*>(node)->op.type) {
+        case TokenType::LESS: case TokenType::LESS_EQUAL:
+        case TokenType::GREATER: case TokenType::GREATER_EQUAL:
+        case TokenType::EQUAL: case TokenType::NOT_EQUAL:
+        case TokenType::LOGICAL_AND: case TokenType::LOGICAL_XOR: case TokenType::LOGICAL_OR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isNumber(const ASTNode* node, double number) {
+    return node->getType() == ASTNode::Type::NumberNode &&
+           static_cast<const NumberNode*>(node)->value.number() == number;
+}
+
+static bool isBool(const ASTNode* node, bool truth) {
+    return node->getType() == ASTNode::Type::BooleanNode &&
+           (static_cast<const BooleanNode*>(node)->value.type == TokenType::BOOLEAN_TRUE) == truth;
+}
+
+/* Picks the operand an identity operation reduces to, or returns nullptr.
+Only operands of a known type are kept on their own, since e.g. x * 1 must
+still fail when x is not a number. x + 0 is not simplified because it turns
+-0 into 0.*/
+static std::unique_ptr<ASTNode>* identityOperand(BinaryOpNode* node) {
+    ASTNode* left = node->left.get();
+    ASTNode* right = node->right.get();
+    switch (node->op.type) {
+        case TokenType::SUBTRACT:
+            if (isNumber(right, 0) && isNumeric(left)) return &node->left;
+            break;
+        case TokenType::MULTIPLY:
+            if (isNumber(right, 1) && isNumeric(left)) return &node->left;
+            if (isNumber(left, 1) && isNumeric(right)) return &node->right;
+            break;
+        case TokenType::DIVIDE:
+            if (isNumber(right, 1) && isNumeric(left)) return &node->left;
+            break;
+        case TokenType::LOGICAL_AND:
+            if (isBool(right, true) && isBoolean(left)) return &node->left;
+            if (isBool(left, true) && isBoolean(right)) return &node->right;
+            break;
+        case TokenType::LOGICAL_OR:
+        case TokenType::LOGICAL_XOR:
+            if (isBool(right, false) && isBoolean(left)) return &node->left;
+            if (isBool(left, false) && isBoolean(right)) return &node->right;
+            break;
+        default:
+            break;
+    }
+    return nullptr;
+}
+
+static void optimizeBinaryOperation(std::unique_ptr<ASTNode>& node) {
+    auto binaryOpNode = static_cast<BinaryOpNode*>(node.get());
+    optimizeExpression(binaryOpNode->left);
+    optimizeExpression(binaryOpNode->right);
+    if (!binaryOpNode->left || !binaryOpNode->right) {
+        return;
+    }
+
+    Value left, right, result;
+    if (literalValue(binaryOpNode->left.get(), left) && literalValue(binaryOpNode->right.get(), right)) {
+        if (foldOperation(binaryOpNode->op.type, left, right, result)) {
+            node = literalNode(result, binaryOpNode->op);
+        }
+        return;
+    }
+
+    std::unique_ptr<ASTNode>* operand = identityOperand(binaryOpNode);
+    if (operand) {
+        std::unique_ptr<ASTNode> kept = std::move(*operand);
+        node = std::move(kept);
+    }
+}
+
+static void optimizeExpression(std::unique_ptr<ASTNode>& node) {
+    if (!node) return;
+
+    switch (node->getType()) {
+        case ASTNode::Type::BinaryOpNode:
+            optimizeBinaryOperation(node);
+            break;
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<AssignmentNode*>(node.get());
+            optimizeExpression(assignmentNode->lhs);
+            optimizeExpression(assignmentNode->rhs);
+            break;
+        }
+        case ASTNode::Type::CallNode:
+            for (auto& argument : static_cast<CallNode*>(node.get())->arguments) {
+                optimizeExpression(argument);
+            }
+            break;
+        case ASTNode::Type::ArrayLiteralNode:
+            for (auto& element : static_cast<ArrayLiteralNode*>(node.get())->elements) {
+                optimizeExpression(element);
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<ArrayLookupNode*>(node.get());
+            optimizeExpression(lookupNode->array);
+            optimizeExpression(lookupNode->index);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Whether a statement is an if whose condition is already known
+static bool isConstantIf(const ASTNode* node) {
+    return node && node->getType() == ASTNode::Type::IfNode &&
+           static_cast<const IfNode*>(node)->condition->getType() == ASTNode::Type::BooleanNode;
+}
+
+// Replaces an if with a constant condition by the branch it always takes (possibly nothing)
+static std::unique_ptr<ASTNode> takenBranch(std::unique_ptr<ASTNode> node) {
+    while (isConstantIf(node.get())) {
+        auto ifNode = static_cast<IfNode*>(node.get());
+        std::unique_ptr<ASTNode> branch = isBool(ifNode->condition.get(), true)
+            ? std::move(ifNode->trueBranch) : std::move(ifNode->falseBranch);
+        node = std::move(branch);
+    }
+    return node;
+}
+
+// Appends an optimized statement to a block, splicing in the branches of pruned ifs
+static void appendStatement(std::vector<std::unique_ptr<ASTNode>>& statements, std::unique_ptr<ASTNode> node) {
+    bool pruned = isConstantIf(node.get());
+    node = takenBranch(std::move(node));
+    if (!node) {
+        return;
+    }
+    if (node->getType() == ASTNode::Type::WhileNode &&
+        isBool(static_cast<WhileNode*>(node.get())->condition.get(), false)) {
+        return;
+    }
+    if (pruned && node->getType() == ASTNode::Type::BlockNode) {
+        for (auto& statement : static_cast<BlockNode*>(node.get())->statements) {
+            appendStatement(statements, std::move(statement));
+        }
+        return;
+    }
+    statements.push_back(std::move(node));
+}
+
+static void optimizeStatement(std::unique_ptr<ASTNode>& node) {
+    if (!node) return;
+
+    switch (node->getType()) {
+        case ASTNode::Type::BlockNode: {
+            auto blockNode = static_cast<BlockNode*>(node.get());
+            std::vector<std::unique_ptr<ASTNode>> statements;
+            statements.reserve(blockNode->statements.size());
+            for (auto& statement : blockNode->statements) {
+                optimizeStatement(statement);
+                appendStatement(statements, std::move(statement));
+            }
+            blockNode->statements = std::move(statements);
+            break;
+        }
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<IfNode*>(node.get());
+            optimizeExpression(ifNode->condition);
+            optimizeStatement(ifNode->trueBranch);
+            optimizeStatement(ifNode->falseBranch);
+            if (isConstantIf(ifNode->falseBranch.get())) {
+                ifNode->falseBranch = takenBranch(std::move(ifNode->falseBranch));
+            }
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<WhileNode*>(node.get());
+            optimizeExpression(whileNode->condition);
+            optimizeStatement(whileNode->body);
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            optimizeExpression(static_cast<PrintNode*>(node.get())->expression);
+            break;
+        case ASTNode::Type::FunctionNode:
+            optimizeStatement(static_cast<FunctionNode*>(node.get())->body);
+            break;
+        case ASTNode::Type::ReturnNode:
+            optimizeExpression(static_cast<ReturnNode*>(node.get())->value);
+            break;
+        default:
+            optimizeExpression(node);
+            break;
+    }
+}
+
+// Variables a loop may rebind, and whether it may change the contents of arrays
+struct LoopEffects {
+    std::unordered_set<SymbolId> assigned;
+    bool mutatesArrays = false;
+};
+
+// Collects the effects of a loop's condition and body, nested functions only count as a binding
+static void collectEffects(const ASTNode* node, LoopEffects& effects) {
+    if (!node) {
+        return;
+    }
+    switch (node->getType()) {
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            collectEffects(binaryOpNode->left.get(), effects);
+            collectEffects(binaryOpNode->right.get(), effects);
+            break;
+        }
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<const AssignmentNode*>(node);
+            if (assignmentNode->lhs->getType() == ASTNode::Type::VariableNode) {
+                effects.assigned.insert(static_cast<const VariableNode*>(assignmentNode->lhs.get())->identifier.symbol);
+            } else {
+                effects.mutatesArrays = true;
+                collectEffects(assignmentNode->lhs.get(), effects);
+            }
+            collectEffects(assignmentNode->rhs.get(), effects);
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            collectEffects(static_cast<const PrintNode*>(node)->expression.get(), effects);
+            break;
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<const IfNode*>(node);
+            collectEffects(ifNode->condition.get(), effects);
+            collectEffects(ifNode->trueBranch.get(), effects);
+            collectEffects(ifNode->falseBranch.get(), effects);
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<const WhileNode*>(node);
+            collectEffects(whileNode->condition.get(), effects);
+            collectEffects(whileNode->body.get(), effects);
+            break;
+        }
+        case ASTNode::Type::BlockNode:
+            for (const auto& stmt : static_cast<const BlockNode*>(node)->statements) {
+                collectEffects(stmt.get(), effects);
+            }
+            break;
+        case ASTNode::Type::FunctionNode:
+            effects.assigned.insert(static_cast<const FunctionNode*>(node)->name.symbol);
+            break;
+        case ASTNode::Type::ReturnNode:
+            collectEffects(static_cast<const ReturnNode*>(node)->value.get(), effects);
+            break;
+        case ASTNode::Type::CallNode: {
+            // push and pop change their array, any other function but len might reach an array too
+            auto callNode = static_cast<const CallNode*>(node);
+            if (callNode->callee->getType() != ASTNode::Type::VariableNode ||
+                static_cast<const VariableNode*>(callNode->callee.get())->identifier.symbol != LEN) {
+                effects.mutatesArrays = true;
+            }
+            collectEffects(callNode->callee.get(), effects);
+            for (const auto& arg : callNode->arguments) {
+                collectEffects(arg.get(), effects);
+            }
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (const auto& element : static_cast<const ArrayLiteralNode*>(node)->elements) {
+                collectEffects(element.get(), effects);
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            collectEffects(lookupNode->array.get(), effects);
+            collectEffects(lookupNode->index.get(), effects);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static bool isLenCall(const ASTNode* node) {
+    if (node->getType() != ASTNode::Type::CallNode) {
+        return false;
+    }
+    auto callNode = static_cast<const CallNode*>(node);
+    return callNode->callee->getType() == ASTNode::Type::VariableNode &&
+           static_cast<const VariableNode*>(callNode->callee.get())->identifier.symbol == LEN &&
+           callNode->arguments.size() == 1;
+}
+
+// Decides which variable reads are known to succeed
+using ReadCheck = std::function<bool(const VariableNode*)>;
+
+/* Whether evaluating an expression can neither fail nor have side effects, so
+it may be evaluated earlier, more than once or not at all. The type inference
+proves the operands of the operators; len only qualifies while no array can
+change.*/
+static bool isSafe(const ASTNode* node, const TypeInference& types, const ReadCheck& readable, bool arraysChange) {
+    switch (node->getType()) {
+        case ASTNode::Type::NumberNode:
+        case ASTNode::Type::BooleanNode:
+        case ASTNode::Type::NullNode:
+            return true;
+        case ASTNode::Type::VariableNode:
+            return readable(static_cast<const VariableNode*>(node));
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            const ASTNode* left = binaryOpNode->left.get();
+            const ASTNode* right = binaryOpNode->right.get();
+            if (!isSafe(left, types, readable, arraysChange) || !isSafe(right, types, readable, arraysChange)) {
+                return false;
+            }
+            bool numbers = types.typeOf(left) == StaticType::Number && types.typeOf(right) == StaticType::Number;
+            bool bools = types.typeOf(left) == StaticType::Bool && types.typeOf(right) == StaticType::Bool;
+            switch (binaryOpNode->op.type) {
+                case TokenType::ADD: case TokenType::SUBTRACT: case TokenType::MULTIPLY:
+                case TokenType::LESS: case TokenType::LESS_EQUAL:
+                case TokenType::GREATER: case TokenType::GREATER_EQUAL:
+                    return numbers;
+                case TokenType::DIVIDE: case TokenType::MODULO:
+                    return numbers && right->getType() == ASTNode::Type::NumberNode && !isNumber(right, 0);
+                case TokenType::EQUAL: case TokenType::NOT_EQUAL:
+                    return true;
+                case TokenType::LOGICAL_AND: case TokenType::LOGICAL_XOR: case TokenType::LOGICAL_OR:
+                    return bools;
+                default:
+                    return false;
+            }
+        }
+        case ASTNode::Type::CallNode: {
+            if (!isLenCall(node) || arraysChange) {
+                return false;
+            }
+            const ASTNode* array = static_cast<const CallNode*>(node)->arguments[0].get();
+            return isSafe(array, types, readable, arraysChange) && types.typeOf(array) == StaticType::Array;
+        }
+        default:
+            return false;
+    }
+}
+
+/* Whether an expression gives the same value on every iteration and can be
+evaluated before the loop without being observable: it is safe and reads only
+variables the loop does not rebind (and which are bound before it). Variables
+a function keeps in its environment are left alone, any call in the loop may
+re-enter the function and rebind them.*/
+static bool isInvariant(const ASTNode* node, const LoopEffects& effects, const TypeInference& types) {
+    return isSafe(node, types, [&](const VariableNode* variable) {
+        SymbolId identifier = variable->identifier.symbol;
+        return !effects.assigned.count(identifier) && !types.isPersistent(SymbolTable::name(identifier)) &&
+               types.typeOf(variable) != StaticType::Unknown;
+    }, effects.mutatesArrays);
+}
+
+// Structural equality of two invariant expressions
+static bool sameExpression(const ASTNode* left, const ASTNode* right) {
+    if (left->getType() != right->getType()) {
+        return false;
+    }
+    switch (left->getType()) {
+        case ASTNode::Type::NumberNode:
+            return static_cast<const NumberNode*>(left)->value.number() ==
+                   static_cast<const NumberNode*>(right)->value.number();
+        case ASTNode::Type::BooleanNode:
+            return static_cast<const BooleanNode*>(left)->value.type == static_cast<const BooleanNode*>(right)->value.type;
+        case ASTNode::Type::NullNode:
+            return true;
+        case ASTNode::Type::VariableNode:
+            return static_cast<const VariableNode*>(left)->identifier.symbol ==
+                   static_cast<const VariableNode*>(right)->identifier.symbol;
+        case ASTNode::Type::BinaryOpNode: {
+            auto leftOp = static_cast<const BinaryOpNode*>(left);
+            auto rightOp = static_cast<const BinaryOpNode*>(right);
+            return leftOp->op.type == rightOp->op.type &&
+                   sameExpression(leftOp->left.get(), rightOp->left.get()) &&
+                   sameExpression(leftOp->right.get(), rightOp->right.get());
+        }
+        case ASTNode::Type::CallNode:
+            return sameExpression(static_cast<const CallNode*>(left)->arguments[0].get(),
+                                  static_cast<const CallNode*>(right)->arguments[0].get());
+        default:
+            return false;
+    }
+}
+
+// State of hoisting the invariants out of one loop
+struct LoopHoist {
+    const LoopEffects& effects;
+    const TypeInference& types;
+    std::vector<std::unique_ptr<ASTNode>>& hoisted;   // assignments of the temporaries, run before the loop
+    size_t& temporaries;
+};
+
+/* Replaces the largest invariant subexpressions by temporaries assigned before
+the loop. Temporaries are named with a $ so they cannot clash with identifiers
+of the program, nameTemporaries renames them when the program is printed.*/
+static void hoistExpression(std::unique_ptr<ASTNode>& node, LoopHoist& loop) {
+    if (!node) return;
+
+    bool computes = node->getType() == ASTNode::Type::BinaryOpNode || node->getType() == ASTNode::Type::CallNode;
+    if (computes && isInvariant(node.get(), loop.effects, loop.types)) {
+        const Token& at = node->getType() == ASTNode::Type::BinaryOpNode
+            ? static_cast<BinaryOpNode*>(node.get())->op
+            : static_cast<VariableNode*>(static_cast<CallNode*>(node.get())->callee.get())->identifier;
+        Token temporary(TokenType::IDENTIFIER, NO_SYMBOL, at.offset);
+        for (const auto& assignment : loop.hoisted) {
+            auto assignmentNode = static_cast<const AssignmentNode*>(assignment.get());
+            if (sameExpression(assignmentNode->rhs.get(), node.get())) {
+                temporary.symbol = static_cast<const VariableNode*>(assignmentNode->lhs.get())->identifier.symbol;
+                break;
+            }
+        }
+        if (temporary.symbol == NO_SYMBOL) {
+            temporary.symbol = SymbolTable::intern("$" + std::to_string(loop.temporaries++));
+            loop.hoisted.push_back(std::make_unique<AssignmentNode>(
+                std::make_unique<VariableNode>(temporary), std::move(node)));
+        }
+        node = std::make_unique<VariableNode>(temporary);
+        return;
+    }
+
+    switch (node->getType()) {
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<BinaryOpNode*>(node.get());
+            hoistExpression(binaryOpNode->left, loop);
+            hoistExpression(binaryOpNode->right, loop);
+            break;
+        }
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<AssignmentNode*>(node.get());
+            if (assignmentNode->lhs->getType() == ASTNode::Type::ArrayLookupNode) {
+                hoistExpression(static_cast<ArrayLookupNode*>(assignmentNode->lhs.get())->index, loop);
+            }
+            hoistExpression(assignmentNode->rhs, loop);
+            break;
+        }
+        case ASTNode::Type::CallNode:
+            for (auto& argument : static_cast<CallNode*>(node.get())->arguments) {
+                hoistExpression(argument, loop);
+            }
+            break;
+        case ASTNode::Type::ArrayLiteralNode:
+            for (auto& element : static_cast<ArrayLiteralNode*>(node.get())->elements) {
+                hoistExpression(element, loop);
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<ArrayLookupNode*>(node.get());
+            hoistExpression(lookupNode->array, loop);
+            hoistExpression(lookupNode->index, loop);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static bool isTemporary(const Token& name) {
+    return name.text()[0] == '$';
+}
+
+// Whether a statement assigns the temporary of an inner loop
+static bool isTemporaryAssignment(const ASTNode* node) {
+    if (node->getType() != ASTNode::Type::AssignmentNode) {
+        return false;
+    }
+    const ASTNode* lhs = static_cast<const AssignmentNode*>(node)->lhs.get();
+    return lhs->getType() == ASTNode::Type::VariableNode && isTemporary(static_cast<const VariableNode*>(lhs)->identifier);
+}
+
+static void hoistFromStatement(std::unique_ptr<ASTNode>& node, LoopHoist& loop) {
+    if (!node) return;
+
+    switch (node->getType()) {
+        case ASTNode::Type::BlockNode: {
+            // Temporaries of inner loops that are invariant here too move out as a whole
+            auto& statements = static_cast<BlockNode*>(node.get())->statements;
+            std::vector<std::unique_ptr<ASTNode>> kept;
+            for (auto& statement : statements) {
+                if (isTemporaryAssignment(statement.get()) &&
+                    isInvariant(static_cast<AssignmentNode*>(statement.get())->rhs.get(), loop.effects, loop.types)) {
+                    loop.hoisted.push_back(std::move(statement));
+                    continue;
+                }
+                hoistFromStatement(statement, loop);
+                kept.push_back(std::move(statement));
+            }
+            statements = std::move(kept);
+            break;
+        }
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<IfNode*>(node.get());
+            hoistExpression(ifNode->condition, loop);
+            hoistFromStatement(ifNode->trueBranch, loop);
+            hoistFromStatement(ifNode->falseBranch, loop);
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<WhileNode*>(node.get());
+            hoistExpression(whileNode->condition, loop);
+            hoistFromStatement(whileNode->body, loop);
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            hoistExpression(static_cast<PrintNode*>(node.get())->expression, loop);
+            break;
+        case ASTNode::Type::ReturnNode:
+            hoistExpression(static_cast<ReturnNode*>(node.get())->value, loop);
+            break;
+        case ASTNode::Type::FunctionNode:
+            break;
+        default:
+            hoistExpression(node, loop);
+            break;
+    }
+}
+
+static void hoistInFunction(FunctionNode* function, size_t& temporaries);
+
+// Hoists out of every loop in a block, inner loops first so their invariants can move further out
+static void hoistInStatement(std::unique_ptr<ASTNode>& node, const TypeInference& types, size_t& temporaries) {
+    if (!node) return;
+
+    switch (node->getType()) {
+        case ASTNode::Type::BlockNode: {
+            auto blockNode = static_cast<BlockNode*>(node.get());
+            std::vector<std::unique_ptr<ASTNode>> statements;
+            for (auto& statement : blockNode->statements) {
+                hoistInStatement(statement, types, temporaries);
+                if (statement->getType() == ASTNode::Type::WhileNode) {
+                    auto whileNode = static_cast<WhileNode*>(statement.get());
+                    LoopEffects effects;
+                    collectEffects(whileNode->condition.get(), effects);
+                    collectEffects(whileNode->body.get(), effects);
+                    std::vector<std::unique_ptr<ASTNode>> hoisted;
+                    LoopHoist loop{effects, types, hoisted, temporaries};
+                    hoistExpression(whileNode->condition, loop);
+                    hoistFromStatement(whileNode->body, loop);
+                    for (auto& assignment : hoisted) {
+                        statements.push_back(std::move(assignment));
+                    }
+                }
+                statements.push_back(std::move(statement));
+            }
+            blockNode->statements = std::move(statements);
+            break;
+        }
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<IfNode*>(node.get());
+            hoistInStatement(ifNode->trueBranch, types, temporaries);
+            hoistInStatement(ifNode->falseBranch, types, temporaries);
+            break;
+        }
+        case ASTNode::Type::WhileNode:
+            hoistInStatement(static_cast<WhileNode*>(node.get())->body, types, temporaries);
+            break;
+        case ASTNode::Type::FunctionNode:
+            hoistInFunction(static_cast<FunctionNode*>(node.get()), temporaries);
+            break;
+        default:
+            break;
+    }
+}
+
+// Loop-invariant code motion over the top level block, types are inferred per body
+static void hoistInvariants(std::unique_ptr<ASTNode>& body, size_t& temporaries) {
+    TypeInference types;
+    types.analyze(body.get());
+    hoistInStatement(body, types, temporaries);
+}
+
+// The same over a function body, which tells the variables kept in the function's environment apart
+static void hoistInFunction(FunctionNode* function, size_t& temporaries) {
+    TypeInference types;
+    types.analyzeFunction(function);
+    hoistInStatement(function->body, types, temporaries);
+}
+
+// Calls visit on every token that names a variable, parameter or function
+static void visitNames(ASTNode* node, const std::function<void(Token&)>& visit) {
+    if (!node) {
+        return;
+    }
+    switch (node->getType()) {
+        case ASTNode::Type::VariableNode:
+            visit(static_cast<VariableNode*>(node)->identifier);
+            break;
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<BinaryOpNode*>(node);
+            visitNames(binaryOpNode->left.get(), visit);
+            visitNames(binaryOpNode->right.get(), visit);
+            break;
+        }
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<AssignmentNode*>(node);
+            visitNames(assignmentNode->lhs.get(), visit);
+            visitNames(assignmentNode->rhs.get(), visit);
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            visitNames(static_cast<PrintNode*>(node)->expression.get(), visit);
+            break;
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<IfNode*>(node);
+            visitNames(ifNode->condition.get(), visit);
+            visitNames(ifNode->trueBranch.get(), visit);
+            visitNames(ifNode->falseBranch.get(), visit);
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<WhileNode*>(node);
+            visitNames(whileNode->condition.get(), visit);
+            visitNames(whileNode->body.get(), visit);
+            break;
+        }
+        case ASTNode::Type::BlockNode:
+            for (auto& statement : static_cast<BlockNode*>(node)->statements) {
+                visitNames(statement.get(), visit);
+            }
+            break;
+        case ASTNode::Type::FunctionNode: {
+            auto functionNode = static_cast<FunctionNode*>(node);
+            visit(functionNode->name);
+            for (auto& param : functionNode->parameters) {
+                visit(param);
+            }
+            visitNames(functionNode->body.get(), visit);
+            break;
+        }
+        case ASTNode::Type::ReturnNode:
+            visitNames(static_cast<ReturnNode*>(node)->value.get(), visit);
+            break;
+        case ASTNode::Type::CallNode: {
+            auto callNode = static_cast<CallNode*>(node);
+            visitNames(callNode->callee.get(), visit);
+            for (auto& arg : callNode->arguments) {
+                visitNames(arg.get(), visit);
+            }
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (auto& element : static_cast<ArrayLiteralNode*>(node)->elements) {
+                visitNames(element.get(), visit);
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<ArrayLookupNode*>(node);
+            visitNames(lookupNode->array.get(), visit);
+            visitNames(lookupNode->index.get(), visit);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Builtins are bound by name wherever they are called
+static bool isBuiltinName(SymbolId identifier) {
+    return identifier == LEN || identifier == POP || identifier == PUSH;
+}
+
+/* Whether the expression a function returns can stand in for its calls. It may
+only read the parameters and call len, so it means the same at any call site,
+cannot recurse and cannot change an array an argument reads.*/
+static bool isInlinable(const ASTNode* node, const std::vector<Token>& parameters) {
+    switch (node->getType()) {
+        case ASTNode::Type::NumberNode:
+        case ASTNode::Type::BooleanNode:
+        case ASTNode::Type::NullNode:
+            return true;
+        case ASTNode::Type::VariableNode:
+            for (const auto& param : parameters) {
+                if (param.symbol == static_cast<const VariableNode*>(node)->identifier.symbol) {
+                    return true;
+                }
+            }
+            return false;
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            if (!isNumeric(node) && !isBoolean(node)) {
+                return false;
+            }
+            return isInlinable(binaryOpNode->left.get(), parameters) && isInlinable(binaryOpNode->right.get(), parameters);
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (const auto& element : static_cast<const ArrayLiteralNode*>(node)->elements) {
+                if (!isInlinable(element.get(), parameters)) {
+                    return false;
+                }
+            }
+            return true;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            return isInlinable(lookupNode->array.get(), parameters) && isInlinable(lookupNode->index.get(), parameters);
+        }
+        case ASTNode::Type::CallNode: {
+            auto callNode = static_cast<const CallNode*>(node);
+            if (callNode->callee->getType() != ASTNode::Type::VariableNode ||
+                static_cast<const VariableNode*>(callNode->callee.get())->identifier.symbol != LEN) {
+                return false;
+            }
+            for (const auto& arg : callNode->arguments) {
+                if (!isInlinable(arg.get(), parameters)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static size_t nodeCount(const ASTNode* node) {
+    if (!node) {
+        return 0;
+    }
+    size_t count = 1;
+    switch (node->getType()) {
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            count += nodeCount(binaryOpNode->left.get()) + nodeCount(binaryOpNode->right.get());
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (const auto& element : static_cast<const ArrayLiteralNode*>(node)->elements) {
+                count += nodeCount(element.get());
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            count += nodeCount(lookupNode->array.get()) + nodeCount(lookupNode->index.get());
+            break;
+        }
+        case ASTNode::Type::CallNode:
+            for (const auto& arg : static_cast<const CallNode*>(node)->arguments) {
+                count += nodeCount(arg.get());
+            }
+            break;
+        default:
+            break;
+    }
+    return count;
+}
+
+// Substitutes copies of the arguments for the parameter reads of an inlined expression
+static void replaceParameters(std::unique_ptr<ASTNode>& node, const SymbolMap<const ASTNode*>& arguments) {
+    switch (node->getType()) {
+        case ASTNode::Type::VariableNode: {
+            auto argument = arguments.find(static_cast<const VariableNode*>(node.get())->identifier.symbol);
+            if (argument) {
+                node.reset((*argument)->clone());
+            }
+            break;
+        }
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<BinaryOpNode*>(node.get());
+            replaceParameters(binaryOpNode->left, arguments);
+            replaceParameters(binaryOpNode->right, arguments);
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (auto& element : static_cast<ArrayLiteralNode*>(node.get())->elements) {
+                replaceParameters(element, arguments);
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<ArrayLookupNode*>(node.get());
+            replaceParameters(lookupNode->array, arguments);
+            replaceParameters(lookupNode->index, arguments);
+            break;
+        }
+        case ASTNode::Type::CallNode:
+            for (auto& arg : static_cast<CallNode*>(node.get())->arguments) {
+                replaceParameters(arg, arguments);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// What a call site may inline
+struct InlineContext {
+    SymbolMap<const FunctionNode*> functions;   // stable functions defined before the site
+    const TypeInference* types;
+    std::unordered_set<SymbolId> shadowed;      // names the enclosing functions bind themselves
+    std::unordered_set<SymbolId> parameters;    // parameters of the innermost function, always bound
+    size_t budget;
+};
+
+static void inlineInStatement(std::unique_ptr<ASTNode>& node, const InlineContext& context);
+
+/* Replaces a call by the expression its function returns, with the arguments
+substituted for the parameters. The arguments must be safe, since inlining may
+evaluate them later, several times or not at all, instead of exactly once
+before the body.*/
+static void inlineInExpression(std::unique_ptr<ASTNode>& node, const InlineContext& context) {
+    if (!node) return;
+
+    switch (node->getType()) {
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<BinaryOpNode*>(node.get());
+            inlineInExpression(binaryOpNode->left, context);
+            inlineInExpression(binaryOpNode->right, context);
+            return;
+        }
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<AssignmentNode*>(node.get());
+            inlineInExpression(assignmentNode->rhs, context);
+            if (assignmentNode->lhs->getType() == ASTNode::Type::ArrayLookupNode) {
+                inlineInExpression(static_cast<ArrayLookupNode*>(assignmentNode->lhs.get())->index, context);
+            }
+            return;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (auto& element : static_cast<ArrayLiteralNode*>(node.get())->elements) {
+                inlineInExpression(element, context);
+            }
+            return;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<ArrayLookupNode*>(node.get());
+            inlineInExpression(lookupNode->array, context);
+            inlineInExpression(lookupNode->index, context);
+            return;
+        }
+        case ASTNode::Type::CallNode:
+            break;
+        default:
+            return;
+    }
+
+    auto callNode = static_cast<CallNode*>(node.get());
+    for (auto& arg : callNode->arguments) {
+        inlineInExpression(arg, context);
+    }
+    if (callNode->callee->getType() != ASTNode::Type::VariableNode) {
+        return;
+    }
+    SymbolId callee = static_cast<const VariableNode*>(callNode->callee.get())->identifier.symbol;
+    const FunctionNode* const* function = context.functions.find(callee);
+    if (!function || context.shadowed.count(callee) || (*function)->parameters.size() != callNode->arguments.size()) {
+        return;
+    }
+
+    const TypeInference& types = *context.types;
+    ReadCheck readable = [&](const VariableNode* variable) {
+        return context.parameters.count(variable->identifier.symbol) || types.typeOf(variable) != StaticType::Unknown;
+    };
+    SymbolMap<const ASTNode*> arguments;
+    for (size_t i = 0; i < callNode->arguments.size(); ++i) {
+        if (!isSafe(callNode->arguments[i].get(), types, readable, false)) {
+            return;
+        }
+        arguments.emplace((*function)->parameters[i].symbol, callNode->arguments[i].get());
+    }
+
+    auto returnNode = static_cast<const ReturnNode*>(static_cast<const BlockNode*>((*function)->body.get())->statements[0].get());
+    std::unique_ptr<ASTNode> expansion(returnNode->value->clone());
+    replaceParameters(expansion, arguments);
+    if (nodeCount(expansion.get()) <= context.budget) {
+        node = std::move(expansion);
+    }
+}
+
+static void inlineInStatement(std::unique_ptr<ASTNode>& node, const InlineContext& context) {
+    if (!node) return;
+
+    switch (node->getType()) {
+        case ASTNode::Type::BlockNode:
+            for (auto& statement : static_cast<BlockNode*>(node.get())->statements) {
+                inlineInStatement(statement, context);
+            }
+            break;
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<IfNode*>(node.get());
+            inlineInExpression(ifNode->condition, context);
+            inlineInStatement(ifNode->trueBranch, context);
+            inlineInStatement(ifNode->falseBranch, context);
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<WhileNode*>(node.get());
+            inlineInExpression(whileNode->condition, context);
+            inlineInStatement(whileNode->body, context);
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            inlineInExpression(static_cast<PrintNode*>(node.get())->expression, context);
+            break;
+        case ASTNode::Type::ReturnNode:
+            inlineInExpression(static_cast<ReturnNode*>(node.get())->value, context);
+            break;
+        case ASTNode::Type::FunctionNode: {
+            // Inside a function its own name, parameters and locals hide the global functions
+            auto functionNode = static_cast<FunctionNode*>(node.get());
+            LoopEffects locals;
+            collectEffects(functionNode->body.get(), locals);
+            TypeInference types;
+            types.analyze(functionNode->body.get());
+
+            InlineContext inner{context.functions, &types, context.shadowed, {}, context.budget};
+            inner.shadowed.insert(functionNode->name.symbol);
+            inner.shadowed.insert(locals.assigned.begin(), locals.assigned.end());
+            for (const auto& param : functionNode->parameters) {
+                inner.shadowed.insert(param.symbol);
+                inner.parameters.insert(param.symbol);
+            }
+            inlineInStatement(functionNode->body, inner);
+            break;
+        }
+        default:
+            inlineInExpression(node, context);
+            break;
+    }
+}
+
+// Whether a top level function consists of a single return of an inlinable expression
+static bool isInlineCandidate(const FunctionNode* node) {
+    if (isBuiltinName(node->name.symbol) || !node->body || node->body->getType() != ASTNode::Type::BlockNode) {
+        return false;
+    }
+    std::unordered_set<SymbolId> distinct;
+    for (const auto& param : node->parameters) {
+        if (!distinct.insert(param.symbol).second) {
+            return false;
+        }
+    }
+    const auto& statements = static_cast<const BlockNode*>(node->body.get())->statements;
+    if (statements.size() != 1 || statements[0]->getType() != ASTNode::Type::ReturnNode) {
+        return false;
+    }
+    const ASTNode* value = static_cast<const ReturnNode*>(statements[0].get())->value.get();
+    return value && isInlinable(value, node->parameters);
+}
+
+/* Inlines calls of small functions defined at the top of the script. A
+function's binding is stable when its definition is the only top level
+statement that binds the name (functions only ever assign their own locals),
+and a call can only run after the definition when it comes later in the
+script, possibly inside a function defined later.*/
+static void inlineFunctions(std::unique_ptr<ASTNode>& program, size_t budget) {
+    if (!program || program->getType() != ASTNode::Type::BlockNode) {
+        return;
+    }
+    auto& statements = static_cast<BlockNode*>(program.get())->statements;
+
+    std::unordered_map<SymbolId, int> bindings;
+    for (const auto& statement : statements) {
+        LoopEffects effects;
+        collectEffects(statement.get(), effects);
+        for (const auto& identifier : effects.assigned) {
+            ++bindings[identifier];
+        }
+    }
+
+    TypeInference types;
+    types.analyze(program.get());
+    InlineContext script{{}, &types, {}, {}, budget};
+    for (auto& statement : statements) {
+        inlineInStatement(statement, script);
+        if (statement->getType() == ASTNode::Type::FunctionNode) {
+            auto functionNode = static_cast<const FunctionNode*>(statement.get());
+            if (bindings[functionNode->name.symbol] == 1 && isInlineCandidate(functionNode)) {
+                script.functions.emplace(functionNode->name.symbol, functionNode);
+            }
+        }
+    }
+}
+
+void optimizeAST(std::unique_ptr<ASTNode>& node, const OptimizerOptions& options) {
+    optimizeStatement(node);
+    if (options.inlineFunctions) {
+        inlineFunctions(node, options.inlineBudget);
+        optimizeStatement(node);
+    }
+    size_t temporaries = 0;
+    hoistInvariants(node, temporaries);
+}
+
+void nameTemporaries(std::unique_ptr<ASTNode>& node) {
+    std::unordered_set<SymbolId> used;
+    visitNames(node.get(), [&](Token& name) {
+        used.insert(name.symbol);
+    });
+
+    SymbolMap<SymbolId> names;
+    size_t next = 0;
+    visitNames(node.get(), [&](Token& name) {
+        if (!isTemporary(name)) {
+            return;
+        }
+        SymbolId* renamed = names.find(name.symbol);
+        if (!renamed) {
+            SymbolId fresh;
+            do {
+                fresh = SymbolTable::intern("tmp" + std::to_string(next++));
+            } while (used.count(fresh));
+            renamed = names.emplace(name.symbol, fresh).first;
+        }
+        name.symbol = *renamed;
+    });
+}
+
+void optimizeBody(FunctionNode& function) {
+    optimizeStatement(function.body);
+    size_t temporaries = 0;
+    hoistInFunction(&function, temporaries);
+}
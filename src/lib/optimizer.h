@@ -0,0 +1,31 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ASTNodes.h"
+#include <cstddef>
+#include <memory>
+
+// Settings of the optimizer passes
+struct OptimizerOptions {
+    bool inlineFunctions = true;
+    size_t inlineBudget = 24;       // largest expression a call may expand to, in AST nodes
+};
+
+/* Simplifies a parsed program in place: constant operator subtrees are folded
+into literals, identity operations are dropped and if/while statements with a
+constant bool condition are pruned. Calls of small top level functions are
+replaced by the expression they return and loop invariants are hoisted.
+Anything that would raise a runtime error (division by zero, invalid operands,
+non-bool conditions) is left untouched so the error is still reported when the
+program runs.*/
+void optimizeAST(std::unique_ptr<ASTNode>& node, const OptimizerOptions& options = OptimizerOptions());
+
+/* Renames the temporaries that hold hoisted invariants, whose names the lexer
+never produces, to identifiers the program does not use, so the program can be
+printed and parsed again.*/
+void nameTemporaries(std::unique_ptr<ASTNode>& node);
+
+// Optimizes a function body parsed after its program was, calls in it are not inlined
+void optimizeBody(FunctionNode& function);
+
+#endif // OPTIMIZER_H
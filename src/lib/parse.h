@@ -24,11 +24,15 @@ private:
     vector<Token> tokens;
     int currentTokenIndex;
     int currentLineNumber;
+    int depth;                  // parentheses open around the current token
     Node* root;
     Token& currentToken();
     Node* expression(std::ostream& os = std::cerr);
     Node* number(std::ostream& os = std::cerr);
 public:
+    // Deeper nesting is a syntax error instead of overflowing the native stack
+    static const int MAX_DEPTH = 10000;
+
     Parser(const vector<Token>& tokens, int lineCount);
     ~Parser();
     Node* parse(std::ostream& os = std::cerr);
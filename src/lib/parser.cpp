@@ -6,7 +6,7 @@
 //Used for accessing current token. 
 
 Parser::Parser(const std::vector<Token> &tokens, int lineCount) 
-    : tokens(tokens), currentTokenIndex(0), currentLineNumber(lineCount) {}
+    : tokens(tokens), currentTokenIndex(0), currentLineNumber(lineCount), depth(0) {}
 
 Token &Parser::currentToken(){
     return tokens[currentTokenIndex];
@@ -19,6 +19,11 @@ Everytime thers a new braket ( or ) it extends to the children nodes.
 */
 Node *Parser::expression(std::ostream &os){
     if (currentToken().type == TokenType::LEFT_PAREN){
+        if (depth == MAX_DEPTH) {
+            os << "Nesting too deep at line " << currentToken().line() << " column " << currentToken().column() << ": " << currentToken().text() << std::endl;
+            exit(2);
+        }
+        depth++;
         currentTokenIndex++;
         Node *node = nullptr;
         switch (currentToken().type) {
@@ -39,13 +44,13 @@ Node *Parser::expression(std::ostream &os){
                     node = new Node(NodeType::ASSIGN);
                     currentTokenIndex++;
                     if (currentToken().type != TokenType::IDENTIFIER) {
-                        os << "Unexpected token at line " << currentToken().line << " column " << currentToken().column << ": " << currentToken().value << std::endl;
+                        os << "Unexpected token at line " << currentToken().line() << " column " << currentToken().column() << ": " << currentToken().text() << std::endl;
                         exit(2);
                     }
                     bool nonIdentifierEncountered = false;
                     while (currentToken().type != TokenType::RIGHT_PAREN) {
                         if (nonIdentifierEncountered && currentToken().type != TokenType::RIGHT_PAREN) {
-                            os << "Unexpected token at line " << currentToken().line << " column " << currentToken().column << ": " << currentToken().value << std::endl;
+                            os << "Unexpected token at line " << currentToken().line() << " column " << currentToken().column() << ": " << currentToken().text() << std::endl;
                             exit(2);
                         }
                         node->children.push_back(expression(os));
@@ -54,7 +59,7 @@ Node *Parser::expression(std::ostream &os){
                         }
                     }
                     if (node->children.size() <= 1) {
-                        os << "Unexpected token at line " << currentToken().line << " column " << currentToken().column << ": " << currentToken().value << std::endl;
+                        os << "Unexpected token at line " << currentToken().line() << " column " << currentToken().column() << ": " << currentToken().text() << std::endl;
                         exit(2);
                     }
                     currentTokenIndex++;
@@ -68,9 +73,10 @@ Node *Parser::expression(std::ostream &os){
             node->children.push_back(expression(os));
         }
         currentTokenIndex++;
+        depth--;
         return node;
     } else if (currentToken().type == TokenType::IDENTIFIER){
-        Node *node = new Node(NodeType::IDENTIFIER, 0, currentToken().value);
+        Node *node = new Node(NodeType::IDENTIFIER, 0, currentToken().text());
         currentTokenIndex++;
         return node;
     } else {
@@ -81,8 +87,8 @@ Node *Parser::expression(std::ostream &os){
 // Resposible for parsing the tokens and setting up the AST.
 Node *Parser::parse(std::ostream &os){
     root = expression(os);
-    if (currentToken().type != TokenType::UNKNOWN || currentToken().value != "END"){
-        os << "Unexpected token at line " << currentToken().line << " column " << currentToken().column << ": " << currentToken().value << std::endl;
+    if (currentToken().type != TokenType::UNKNOWN || currentToken().text() != "END"){
+        os << "Unexpected token at line " << currentToken().line() << " column " << currentToken().column() << ": " << currentToken().text() << std::endl;
         exit(2);
     }
     return root;
@@ -105,11 +111,11 @@ Parser::~Parser(){
 
 Node *Parser::number(std::ostream &os) {
     if (currentToken().type == TokenType::NUMBER) {
-        Node *node = new Node(NodeType::NUMBER, std::stod(currentToken().value));
+        Node *node = new Node(NodeType::NUMBER, currentToken().number());
         currentTokenIndex++;
         return node;
     } else {
-        os << "Unexpected token at line " << currentToken().line << " column " << currentToken().column << ": " << currentToken().value << std::endl;
+        os << "Unexpected token at line " << currentToken().line() << " column " << currentToken().column() << ": " << currentToken().text() << std::endl;
         exit(2);
     }
 }
\ No newline at end of file
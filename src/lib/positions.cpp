@@ -0,0 +1,70 @@
+#include "positions.h"
+#include <algorithm>
+
+SourcePositions& SourcePositions::instance() {
+    static SourcePositions positions;
+    return positions;
+}
+
+uint32_t SourcePositions::reserve(size_t length) {
+    SourcePositions& positions = instance();
+    uint32_t begin = positions.next;
+    positions.next += static_cast<uint32_t>(length) + 1;
+    return begin;
+}
+
+void SourcePositions::addSource(uint32_t begin, int firstLine, std::vector<uint32_t> lineStarts) {
+    SourcePositions& positions = instance();
+    Source source{begin, firstLine, static_cast<uint32_t>(positions.lineStarts.size()),
+                  static_cast<uint32_t>(lineStarts.size())};
+    positions.lineStarts.insert(positions.lineStarts.end(), lineStarts.begin(), lineStarts.end());
+    auto& sources = positions.sources;
+    auto at = std::upper_bound(sources.begin(), sources.end(), begin,
+                               [](uint32_t offset, const Source& entry) { return offset < entry.begin; });
+    sources.insert(at, source);
+}
+
+void SourcePositions::release(uint32_t before) {
+    SourcePositions& positions = instance();
+    auto& sources = positions.sources;
+    auto end = std::lower_bound(sources.begin(), sources.end(), before,
+                                [](const Source& source, uint32_t offset) { return source.begin < offset; });
+    uint32_t released = 0;
+    for (auto it = sources.begin(); it != end; ++it) {
+        released += it->startCount;
+    }
+    sources.erase(sources.begin(), end);
+    positions.lineStarts.erase(positions.lineStarts.begin(), positions.lineStarts.begin() + released);
+    for (Source& source : sources) {
+        source.firstStart -= released;
+    }
+}
+
+const SourcePositions::Source* SourcePositions::find(uint32_t offset, size_t& lineIndex) const {
+    auto it = std::upper_bound(sources.begin(), sources.end(), offset,
+                               [](uint32_t value, const Source& source) { return value < source.begin; });
+    if (it == sources.begin()) {
+        return nullptr;
+    }
+    const Source& source = *--it;
+    auto first = lineStarts.begin() + source.firstStart;
+    auto lineStart = std::upper_bound(first, first + source.startCount, offset - source.begin);
+    lineIndex = static_cast<size_t>(lineStart - first) - 1;
+    return &source;
+}
+
+int SourcePositions::line(uint32_t offset) {
+    size_t lineIndex = 0;
+    const Source* source = instance().find(offset, lineIndex);
+    return source ? source->firstLine + static_cast<int>(lineIndex) : 0;
+}
+
+int SourcePositions::column(uint32_t offset) {
+    size_t lineIndex = 0;
+    const Source* source = instance().find(offset, lineIndex);
+    if (!source) {
+        return 0;
+    }
+    const SourcePositions& positions = instance();
+    return static_cast<int>(offset - source->begin - positions.lineStarts[source->firstStart + lineIndex]) + 1;
+}
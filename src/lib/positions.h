@@ -0,0 +1,42 @@
+#ifndef POSITIONS_H
+#define POSITIONS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Process-wide record of where the lines of every lexed source start. A
+token keeps only the offset of its first character; its line and column are
+worked out here when a diagnostic prints them. Each source owns the offsets
+from its first character to one past its last, so the end of input token of
+one source never lands in the next one.*/
+class SourcePositions {
+public:
+    // Claims the offsets of a source of the given length and returns the first
+    static uint32_t reserve(size_t length);
+    // Records a reserved source: the number of its first line and where its lines start, relative to it
+    static void addSource(uint32_t begin, int firstLine, std::vector<uint32_t> lineStarts);
+    // Forgets the sources that begin before an offset, once no token of theirs will be reported
+    static void release(uint32_t before);
+
+    static int line(uint32_t offset);
+    static int column(uint32_t offset);
+
+private:
+    struct Source {
+        uint32_t begin;
+        int firstLine;
+        uint32_t firstStart;                // range of the source's line starts in lineStarts
+        uint32_t startCount;
+    };
+
+    static SourcePositions& instance();
+    // The source holding an offset and the index of the line it is on
+    const Source* find(uint32_t offset, size_t& lineIndex) const;
+
+    uint32_t next = 0;
+    std::vector<Source> sources;            // ordered by begin
+    std::vector<uint32_t> lineStarts;       // relative to their source, the first line starts at 0
+};
+
+#endif // POSITIONS_H
@@ -0,0 +1,235 @@
+#include "purity.h"
+#include "typeInference.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Collects the names a statement binds, without entering function bodies
+static void collectBindings(const ASTNode* node, std::unordered_map<std::string, int>& bindings) {
+    if (!node) {
+        return;
+    }
+    switch (node->getType()) {
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<const AssignmentNode*>(node);
+            if (assignmentNode->lhs->getType() == ASTNode::Type::VariableNode) {
+                ++bindings[static_cast<const VariableNode*>(assignmentNode->lhs.get())->identifier.text()];
+            }
+            collectBindings(assignmentNode->rhs.get(), bindings);
+            break;
+        }
+        case ASTNode::Type::FunctionNode:
+            ++bindings[static_cast<const FunctionNode*>(node)->name.text()];
+            break;
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<const IfNode*>(node);
+            collectBindings(ifNode->condition.get(), bindings);
+            collectBindings(ifNode->trueBranch.get(), bindings);
+            collectBindings(ifNode->falseBranch.get(), bindings);
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<const WhileNode*>(node);
+            collectBindings(whileNode->condition.get(), bindings);
+            collectBindings(whileNode->body.get(), bindings);
+            break;
+        }
+        case ASTNode::Type::BlockNode:
+            for (const auto& stmt : static_cast<const BlockNode*>(node)->statements) {
+                collectBindings(stmt.get(), bindings);
+            }
+            break;
+        case ASTNode::Type::PrintNode:
+            collectBindings(static_cast<const PrintNode*>(node)->expression.get(), bindings);
+            break;
+        case ASTNode::Type::ReturnNode:
+            collectBindings(static_cast<const ReturnNode*>(node)->value.get(), bindings);
+            break;
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            collectBindings(binaryOpNode->left.get(), bindings);
+            collectBindings(binaryOpNode->right.get(), bindings);
+            break;
+        }
+        case ASTNode::Type::CallNode: {
+            auto callNode = static_cast<const CallNode*>(node);
+            collectBindings(callNode->callee.get(), bindings);
+            for (const auto& arg : callNode->arguments) {
+                collectBindings(arg.get(), bindings);
+            }
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (const auto& element : static_cast<const ArrayLiteralNode*>(node)->elements) {
+                collectBindings(element.get(), bindings);
+            }
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            collectBindings(lookupNode->array.get(), bindings);
+            collectBindings(lookupNode->index.get(), bindings);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// What a function body does that matters to its purity
+struct BodyScan {
+    const FunctionNode* function;
+    std::unordered_set<std::string> locals;       // parameters and assigned names
+    TypeInference types;
+    std::vector<std::string> callees;             // functions it calls by their global name
+};
+
+/* Checks a function body statement by statement. Variable reads must find a
+parameter or a local the body has certainly assigned, anything else would
+reach the globals.*/
+static bool isPureBody(const ASTNode* node, BodyScan& scan) {
+    if (!node) {
+        return true;
+    }
+    switch (node->getType()) {
+        case ASTNode::Type::NumberNode:
+        case ASTNode::Type::BooleanNode:
+        case ASTNode::Type::NullNode:
+            return true;
+        case ASTNode::Type::VariableNode: {
+            auto variable = static_cast<const VariableNode*>(node);
+            for (const auto& param : scan.function->parameters) {
+                if (param.text() == variable->identifier.text()) {
+                    return true;
+                }
+            }
+            return scan.types.typeOf(variable) != StaticType::Unknown;
+        }
+        case ASTNode::Type::BinaryOpNode: {
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            return isPureBody(binaryOpNode->left.get(), scan) && isPureBody(binaryOpNode->right.get(), scan);
+        }
+        case ASTNode::Type::AssignmentNode: {
+            // Assignments inside a function only ever bind its own locals
+            auto assignmentNode = static_cast<const AssignmentNode*>(node);
+            return assignmentNode->lhs->getType() == ASTNode::Type::VariableNode &&
+                   isPureBody(assignmentNode->rhs.get(), scan);
+        }
+        case ASTNode::Type::CallNode: {
+            auto callNode = static_cast<const CallNode*>(node);
+            for (const auto& arg : callNode->arguments) {
+                if (!isPureBody(arg.get(), scan)) {
+                    return false;
+                }
+            }
+            if (callNode->callee->getType() != ASTNode::Type::VariableNode) {
+                return false;
+            }
+            const std::string& callee = static_cast<const VariableNode*>(callNode->callee.get())->identifier.text();
+            if (callee == "push" || callee == "pop" || scan.locals.count(callee)) {
+                return false;
+            }
+            if (callee != "len" && callee != scan.function->name.text()) {
+                scan.callees.push_back(callee);
+            }
+            return true;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (const auto& element : static_cast<const ArrayLiteralNode*>(node)->elements) {
+                if (!isPureBody(element.get(), scan)) {
+                    return false;
+                }
+            }
+            return true;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            return isPureBody(lookupNode->array.get(), scan) && isPureBody(lookupNode->index.get(), scan);
+        }
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<const IfNode*>(node);
+            return isPureBody(ifNode->condition.get(), scan) && isPureBody(ifNode->trueBranch.get(), scan) &&
+                   isPureBody(ifNode->falseBranch.get(), scan);
+        }
+        case ASTNode::Type::WhileNode: {
+            auto whileNode = static_cast<const WhileNode*>(node);
+            return isPureBody(whileNode->condition.get(), scan) && isPureBody(whileNode->body.get(), scan);
+        }
+        case ASTNode::Type::BlockNode:
+            for (const auto& stmt : static_cast<const BlockNode*>(node)->statements) {
+                if (!isPureBody(stmt.get(), scan)) {
+                    return false;
+                }
+            }
+            return true;
+        case ASTNode::Type::ReturnNode:
+            return isPureBody(static_cast<const ReturnNode*>(node)->value.get(), scan);
+        default:
+            // Prints, nested functions and indexed assignments
+            return false;
+    }
+}
+
+std::unordered_set<const FunctionNode*> findPureFunctions(const ASTNode* program) {
+    std::unordered_set<const FunctionNode*> pure;
+    if (!program || program->getType() != ASTNode::Type::BlockNode) {
+        return pure;
+    }
+    const auto& statements = static_cast<const BlockNode*>(program)->statements;
+
+    std::unordered_map<std::string, int> bindings;
+    for (const auto& statement : statements) {
+        collectBindings(statement.get(), bindings);
+    }
+
+    std::vector<BodyScan> scans;
+    scans.reserve(statements.size());
+    for (const auto& statement : statements) {
+        if (statement->getType() != ASTNode::Type::FunctionNode) {
+            continue;
+        }
+        auto functionNode = static_cast<const FunctionNode*>(statement.get());
+        const std::string& name = functionNode->name.text();
+        if (bindings[name] != 1 || name == "len" || name == "pop" || name == "push" || !functionNode->body) {
+            continue;
+        }
+        scans.push_back(BodyScan{functionNode, {}, {}, {}});
+        BodyScan& scan = scans.back();
+        for (const auto& param : functionNode->parameters) {
+            scan.locals.insert(param.text());
+        }
+        std::unordered_map<std::string, int> assigned;
+        collectBindings(functionNode->body.get(), assigned);
+        for (const auto& entry : assigned) {
+            scan.locals.insert(entry.first);
+        }
+        scan.types.analyze(functionNode->body.get());
+        if (isPureBody(functionNode->body.get(), scan)) {
+            pure.insert(functionNode);
+        } else {
+            scans.pop_back();
+        }
+    }
+
+    // Drops functions calling anything not (or no longer) known to be pure until none is left
+    std::unordered_map<std::string, const FunctionNode*> byName;
+    for (const auto& scan : scans) {
+        byName[scan.function->name.text()] = scan.function;
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const auto& scan : scans) {
+            if (!pure.count(scan.function)) {
+                continue;
+            }
+            for (const auto& callee : scan.callees) {
+                auto it = byName.find(callee);
+                if (it == byName.end() || !pure.count(it->second)) {
+                    pure.erase(scan.function);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+    return pure;
+}
@@ -0,0 +1,14 @@
+#ifndef PURITY_H
+#define PURITY_H
+
+#include "ASTNodes.h"
+#include <unordered_set>
+
+/* Finds the top level functions whose result depends only on their arguments:
+they do not print, define functions, change arrays or read variables other
+than their parameters and locals, and only call len, themselves or other pure
+functions. Only functions whose name the script binds once qualify, so a call
+by that name always reaches the same function.*/
+std::unordered_set<const FunctionNode*> findPureFunctions(const ASTNode* program);
+
+#endif // PURITY_H
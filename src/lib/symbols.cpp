@@ -0,0 +1,116 @@
+#include "symbols.h"
+#include <charconv>
+
+SymbolTable& SymbolTable::instance() {
+    static SymbolTable table;
+    return table;
+}
+
+SymbolId SymbolTable::intern(std::string_view name) {
+    SymbolTable& table = instance();
+    auto it = table.ids.find(name);
+    if (it != table.ids.end()) {
+        return it->second;
+    }
+    SymbolId symbol = static_cast<SymbolId>(table.names.size());
+    table.names.emplace_back(name);
+    table.ids.emplace(table.names.back(), symbol);
+    table.numbers.emplace_back();
+    return symbol;
+}
+
+SymbolId SymbolTable::internNumber(std::string_view text) {
+    SymbolTable& table = instance();
+    auto it = table.literalIds.find(text);
+    if (it != table.literalIds.end() && (it->second & ~LITERAL) >= table.releasedLiteral) {
+        return it->second;
+    }
+    return internNumber(text, parseNumber(text));
+}
+
+/* A literal still interned from before the last releaseNumbers is not reused,
+it goes at the next one while the new token may still need it. Its entry in
+literalIds is keyed by a view of the old text, so it is replaced by one keyed
+by the new text before the old text goes.*/
+SymbolId SymbolTable::internNumber(std::string_view text, double value) {
+    SymbolTable& table = instance();
+    auto it = table.literalIds.find(text);
+    if (it != table.literalIds.end() && (it->second & ~LITERAL) >= table.releasedLiteral) {
+        table.literals[(it->second & ~LITERAL) - table.firstLiteral].value = value;
+        return it->second;
+    }
+    if (it != table.literalIds.end()) {
+        table.literalIds.erase(it);
+    }
+    SymbolId symbol = (table.firstLiteral + static_cast<SymbolId>(table.literals.size())) | LITERAL;
+    table.literals.push_back({std::string(text), value});
+    table.literalIds.emplace(table.literals.back().text, symbol);
+    return symbol;
+}
+
+void SymbolTable::releaseNumbers() {
+    SymbolTable& table = instance();
+    for (; table.firstLiteral < table.releasedLiteral; ++table.firstLiteral) {
+        auto it = table.literalIds.find(table.literals.front().text);
+        if (it != table.literalIds.end() && it->second == (table.firstLiteral | LITERAL)) {
+            table.literalIds.erase(it);
+        }
+        table.literals.pop_front();
+    }
+    table.releasedLiteral = table.firstLiteral + static_cast<SymbolId>(table.literals.size());
+}
+
+double SymbolTable::number(SymbolId symbol) {
+    if (symbol & LITERAL) {
+        return instance().literal(symbol).value;
+    }
+    std::optional<double>& value = instance().numbers[symbol];
+    if (!value) {
+        value = parseNumber(name(symbol));
+    }
+    return *value;
+}
+
+/* Literals of the form digits[.digits] with at most 19 significant digits
+take Clinger's fast path: when the digits are at most 2^53 and the scale at
+most 10^22 both are exact doubles, so one division rounds correctly. Other
+text (long literals, and the exponents, signs and infinities of folded
+constants) goes to std::from_chars, which is exact as well.*/
+double parseNumber(std::string_view text) {
+    static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    uint64_t digits = 0;
+    int significant = 0;
+    int scale = 0;
+    bool fraction = false;
+    bool plain = !text.empty();
+    for (char c : text) {
+        if (c >= '0' && c <= '9') {
+            digits = digits * 10 + static_cast<uint64_t>(c - '0');
+            significant += digits != 0;
+            scale += fraction;
+            if (significant > 19) {
+                plain = false;
+                break;
+            }
+        } else if (c == '.' && !fraction) {
+            fraction = true;
+        } else {
+            plain = false;
+            break;
+        }
+    }
+    if (plain && digits <= (uint64_t(1) << 53) && scale <= 22) {
+        return static_cast<double>(digits) / powers[scale];
+    }
+    double value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
+
+const std::string& SymbolTable::name(SymbolId symbol) {
+    if (symbol & LITERAL) {
+        return instance().literal(symbol).text;
+    }
+    return instance().names[symbol];
+}
@@ -0,0 +1,177 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using SymbolId = uint32_t;
+
+// Never handed out by the SymbolTable, marks free SymbolMap slots
+const SymbolId NO_SYMBOL = UINT32_MAX;
+
+// The value of a number literal, 0 if the text is not a number. Exact and independent of the locale.
+double parseNumber(std::string_view text);
+
+/* Process-wide table of interned token text. The lexer interns the text of
+every token it reads, so tokens, AST nodes and scopes refer to a name by a
+32-bit ID and comparing two names is an integer compare. IDs are handed out
+densely from 0 and stay valid for the lifetime of the process.
+
+Number literals are kept apart, under IDs with the top bit set, so a streamed
+script can let go of them: nothing refers to a literal once the statement it
+appears in has been compiled, while names stay bound in scopes.*/
+class SymbolTable {
+public:
+    static SymbolId intern(std::string_view name);
+    // Interns the text of a number literal, reading its value the first time the text is seen
+    static SymbolId internNumber(std::string_view text);
+    // Interns the text of a number literal whose value has already been read
+    static SymbolId internNumber(std::string_view text, double value);
+    static const std::string& name(SymbolId symbol);
+    // The value of a number literal's symbol, parsed from its text on first use if it was interned as plain text
+    static double number(SymbolId symbol);
+    /* Forgets the number literals interned before the previous call. Called
+    between the statements of a stream, it keeps the literals of the statement
+    just run, which may include the token the parser looked ahead to, and drops
+    those of the one before. A literal seen again is interned anew.*/
+    static void releaseNumbers();
+
+private:
+    static const SymbolId LITERAL = 0x80000000u;   // marks the IDs of number literals
+
+    struct Literal {
+        std::string text;
+        double value;
+    };
+
+    static SymbolTable& instance();
+    const Literal& literal(SymbolId symbol) const { return literals[(symbol & ~LITERAL) - firstLiteral]; }
+
+    std::deque<std::string> names;      // a deque keeps the views in ids valid as it grows
+    std::unordered_map<std::string_view, SymbolId> ids;
+    std::vector<std::optional<double>> numbers;
+    std::deque<Literal> literals;       // the literals from firstLiteral on
+    std::unordered_map<std::string_view, SymbolId> literalIds;
+    SymbolId firstLiteral = 0;
+    SymbolId releasedLiteral = 0;       // literals before this one go at the next releaseNumbers
+};
+
+/* Open addressing hash map from symbols to values. Slots live in one array
+whose size is a power of two, keys are spread by a Fibonacci hash and
+collisions probe linearly; erasing shifts the following entries of the probe
+run back, so there are no tombstones. Inserting and erasing may move entries,
+which invalidates pointers to values.*/
+template <typename T>
+class SymbolMap {
+public:
+    T* find(SymbolId key) {
+        return const_cast<T*>(static_cast<const SymbolMap*>(this)->find(key));
+    }
+
+    const T* find(SymbolId key) const {
+        if (count == 0) {
+            return nullptr;
+        }
+        for (size_t i = slotOf(key);; i = (i + 1) & mask()) {
+            if (entries[i].key == key) {
+                return &entries[i].value;
+            }
+            if (entries[i].key == NO_SYMBOL) {
+                return nullptr;
+            }
+        }
+    }
+
+    // Inserts the key unless it is present; returns its value and whether it was inserted
+    std::pair<T*, bool> emplace(SymbolId key, const T& value) {
+        if (T* existing = find(key)) {
+            return {existing, false};
+        }
+        if ((count + 1) * 3 > entries.size() * 2) {
+            grow();
+        }
+        size_t i = slotOf(key);
+        while (entries[i].key != NO_SYMBOL) {
+            i = (i + 1) & mask();
+        }
+        entries[i].key = key;
+        entries[i].value = value;
+        ++count;
+        return {&entries[i].value, true};
+    }
+
+    bool erase(SymbolId key) {
+        if (count == 0) {
+            return false;
+        }
+        size_t hole = slotOf(key);
+        while (entries[hole].key != key) {
+            if (entries[hole].key == NO_SYMBOL) {
+                return false;
+            }
+            hole = (hole + 1) & mask();
+        }
+        // Pull back every later entry of the run that may live in the hole
+        for (size_t i = (hole + 1) & mask(); entries[i].key != NO_SYMBOL; i = (i + 1) & mask()) {
+            size_t home = slotOf(entries[i].key);
+            if (((i - home) & mask()) >= ((i - hole) & mask())) {
+                entries[hole] = std::move(entries[i]);
+                hole = i;
+            }
+        }
+        entries[hole].key = NO_SYMBOL;
+        entries[hole].value = T();
+        --count;
+        return true;
+    }
+
+    size_t size() const { return count; }
+
+    template <typename Function>
+    void forEach(Function function) const {
+        for (const auto& entry : entries) {
+            if (entry.key != NO_SYMBOL) {
+                function(entry.key, entry.value);
+            }
+        }
+    }
+
+private:
+    struct Entry {
+        SymbolId key = NO_SYMBOL;
+        T value;
+    };
+
+    size_t mask() const { return entries.size() - 1; }
+
+    size_t slotOf(SymbolId key) const {
+        return static_cast<uint32_t>(key * 2654435769u) >> (32 - bits);
+    }
+
+    void grow() {
+        std::vector<Entry> old(entries.size() ? entries.size() * 2 : 8);
+        old.swap(entries);
+        bits = bits ? bits + 1 : 3;
+        for (auto& entry : old) {
+            if (entry.key != NO_SYMBOL) {
+                size_t i = slotOf(entry.key);
+                while (entries[i].key != NO_SYMBOL) {
+                    i = (i + 1) & mask();
+                }
+                entries[i] = std::move(entry);
+            }
+        }
+    }
+
+    std::vector<Entry> entries;
+    size_t count = 0;
+    unsigned bits = 0;
+};
+
+#endif // SYMBOLS_H
@@ -0,0 +1,220 @@
+#include "typeInference.h"
+
+void TypeInference::analyze(const ASTNode* body) {
+    State state;
+    analyzeStatement(body, state);
+}
+
+/* Analyzes a function body. A variable the body assigns but may read before
+it is bound lives in the function's environment and keeps its value from one
+call to the next; any call may re-enter the function and rebind it, so past a
+call it is only known to be bound.*/
+void TypeInference::analyzeFunction(const FunctionNode* function) {
+    analyze(function->body.get());
+    for (const auto& identifier : unbound) {
+        if (assigned.count(identifier)) {
+            persistent.insert(identifier);
+        }
+    }
+    for (const auto& param : function->parameters) {
+        persistent.erase(param.text());
+    }
+    if (!persistent.empty()) {
+        types.clear();
+        analyze(function->body.get());
+    }
+}
+
+StaticType TypeInference::typeOf(const ASTNode* node) const {
+    auto it = types.find(node);
+    return it != types.end() ? it->second : StaticType::Unknown;
+}
+
+// Whether a function body keeps the variable in its environment instead of a slot of each call
+bool TypeInference::isPersistent(const std::string& identifier) const {
+    return persistent.count(identifier) > 0;
+}
+
+// Expressions inside loops are visited once per pass, only what holds on every pass is kept
+void TypeInference::record(const ASTNode* node, StaticType type) {
+    auto inserted = types.emplace(node, type);
+    if (!inserted.second) {
+        inserted.first->second = join(inserted.first->second, type);
+    }
+}
+
+// What is known of a value that has one of two types
+StaticType TypeInference::join(StaticType left, StaticType right) {
+    if (left == right) {
+        return left;
+    }
+    if (left == StaticType::Unknown || right == StaticType::Unknown) {
+        return StaticType::Unknown;
+    }
+    return StaticType::Bound;
+}
+
+// Keeps the variables bound on both paths, with the type they have on both
+TypeInference::State TypeInference::merge(const State& left, const State& right) {
+    State merged;
+    for (const auto& entry : left) {
+        auto it = right.find(entry.first);
+        if (it != right.end()) {
+            merged.emplace(entry.first, join(entry.second, it->second));
+        }
+    }
+    return merged;
+}
+
+void TypeInference::analyzeStatement(const ASTNode* node, State& state) {
+    if (!node) {
+        return;
+    }
+    switch (node->getType()) {
+        case ASTNode::Type::BlockNode:
+            for (const auto& stmt : static_cast<const BlockNode*>(node)->statements) {
+                analyzeStatement(stmt.get(), state);
+            }
+            break;
+        case ASTNode::Type::IfNode: {
+            auto ifNode = static_cast<const IfNode*>(node);
+            analyzeExpression(ifNode->condition.get(), state);
+            State falseState = state;
+            analyzeStatement(ifNode->trueBranch.get(), state);
+            analyzeStatement(ifNode->falseBranch.get(), falseState);
+            state = merge(state, falseState);
+            break;
+        }
+        case ASTNode::Type::WhileNode: {
+            // The loop head sees the entry state and the state after every iteration
+            auto whileNode = static_cast<const WhileNode*>(node);
+            State entry = state;
+            State head = state;
+            while (true) {
+                State iteration = head;
+                analyzeExpression(whileNode->condition.get(), iteration);
+                State exit = iteration;
+                analyzeStatement(whileNode->body.get(), iteration);
+                State next = merge(entry, iteration);
+                if (next == head) {
+                    state = std::move(exit);
+                    break;
+                }
+                head = std::move(next);
+            }
+            break;
+        }
+        case ASTNode::Type::PrintNode:
+            analyzeExpression(static_cast<const PrintNode*>(node)->expression.get(), state);
+            break;
+        case ASTNode::Type::FunctionNode:
+            state[static_cast<const FunctionNode*>(node)->name.text()] = StaticType::Bound;
+            assigned.insert(static_cast<const FunctionNode*>(node)->name.text());
+            break;
+        case ASTNode::Type::ReturnNode:
+            analyzeExpression(static_cast<const ReturnNode*>(node)->value.get(), state);
+            break;
+        case ASTNode::Type::AssignmentNode:
+        case ASTNode::Type::CallNode:
+            analyzeExpression(node, state);
+            break;
+        default:
+            break;
+    }
+}
+
+StaticType TypeInference::analyzeExpression(const ASTNode* node, State& state) {
+    if (!node) {
+        return StaticType::Unknown;
+    }
+    StaticType type = StaticType::Unknown;
+    switch (node->getType()) {
+        case ASTNode::Type::NumberNode:
+            type = StaticType::Number;
+            break;
+        case ASTNode::Type::BooleanNode:
+            type = StaticType::Bool;
+            break;
+        case ASTNode::Type::VariableNode: {
+            auto it = state.find(static_cast<const VariableNode*>(node)->identifier.text());
+            if (it != state.end()) {
+                type = it->second;
+            } else {
+                unbound.insert(static_cast<const VariableNode*>(node)->identifier.text());
+            }
+            break;
+        }
+        case ASTNode::Type::BinaryOpNode: {
+            // An operator either produces its result type or raises an error
+            auto binaryOpNode = static_cast<const BinaryOpNode*>(node);
+            analyzeExpression(binaryOpNode->left.get(), state);
+            analyzeExpression(binaryOpNode->right.get(), state);
+            switch (binaryOpNode->op.type) {
+                case TokenType::ADD: case TokenType::SUBTRACT: case TokenType::MULTIPLY:
+                case TokenType::DIVIDE: case TokenType::MODULO:
+                    type = StaticType::Number;
+                    break;
+                case TokenType::LESS: case TokenType::LESS_EQUAL:
+                case TokenType::GREATER: case TokenType::GREATER_EQUAL:
+                case TokenType::EQUAL: case TokenType::NOT_EQUAL:
+                case TokenType::LOGICAL_AND: case TokenType::LOGICAL_XOR: case TokenType::LOGICAL_OR:
+                    type = StaticType::Bool;
+                    break;
+                default:
+                    break;
+            }
+            break;
+        }
+        case ASTNode::Type::AssignmentNode: {
+            auto assignmentNode = static_cast<const AssignmentNode*>(node);
+            type = analyzeExpression(assignmentNode->rhs.get(), state);
+            if (assignmentNode->lhs->getType() == ASTNode::Type::VariableNode) {
+                const std::string& identifier = static_cast<const VariableNode*>(assignmentNode->lhs.get())->identifier.text();
+                state[identifier] = type == StaticType::Unknown ? StaticType::Bound : type;
+                assigned.insert(identifier);
+            } else if (assignmentNode->lhs->getType() == ASTNode::Type::ArrayLookupNode) {
+                auto lookupNode = static_cast<const ArrayLookupNode*>(assignmentNode->lhs.get());
+                analyzeExpression(lookupNode->index.get(), state);
+                analyzeExpression(lookupNode->array.get(), state);
+            }
+            break;
+        }
+        case ASTNode::Type::CallNode: {
+            // Calls only rebind the caller's variables that live in its environment
+            auto callNode = static_cast<const CallNode*>(node);
+            for (const auto& arg : callNode->arguments) {
+                analyzeExpression(arg.get(), state);
+            }
+            analyzeExpression(callNode->callee.get(), state);
+            // len is bound to the builtin by name and returns a number whenever it returns
+            if (callNode->callee->getType() == ASTNode::Type::VariableNode &&
+                static_cast<const VariableNode*>(callNode->callee.get())->identifier.text() == "len") {
+                type = StaticType::Number;
+            } else {
+                for (const auto& identifier : persistent) {
+                    auto it = state.find(identifier);
+                    if (it != state.end()) {
+                        it->second = StaticType::Bound;
+                    }
+                }
+            }
+            break;
+        }
+        case ASTNode::Type::ArrayLiteralNode:
+            for (const auto& element : static_cast<const ArrayLiteralNode*>(node)->elements) {
+                analyzeExpression(element.get(), state);
+            }
+            type = StaticType::Array;
+            break;
+        case ASTNode::Type::ArrayLookupNode: {
+            auto lookupNode = static_cast<const ArrayLookupNode*>(node);
+            analyzeExpression(lookupNode->array.get(), state);
+            analyzeExpression(lookupNode->index.get(), state);
+            break;
+        }
+        default:
+            break;
+    }
+    record(node, type);
+    return type;
+}
@@ -0,0 +1,40 @@
+#ifndef TYPE_INFERENCE_H
+#define TYPE_INFERENCE_H
+
+#include "ASTNodes.h"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+/* What the compiler can prove about the value of an expression. Bound only
+says a variable read is certain to find a value, of no particular type.*/
+enum class StaticType { Unknown, Number, Bool, Array, Bound };
+
+/* Flow-sensitive type inference over one function body (or the script's top
+level block). Variables assigned a number, bool or array keep that type until the
+next assignment; if branches are merged and while loops are iterated to a fixed
+point, so a type is only reported when it holds on every path to the
+expression. Nested function bodies are analyzed separately.*/
+class TypeInference {
+public:
+    void analyze(const ASTNode* body);
+    void analyzeFunction(const FunctionNode* function);
+    StaticType typeOf(const ASTNode* node) const;
+    bool isPersistent(const std::string& identifier) const;
+
+private:
+    using State = std::unordered_map<std::string, StaticType>;
+
+    void analyzeStatement(const ASTNode* node, State& state);
+    StaticType analyzeExpression(const ASTNode* node, State& state);
+    void record(const ASTNode* node, StaticType type);
+    static StaticType join(StaticType left, StaticType right);
+    static State merge(const State& left, const State& right);
+
+    std::unordered_map<const ASTNode*, StaticType> types;
+    std::unordered_set<std::string> assigned;
+    std::unordered_set<std::string> unbound;       // variables read where they may not be bound yet
+    std::unordered_set<std::string> persistent;
+};
+
+#endif // TYPE_INFERENCE_H
@@ -55,6 +55,7 @@ void Value::cleanUp() {
         switch (type) {
             case Type::Double:
             case Type::Bool:
+            case Type::BuiltinFunction:
                 break;
             case Type::Function:
                 functionValue.~Function();
@@ -62,10 +63,8 @@ void Value::cleanUp() {
             case Type::Array:
                 arrayValue.reset();
                 break;
-            case Type::BuiltinFunction:
-                builtinFunction.~FunctionPtr();
-                break;
             case Type::Null:
+            case Type::Undefined:
                 break;
         }
         type = Type::Null;
@@ -91,9 +90,10 @@ void Value::copyFrom(const Value& other) {
             new (&arrayValue) std::shared_ptr<std::vector<Value>>(other.arrayValue);
             break;
         case Type::Null:
+        case Type::Undefined:
             break;
         case Type::BuiltinFunction:
-            new (&builtinFunction) FunctionPtr(other.builtinFunction);
+            builtinFunction = other.builtinFunction;
             break;
     }
 }
@@ -136,9 +136,10 @@ void Value::moveFrom(Value&& other) {
             new (&arrayValue) std::shared_ptr<std::vector<Value>>(std::move(other.arrayValue));
             break;
         case Type::Null:
+        case Type::Undefined:
             break;
         case Type::BuiltinFunction:
-            new (&builtinFunction) FunctionPtr(std::move(other.builtinFunction));
+            builtinFunction = other.builtinFunction;
             break;
     }
     other.type = Type::Null;
@@ -195,7 +196,7 @@ bool Value::equals(const Value& other) const {
             return true;
         }
         case Type::BuiltinFunction:
-            return this->builtinFunction.target<Value::FunctionPtr>() == other.builtinFunction.target<Value::FunctionPtr>();
+            return this->builtinFunction == other.builtinFunction;
         default:
             throw std::runtime_error("Unsupported type in Value::equals");
     }
@@ -206,6 +207,17 @@ bool Value::isNull() const {
     return type == Type::Null;
 }
 
+// Marker for a local variable slot that has not been assigned yet
+Value Value::undefined() {
+    Value value;
+    value.type = Type::Undefined;
+    return value;
+}
+
+bool Value::isUndefined() const {
+    return type == Type::Undefined;
+}
+
 bool Value::isArray() const {
     return type == Type::Array;
 }
@@ -233,27 +245,49 @@ const std::vector<Value>& Value::asArray() const {
     return *arrayValue;
 }
 
-void Scope::setVariable(const std::string& name, const Value& value) {
+uint64_t Scope::shapeVersion = 0;
+
+Scope::~Scope() {
+    ++shapeVersion;
+}
+
+void Scope::setVariable(SymbolId name, const Value& value) {
     if (parentScope && parentScope->hasVariable(name)) {
         parentScope->setVariable(name, value);
     } else {
-        variables[name] = value;
+        defineVariable(name, value);
+    }
+}
+
+// Binds a variable in this scope only, shadowing any parent binding
+void Scope::defineVariable(SymbolId name, const Value& value) {
+    auto result = variables.emplace(name, value);
+    if (result.second) {
+        ++shapeVersion;
+    } else {
+        *result.first = value;
+    }
+}
+
+// Removes a binding from this scope only
+void Scope::eraseVariable(SymbolId name) {
+    if (variables.erase(name)) {
+        ++shapeVersion;
     }
 }
 
 // Get a variable from this scope or parent scopes
-Value* Scope::getVariable(const std::string& name) {
-    auto it = variables.find(name);
-    if (it != variables.end()) {
-        return &it->second;
+Value* Scope::getVariable(SymbolId name) {
+    if (Value* value = variables.find(name)) {
+        return value;
     } else if (parentScope) {
         return parentScope->getVariable(name);
     }
     return nullptr; 
 }
 
-bool Scope::hasVariable(const std::string& name) {
-    if (variables.count(name) > 0) {
+bool Scope::hasVariable(SymbolId name) {
+    if (variables.find(name)) {
         return true;
     } else if (parentScope) {
         return parentScope->hasVariable(name);
@@ -261,7 +295,7 @@ bool Scope::hasVariable(const std::string& name) {
     return false;
 }
 
-const std::unordered_map<std::string, Value>& Scope::getVariables() const{
+const SymbolMap<Value>& Scope::getVariables() const{
         return variables;
     }
 
@@ -269,19 +303,13 @@ std::shared_ptr<Scope> Scope::getParent() const { return parentScope; }
 
 std::shared_ptr<Scope> Scope::copyScope() const {
     auto newScope = std::make_shared<Scope>(parentScope);
-    for (const auto& var : variables) {
-        newScope->variables[var.first] = var.second;
-    }
+    newScope->variables = variables;
     return newScope;
 }
 
 std::shared_ptr<Scope> Scope::deepCopy() const {
     auto copiedScope = std::make_shared<Scope>(nullptr);
-    for (const auto& variable : this->variables) {
-        const std::string& name = variable.first;
-        const Value& value = variable.second;
-        copiedScope->variables[name] = value;
-    }
+    copiedScope->variables = this->variables;
 
     if (this->parentScope) {
         copiedScope->parentScope = this->parentScope->deepCopy();
@@ -289,10 +317,3 @@ std::shared_ptr<Scope> Scope::deepCopy() const {
 
     return copiedScope;
 }
-
-// ReturnException implementations
-ReturnException::ReturnException(Value returnValue) : returnValue(std::move(returnValue)) {}
-
-const Value& ReturnException::getValue() const {
-    return returnValue;
-}
\ No newline at end of file
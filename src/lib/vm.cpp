@@ -0,0 +1,764 @@
+#include "vm.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+VM::VM(std::ostream& os)
+        : os(os), globals(std::make_shared<Scope>()), maxCallDepth(DEFAULT_MAX_CALL_DEPTH),
+          memoization(false), memoLimit(DEFAULT_MEMO_LIMIT), jitThreshold(Jit::DEFAULT_THRESHOLD) {}
+
+// Registers a builtin both as a global value and as a direct call target
+void VM::defineBuiltin(const std::string& name, Value::FunctionPtr function) {
+    builtinNames.push_back(name);
+    builtins.push_back(function);
+    globals->setVariable(SymbolTable::intern(name), Value(function));
+}
+
+const std::vector<std::string>& VM::getBuiltinNames() const {
+    return builtinNames;
+}
+
+void VM::setMaxCallDepth(size_t depth) {
+    maxCallDepth = depth;
+}
+
+// Caches the results of calls to functions the compiler proved pure
+void VM::setMemoization(bool enabled, size_t limit) {
+    memoization = enabled && limit > 0;
+    memoLimit = limit;
+}
+
+// Compiles functions to machine code once they were called threshold times
+void VM::setJit(bool enabled, uint32_t threshold) {
+    jit.reset(enabled && Jit::isSupported() ? new Jit() : nullptr);
+    jitThreshold = std::max<uint32_t>(threshold, 1);
+}
+
+// Runs a compiled script in the global scope
+void VM::run(const std::shared_ptr<Prototype>& program) {
+    frames.clear();
+    stack.clear();
+    memos.clear();
+    pendingMemos.clear();
+    ensureStack(program->maxStack + 1);
+    frames.push_back({program.get(), program->code.data(), 0, globals.get()});
+    execute();
+}
+
+/* Encodes the arguments of a call as a cache key. Only numbers, bools and null
+qualify: arrays can change after the call and functions have no value identity.
+Numbers are keyed on their bits so -0 and 0 stay apart.*/
+bool VM::memoKey(const Value* args, uint32_t argc, std::string& key) const {
+    key.clear();
+    for (uint32_t i = 0; i < argc; ++i) {
+        const Value& arg = args[i];
+        switch (arg.getType()) {
+            case Value::Type::Double: {
+                double number = arg.getDouble();
+                char bytes[sizeof(double)];
+                std::memcpy(bytes, &number, sizeof(double));
+                key += 'd';
+                key.append(bytes, sizeof(double));
+                break;
+            }
+            case Value::Type::Bool:
+                key += arg.getBool() ? 't' : 'f';
+                break;
+            case Value::Type::Null:
+                key += 'n';
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+// Stores a call result, evicting the least recently used one when the cache is full
+void VM::memoize(MemoCache& cache, std::string key, const Value& result) {
+    Value::Type type = result.getType();
+    if (type != Value::Type::Double && type != Value::Type::Bool && type != Value::Type::Null) {
+        return;
+    }
+    if (cache.index.count(key)) {
+        return;
+    }
+    if (cache.entries.size() >= memoLimit) {
+        cache.index.erase(cache.entries.back().first);
+        cache.entries.pop_back();
+    }
+    cache.entries.emplace_front(std::move(key), result);
+    cache.index[cache.entries.front().first] = cache.entries.begin();
+}
+
+/* Runs a call in machine code when its function is compiled or just became
+hot enough to be. Functions the JIT rejected stay counted past the threshold
+and are not tried again.*/
+bool VM::callNative(const Prototype& proto, const Value* args, uint32_t argc, Value& result) {
+    if (!proto.native) {
+        if (proto.calls >= jitThreshold || ++proto.calls < jitThreshold || !jit->compile(proto)) {
+            return false;
+        }
+    }
+    nativeArgs.resize(argc);
+    for (uint32_t i = 0; i < argc; ++i) {
+        if (!args[i].isDouble()) {
+            return false;
+        }
+        double number = args[i].getDouble();
+        std::memcpy(&nativeArgs[i], &number, sizeof(number));
+    }
+    return jit->run(proto, nativeArgs.data(), maxCallDepth - frames.size() - 1, result);
+}
+
+// Grows the value stack so that it holds at least size values
+void VM::ensureStack(size_t size) {
+    if (stack.size() < size) {
+        stack.resize(std::max(size, stack.size() * 2));
+    }
+}
+
+// Looks a variable up by name in the scope a frame closes over
+Value* VM::lookup(const CallFrame& frame, uint32_t name) {
+    Value* valuePtr = frame.scope->getVariable(frame.proto->names[name]);
+    if (!valuePtr) {
+        throw std::runtime_error("Runtime error: unknown identifier " + SymbolTable::name(frame.proto->names[name]));
+    }
+    return valuePtr;
+}
+
+/* Nested functions close over a copy of the locals that are assigned at the
+point of their definition, chained to the scope of the enclosing function.*/
+std::shared_ptr<Scope> VM::captureLocals(const CallFrame& frame) {
+    const Value& self = stack[frame.base + frame.proto->parameters.size()];
+    auto captured = std::make_shared<Scope>(self.asFunction().capturedScope);
+    for (size_t i = 0; i < frame.proto->locals.size(); ++i) {
+        const Value& local = stack[frame.base + i];
+        if (!local.isUndefined()) {
+            captured->defineVariable(frame.proto->locals[i], local);
+        }
+    }
+    return captured;
+}
+
+// Checks that a call can go ahead and returns the prototype it runs, compiled if it was deferred
+const Prototype* VM::checkCall(const Value& callee, uint32_t argc) {
+    if (callee.getType() != Value::Type::Function) {
+        throw std::runtime_error("Runtime error: not a function.");
+    }
+    const Prototype* proto = callee.asFunction().definition.get();
+    if (proto->parameters.size() != argc) {
+        throw std::runtime_error("Runtime error: incorrect argument count.");
+    }
+    if (proto->compileBody) {
+        std::function<void()> compileBody = std::move(proto->compileBody);
+        proto->compileBody = nullptr;
+        compileBody();
+    }
+    return proto;
+}
+
+/* Sets up the activation record of a frame whose arguments and closure are
+already in place, and returns the stack pointer for its first operand.*/
+Value* VM::enterFrame(const CallFrame& frame, uint32_t argc) {
+    size_t top = frame.base + frame.proto->locals.size();
+    ensureStack(top + frame.proto->maxStack);
+
+    Value* sp = stack.data() + frame.base + argc + 1;
+    while (sp < stack.data() + top) {
+        *sp++ = Value::undefined();
+    }
+    return sp;
+}
+
+// Generic semantics of the arithmetic, comparison and equality operators
+static Value binaryOperation(OpCode op, const Value& left, const Value& right) {
+    switch (op) {
+        case OpCode::ADD:
+            return Value(left.asDouble() + right.asDouble());
+        case OpCode::SUBTRACT:
+            return Value(left.asDouble() - right.asDouble());
+        case OpCode::MULTIPLY:
+            return Value(left.asDouble() * right.asDouble());
+        case OpCode::DIVIDE:
+            if (right.asDouble() == 0) {
+                throw std::runtime_error("Division by zero.");
+            }
+            return Value(left.asDouble() / right.asDouble());
+        case OpCode::MODULO:
+            if (right.asDouble() == 0) {
+                throw std::runtime_error("Modulo by zero.");
+            }
+            return Value(fmod(left.asDouble(), right.asDouble()));
+        case OpCode::LESS:
+            return Value(left.asDouble() < right.asDouble());
+        case OpCode::LESS_EQUAL:
+            return Value(left.asDouble() <= right.asDouble());
+        case OpCode::GREATER:
+            return Value(left.asDouble() > right.asDouble());
+        case OpCode::GREATER_EQUAL:
+            return Value(left.asDouble() >= right.asDouble());
+        case OpCode::EQUAL:
+            return Value(left.equals(right));
+        default:
+            return Value(!left.equals(right));
+    }
+}
+
+// Checks an index operand and converts it to a position in the array
+static size_t arrayIndex(const Value& indexValue, const Value& arrayValue) {
+    if (indexValue.getType() != Value::Type::Double) {
+        throw std::runtime_error("Runtime error: index is not a number.");
+    }
+    double intPart;
+    if (modf(indexValue.asDouble(), &intPart) != 0.0) {
+        throw std::runtime_error("Runtime error: index is not an integer.");
+    }
+    int index = static_cast<int>(intPart);
+    if (index < 0 || index >= static_cast<int>(arrayValue.asArray().size())) {
+        throw std::runtime_error("Runtime error: index out of bounds.");
+    }
+    return static_cast<size_t>(index);
+}
+
+// Fused operand of a superinstruction, or nullptr when it is not a double that is at hand
+static const Value* fusedOperand(const Instruction& in, OpCode op, const CallFrame& frame, const Value* locals) {
+    const Value* value;
+    switch (op) {
+        case OpCode::CONSTANT:
+            value = &frame.proto->constants[in.a];
+            break;
+        case OpCode::GET_LOCAL:
+            value = &locals[in.a];
+            break;
+        case OpCode::GET_NAME: {
+            const InlineCache& cache = frame.proto->caches[in.b];
+            if (cache.scope != frame.scope || cache.version != Scope::getShapeVersion()) {
+                return nullptr;
+            }
+            value = cache.binding;
+            break;
+        }
+        default:
+            return nullptr;
+    }
+    return value->isDouble() ? value : nullptr;
+}
+
+// Binary operator of a superinstruction, false when it raises an error the unfused code reports
+static bool fusedOperation(OpCode op, double left, double right, Value& result) {
+    switch (genericForm(op)) {
+        case OpCode::ADD:           result.setDouble(left + right); return true;
+        case OpCode::SUBTRACT:      result.setDouble(left - right); return true;
+        case OpCode::MULTIPLY:      result.setDouble(left * right); return true;
+        case OpCode::DIVIDE:
+            if (right == 0) {
+                return false;
+            }
+            result.setDouble(left / right);
+            return true;
+        case OpCode::MODULO:
+            if (right == 0) {
+                return false;
+            }
+            result.setDouble(fmod(left, right));
+            return true;
+        case OpCode::LESS:          result.setBool(left < right); return true;
+        case OpCode::LESS_EQUAL:    result.setBool(left <= right); return true;
+        case OpCode::GREATER:       result.setBool(left > right); return true;
+        case OpCode::GREATER_EQUAL: result.setBool(left >= right); return true;
+        case OpCode::EQUAL:         result.setBool(left == right); return true;
+        default:                    result.setBool(left != right); return true;
+    }
+}
+
+static bool fusedComparison(OpCode op, double left, double right) {
+    switch (genericForm(op)) {
+        case OpCode::LESS:          return left < right;
+        case OpCode::LESS_EQUAL:    return left <= right;
+        case OpCode::GREATER:       return left > right;
+        case OpCode::GREATER_EQUAL: return left >= right;
+        case OpCode::EQUAL:         return left == right;
+        default:                    return left != right;
+    }
+}
+
+/* Instruction dispatch. With GCC and Clang every handler ends in its own
+indirect jump through a table of label addresses, which branch predictors
+follow far better than the single jump of a switch. Define
+SCRYPT_SWITCH_DISPATCH (or use another compiler) to get the portable switch.*/
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(SCRYPT_SWITCH_DISPATCH)
+#define SCRYPT_THREADED_DISPATCH 1
+#define OPCODE(name) op_##name
+#define DISPATCH() do { in = ip++; goto *dispatchTable[static_cast<size_t>(in->op)]; } while (false)
+#else
+#define OPCODE(name) case OpCode::name
+#define DISPATCH() break
+#endif
+
+/* The interpreter loop. Script calls push a CallFrame and keep looping instead
+of recursing, so the depth of a script is only bounded by maxCallDepth.*/
+void VM::execute() {
+    CallFrame* frame = &frames.back();
+    Instruction* code = frame->proto->code.data();
+    Instruction* ip = frame->ip;
+    Instruction* in = ip;
+    Value* sp = stack.data() + frame->base;
+
+#ifdef SCRYPT_THREADED_DISPATCH
+    // In the order of OpCode
+    static const void* const dispatchTable[] = {
+        &&op_CONSTANT, &&op_NIL, &&op_GET_NAME, &&op_SET_NAME, &&op_UNSET_NAME,
+        &&op_GET_LOCAL, &&op_SET_LOCAL, &&op_UNSET_LOCAL, &&op_POP,
+        &&op_ADD, &&op_SUBTRACT, &&op_MULTIPLY, &&op_DIVIDE, &&op_MODULO,
+        &&op_LESS, &&op_LESS_EQUAL, &&op_GREATER, &&op_GREATER_EQUAL,
+        &&op_EQUAL, &&op_NOT_EQUAL,
+        &&op_ADD_DD, &&op_SUBTRACT_DD, &&op_MULTIPLY_DD, &&op_DIVIDE_DD, &&op_MODULO_DD,
+        &&op_LESS_DD, &&op_LESS_EQUAL_DD, &&op_GREATER_DD, &&op_GREATER_EQUAL_DD,
+        &&op_EQUAL_DD, &&op_NOT_EQUAL_DD,
+        &&op_ADD_UNCHECKED, &&op_SUBTRACT_UNCHECKED, &&op_MULTIPLY_UNCHECKED,
+        &&op_DIVIDE_UNCHECKED, &&op_MODULO_UNCHECKED,
+        &&op_LESS_UNCHECKED, &&op_LESS_EQUAL_UNCHECKED, &&op_GREATER_UNCHECKED,
+        &&op_GREATER_EQUAL_UNCHECKED, &&op_EQUAL_UNCHECKED, &&op_NOT_EQUAL_UNCHECKED,
+        &&op_LOGICAL_AND, &&op_LOGICAL_XOR, &&op_LOGICAL_OR,
+        &&op_LOGICAL_AND_UNCHECKED, &&op_LOGICAL_XOR_UNCHECKED, &&op_LOGICAL_OR_UNCHECKED,
+        &&op_PRINT, &&op_JUMP, &&op_JUMP_IF_FALSE, &&op_JUMP_IF_FALSE_UNCHECKED,
+        &&op_MAKE_FUNCTION, &&op_MAKE_CLOSURE, &&op_CALL, &&op_TAIL_CALL, &&op_CALL_BUILTIN,
+        &&op_RETURN, &&op_RETURN_NULL, &&op_ARRAY, &&op_INDEX, &&op_SET_INDEX, &&op_SET_INDEX_LOCAL,
+        &&op_FAIL,
+        &&op_LOCAL_OPERATE, &&op_LOCAL_BRANCH, &&op_LOCAL_STORE,
+        &&op_NAME_OPERATE, &&op_NAME_BRANCH, &&op_NAME_STORE,
+        &&op_HALT
+    };
+    static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == static_cast<size_t>(OpCode::HALT) + 1,
+                  "dispatch table out of sync with OpCode");
+    DISPATCH();
+#else
+    while (true) {
+        in = ip++;
+        switch (in->op) {
+#endif
+            OPCODE(CONSTANT):
+                *sp++ = frame->proto->constants[in->a];
+                DISPATCH();
+            OPCODE(NIL):
+                *sp++ = Value();
+                DISPATCH();
+            OPCODE(GET_NAME):
+            getName: {
+                InlineCache& cache = frame->proto->caches[in->b];
+                if (cache.scope != frame->scope || cache.version != Scope::getShapeVersion()) {
+                    cache = {frame->scope, 0, lookup(*frame, in->a)};
+                    cache.version = Scope::getShapeVersion();
+                }
+                *sp++ = *cache.binding;
+                DISPATCH();
+            }
+            OPCODE(SET_NAME): {
+                InlineCache& cache = frame->proto->caches[in->b];
+                if (cache.scope == frame->scope && cache.version == Scope::getShapeVersion()) {
+                    *cache.binding = sp[-1];
+                } else {
+                    SymbolId name = frame->proto->names[in->a];
+                    frame->scope->defineVariable(name, sp[-1]);
+                    cache = {frame->scope, Scope::getShapeVersion(), frame->scope->getVariable(name)};
+                }
+                DISPATCH();
+            }
+            OPCODE(UNSET_NAME): {
+                // Names that already existed outside of the loop stay bound
+                std::shared_ptr<Scope> parent = frame->scope->getParent();
+                if (!parent || !parent->hasVariable(frame->proto->names[in->a])) {
+                    frame->scope->eraseVariable(frame->proto->names[in->a]);
+                }
+                DISPATCH();
+            }
+            OPCODE(GET_LOCAL):
+            getLocal: {
+                const Value& local = stack[frame->base + in->a];
+                *sp++ = local.isUndefined() ? *lookup(*frame, in->b) : local;
+                DISPATCH();
+            }
+            OPCODE(SET_LOCAL):
+                stack[frame->base + in->a] = sp[-1];
+                DISPATCH();
+            OPCODE(UNSET_LOCAL):
+                // Names that already existed outside of the loop stay bound
+                if (!frame->scope->hasVariable(frame->proto->names[in->b])) {
+                    stack[frame->base + in->a] = Value::undefined();
+                }
+                DISPATCH();
+            OPCODE(POP):
+                *--sp = Value();
+                DISPATCH();
+            OPCODE(ADD):
+            OPCODE(SUBTRACT):
+            OPCODE(MULTIPLY):
+            OPCODE(DIVIDE):
+            OPCODE(MODULO):
+            OPCODE(LESS):
+            OPCODE(LESS_EQUAL):
+            OPCODE(GREATER):
+            OPCODE(GREATER_EQUAL):
+            OPCODE(EQUAL):
+            OPCODE(NOT_EQUAL): {
+                OpCode op = in->op;
+                // Sites that see two doubles are rewritten to their specialized form
+                if (sp[-2].isDouble() && sp[-1].isDouble() && in->b < MAX_DEOPTIMIZATIONS) {
+                    in->op = specializedForm(op);
+                }
+                Value right = std::move(*--sp);
+                sp[-1] = binaryOperation(op, sp[-1], right);
+                DISPATCH();
+            }
+            OPCODE(ADD_DD):
+            OPCODE(SUBTRACT_DD):
+            OPCODE(MULTIPLY_DD):
+            OPCODE(DIVIDE_DD):
+            OPCODE(MODULO_DD):
+            OPCODE(LESS_DD):
+            OPCODE(LESS_EQUAL_DD):
+            OPCODE(GREATER_DD):
+            OPCODE(GREATER_EQUAL_DD):
+            OPCODE(EQUAL_DD):
+            OPCODE(NOT_EQUAL_DD):
+                if (!sp[-2].isDouble() || !sp[-1].isDouble()) {
+                    // Deoptimize and rerun the instruction in its generic form
+                    in->op = genericForm(in->op);
+                    ++in->b;
+                    --ip;
+                    DISPATCH();
+                }
+                goto doubleOperation;
+            OPCODE(ADD_UNCHECKED):
+            OPCODE(SUBTRACT_UNCHECKED):
+            OPCODE(MULTIPLY_UNCHECKED):
+            OPCODE(DIVIDE_UNCHECKED):
+            OPCODE(MODULO_UNCHECKED):
+            OPCODE(LESS_UNCHECKED):
+            OPCODE(LESS_EQUAL_UNCHECKED):
+            OPCODE(GREATER_UNCHECKED):
+            OPCODE(GREATER_EQUAL_UNCHECKED):
+            OPCODE(EQUAL_UNCHECKED):
+            OPCODE(NOT_EQUAL_UNCHECKED):
+            doubleOperation: {
+                double right = (--sp)->getDouble();
+                Value& left = sp[-1];
+                switch (genericForm(in->op)) {
+                    case OpCode::ADD:           left.setDouble(left.getDouble() + right); break;
+                    case OpCode::SUBTRACT:      left.setDouble(left.getDouble() - right); break;
+                    case OpCode::MULTIPLY:      left.setDouble(left.getDouble() * right); break;
+                    case OpCode::DIVIDE:
+                        if (right == 0) {
+                            throw std::runtime_error("Division by zero.");
+                        }
+                        left.setDouble(left.getDouble() / right);
+                        break;
+                    case OpCode::MODULO:
+                        if (right == 0) {
+                            throw std::runtime_error("Modulo by zero.");
+                        }
+                        left.setDouble(fmod(left.getDouble(), right));
+                        break;
+                    case OpCode::LESS:          left.setBool(left.getDouble() < right); break;
+                    case OpCode::LESS_EQUAL:    left.setBool(left.getDouble() <= right); break;
+                    case OpCode::GREATER:       left.setBool(left.getDouble() > right); break;
+                    case OpCode::GREATER_EQUAL: left.setBool(left.getDouble() >= right); break;
+                    case OpCode::EQUAL:         left.setBool(left.getDouble() == right); break;
+                    default:                    left.setBool(left.getDouble() != right); break;
+                }
+                DISPATCH();
+            }
+            OPCODE(LOGICAL_AND): {
+                Value right = std::move(*--sp);
+                sp[-1] = Value(sp[-1].asBool() && right.asBool());
+                DISPATCH();
+            }
+            OPCODE(LOGICAL_XOR): {
+                Value right = std::move(*--sp);
+                sp[-1] = Value(sp[-1].asBool() != right.asBool());
+                DISPATCH();
+            }
+            OPCODE(LOGICAL_OR): {
+                Value right = std::move(*--sp);
+                sp[-1] = Value(sp[-1].asBool() || right.asBool());
+                DISPATCH();
+            }
+            OPCODE(LOGICAL_AND_UNCHECKED): {
+                bool right = (--sp)->getBool();
+                sp[-1].setBool(sp[-1].getBool() && right);
+                DISPATCH();
+            }
+            OPCODE(LOGICAL_XOR_UNCHECKED): {
+                bool right = (--sp)->getBool();
+                sp[-1].setBool(sp[-1].getBool() != right);
+                DISPATCH();
+            }
+            OPCODE(LOGICAL_OR_UNCHECKED): {
+                bool right = (--sp)->getBool();
+                sp[-1].setBool(sp[-1].getBool() || right);
+                DISPATCH();
+            }
+            OPCODE(PRINT): {
+                Value value = std::move(*--sp);
+                printValue(value);
+                os << std::endl;
+                DISPATCH();
+            }
+            OPCODE(JUMP):
+                ip = code + in->a;
+                DISPATCH();
+            OPCODE(JUMP_IF_FALSE): {
+                Value condition = std::move(*--sp);
+                if (!condition.asBool()) {
+                    ip = code + in->a;
+                }
+                DISPATCH();
+            }
+            OPCODE(JUMP_IF_FALSE_UNCHECKED):
+                if (!(--sp)->getBool()) {
+                    ip = code + in->a;
+                }
+                DISPATCH();
+            OPCODE(MAKE_FUNCTION):
+                *sp++ = Value(Value::Function(frame->proto->functions[in->a], std::make_shared<Scope>(globals)));
+                DISPATCH();
+            OPCODE(MAKE_CLOSURE): {
+                std::shared_ptr<Scope> captured = captureLocals(*frame);
+                if (in->b) {
+                    captured = std::make_shared<Scope>(std::move(captured));
+                }
+                *sp++ = Value(Value::Function(frame->proto->functions[in->a], std::move(captured)));
+                DISPATCH();
+            }
+            OPCODE(CALL): {
+                // The arguments already sit where the parameter slots go,
+                // followed by the callee which becomes the closure slot
+                const Prototype* proto = checkCall(sp[-1], in->a);
+                Value* args = sp - 1 - in->a;
+                MemoCache* memo = nullptr;
+                std::string key;
+                if (memoization && proto->pure && memoKey(args, in->a, key)) {
+                    memo = &memos[proto];
+                    auto hit = memo->index.find(key);
+                    if (hit != memo->index.end()) {
+                        memo->entries.splice(memo->entries.begin(), memo->entries, hit->second);
+                        while (sp > args) {
+                            *--sp = Value();
+                        }
+                        *sp++ = hit->second->second;
+                        DISPATCH();
+                    }
+                }
+                Value result;
+                if (jit && frames.size() < maxCallDepth && callNative(*proto, args, in->a, result)) {
+                    while (sp > args) {
+                        *--sp = Value();
+                    }
+                    if (memo) {
+                        memoize(*memo, std::move(key), result);
+                    }
+                    *sp++ = std::move(result);
+                    DISPATCH();
+                }
+                if (memo) {
+                    pendingMemos.push_back({frames.size() + 1, memo, std::move(key)});
+                }
+                if (frames.size() >= maxCallDepth) {
+                    throw std::runtime_error("Runtime error: stack overflow.");
+                }
+
+                size_t base = static_cast<size_t>(args - stack.data());
+                frame->ip = ip;
+                frames.push_back({proto, proto->code.data(), base, sp[-1].asFunction().capturedScope.get()});
+
+                frame = &frames.back();
+                code = proto->code.data();
+                ip = code;
+                sp = enterFrame(*frame, in->a);
+                DISPATCH();
+            }
+            OPCODE(TAIL_CALL): {
+                // Reuse the current activation record for the callee
+                const Prototype* proto = checkCall(sp[-1], in->a);
+                Value* args = sp - 1 - in->a;
+                Value* base = stack.data() + frame->base;
+                for (size_t i = 0; i <= in->a; ++i) {
+                    base[i] = std::move(args[i]);
+                }
+                while (sp > base + in->a + 1) {
+                    *--sp = Value();
+                }
+
+                frame->proto = proto;
+                frame->scope = base[in->a].asFunction().capturedScope.get();
+                code = proto->code.data();
+                ip = code;
+                sp = enterFrame(*frame, in->a);
+                DISPATCH();
+            }
+            OPCODE(CALL_BUILTIN): {
+                // Builtins read their arguments in place on the value stack
+                Value* args = sp - in->a;
+                Value result = builtins[in->b](args, in->a);
+                while (sp > args) {
+                    *--sp = Value();
+                }
+                *sp++ = std::move(result);
+                DISPATCH();
+            }
+            OPCODE(RETURN):
+            OPCODE(RETURN_NULL): {
+                Value result;
+                if (in->op == OpCode::RETURN) {
+                    result = std::move(*--sp);
+                }
+                if (frames.size() == 1) {
+                    throw std::runtime_error("Runtime error: unexpected return.");
+                }
+                if (!pendingMemos.empty() && pendingMemos.back().depth == frames.size()) {
+                    PendingMemo& pending = pendingMemos.back();
+                    memoize(*pending.cache, std::move(pending.key), result);
+                    pendingMemos.pop_back();
+                }
+                Value* base = stack.data() + frame->base;
+                while (sp > base) {
+                    *--sp = Value();
+                }
+                frames.pop_back();
+
+                frame = &frames.back();
+                code = frame->proto->code.data();
+                ip = frame->ip;
+                *sp++ = std::move(result);
+                DISPATCH();
+            }
+            OPCODE(ARRAY): {
+                std::vector<Value> elements;
+                elements.reserve(in->a);
+                for (Value* element = sp - in->a; element < sp; ++element) {
+                    elements.push_back(element->deepCopy());
+                    *element = Value();
+                }
+                sp -= in->a;
+                *sp++ = Value(std::move(elements));
+                DISPATCH();
+            }
+            OPCODE(INDEX): {
+                Value indexValue = std::move(*--sp);
+                Value arrayValue = std::move(*--sp);
+                size_t index = arrayIndex(indexValue, arrayValue);
+                *sp++ = arrayValue.asArray()[index];
+                DISPATCH();
+            }
+            OPCODE(SET_INDEX):
+            OPCODE(SET_INDEX_LOCAL): {
+                Value indexValue = std::move(*--sp);
+                Value* arrayValuePtr = nullptr;
+                if (in->op == OpCode::SET_INDEX_LOCAL && !stack[frame->base + in->a].isUndefined()) {
+                    arrayValuePtr = &stack[frame->base + in->a];
+                } else {
+                    arrayValuePtr = frame->scope->getVariable(frame->proto->names[in->op == OpCode::SET_INDEX ? in->a : in->b]);
+                }
+                if (!arrayValuePtr || arrayValuePtr->getType() != Value::Type::Array) {
+                    throw std::runtime_error("Runtime error: not an array.");
+                }
+                size_t index = arrayIndex(indexValue, *arrayValuePtr);
+                arrayValuePtr->asArray()[index] = sp[-1];
+                DISPATCH();
+            }
+            OPCODE(FAIL):
+                throw std::runtime_error(frame->proto->messages[in->a]);
+            OPCODE(LOCAL_OPERATE):
+            OPCODE(NAME_OPERATE): {
+                // ip points at the second operand, the operator follows it
+                const Value* locals = stack.data() + frame->base;
+                const Value* left = fusedOperand(*in, unfusedForm(in->op), *frame, locals);
+                const Value* right = left ? fusedOperand(ip[0], ip[0].op, *frame, locals) : nullptr;
+                if (right && fusedOperation(ip[1].op, left->getDouble(), right->getDouble(), *sp)) {
+                    ++sp;
+                    ip += 2;
+                    DISPATCH();
+                }
+                goto unfused;
+            }
+            OPCODE(LOCAL_BRANCH):
+            OPCODE(NAME_BRANCH): {
+                const Value* locals = stack.data() + frame->base;
+                const Value* left = fusedOperand(*in, unfusedForm(in->op), *frame, locals);
+                const Value* right = left ? fusedOperand(ip[0], ip[0].op, *frame, locals) : nullptr;
+                if (right) {
+                    ip = fusedComparison(ip[1].op, left->getDouble(), right->getDouble()) ? ip + 3 : code + ip[2].a;
+                    DISPATCH();
+                }
+                goto unfused;
+            }
+            OPCODE(LOCAL_STORE):
+            OPCODE(NAME_STORE): {
+                Value* locals = stack.data() + frame->base;
+                const Value* left = fusedOperand(*in, unfusedForm(in->op), *frame, locals);
+                const Value* right = left ? fusedOperand(ip[0], ip[0].op, *frame, locals) : nullptr;
+                Value* target = nullptr;
+                if (right && ip[2].op == OpCode::SET_LOCAL) {
+                    target = &locals[ip[2].a];
+                } else if (right) {
+                    const InlineCache& cache = frame->proto->caches[ip[2].b];
+                    if (cache.scope == frame->scope && cache.version == Scope::getShapeVersion()) {
+                        target = cache.binding;
+                    }
+                }
+                if (target && fusedOperation(ip[1].op, left->getDouble(), right->getDouble(), *target)) {
+                    ip += 4;
+                    DISPATCH();
+                }
+                goto unfused;
+            }
+            unfused:
+                // Runs the load the superinstruction was written over, the rest follows as usual
+                if (unfusedForm(in->op) == OpCode::GET_LOCAL) {
+                    goto getLocal;
+                }
+                goto getName;
+            OPCODE(HALT):
+                return;
+#ifndef SCRYPT_THREADED_DISPATCH
+        }
+    }
+#endif
+}
+
+#undef OPCODE
+#undef DISPATCH
+
+// Prints a value the way print statements display it
+void VM::printValue(const Value& value) {
+    switch (value.getType()) {
+        case Value::Type::Double:
+            os << value.asDouble();
+            break;
+
+        case Value::Type::Bool:
+            os << std::boolalpha << value.asBool();
+            break;
+
+        case Value::Type::Null:
+            os << "null";
+            break;
+
+        case Value::Type::Array: {
+            os << "[";
+            const auto& array = value.asArray();
+            for (size_t i = 0; i < array.size(); ++i) {
+                if (i > 0) os << ", ";
+                printValue(array[i]);
+            }
+            os << "]";
+            break;
+        }
+
+        default:
+            os << "/* Unsupported type */";
+            break;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef VM_H
+#define VM_H
+
+#include "Bytecode.h"
+#include "ScryptComponents.h"
+#include "jit.h"
+#include <iostream>
+#include <list>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Activation record of a running script function. Frames live in a heap
+// allocated stack so script recursion never grows the native stack.
+struct CallFrame {
+    const Prototype* proto;
+    Instruction* ip;
+    size_t base;                  // offset of the frame's first local slot on the value stack
+    Scope* scope;                 // scope the function closes over, owned by the closure slot
+};
+
+/* Results of one pure function keyed on its argument values, the least
+recently used entry is evicted once the cache is full.*/
+struct MemoCache {
+    std::list<std::pair<std::string, Value>> entries;     // most recently used first
+    std::unordered_map<std::string, std::list<std::pair<std::string, Value>>::iterator> index;
+};
+
+// A pure call whose result is stored in the memo cache when its frame returns
+struct PendingMemo {
+    size_t depth;
+    MemoCache* cache;
+    std::string key;
+};
+
+// Stack based virtual machine that executes compiled Scrypt programs
+
+class VM {
+public:
+    static const size_t DEFAULT_MAX_CALL_DEPTH = 1000000;
+    static const size_t DEFAULT_MEMO_LIMIT = 4096;
+
+    explicit VM(std::ostream& os = std::cout);
+
+    void defineBuiltin(const std::string& name, Value::FunctionPtr function);
+    const std::vector<std::string>& getBuiltinNames() const;
+    void setMaxCallDepth(size_t depth);
+    void setMemoization(bool enabled, size_t limit = DEFAULT_MEMO_LIMIT);
+    void setJit(bool enabled, uint32_t threshold = Jit::DEFAULT_THRESHOLD);
+    void run(const std::shared_ptr<Prototype>& program);
+
+private:
+    void execute();
+    void ensureStack(size_t size);
+    const Prototype* checkCall(const Value& callee, uint32_t argc);
+    Value* enterFrame(const CallFrame& frame, uint32_t argc);
+    Value* lookup(const CallFrame& frame, uint32_t name);
+    std::shared_ptr<Scope> captureLocals(const CallFrame& frame);
+    bool memoKey(const Value* args, uint32_t argc, std::string& key) const;
+    void memoize(MemoCache& cache, std::string key, const Value& result);
+    bool callNative(const Prototype& proto, const Value* args, uint32_t argc, Value& result);
+    void printValue(const Value& value);
+
+    std::ostream& os;
+    std::shared_ptr<Scope> globals;
+    std::vector<std::string> builtinNames;
+    std::vector<Value::FunctionPtr> builtins;
+    std::vector<Value> stack;
+    std::vector<CallFrame> frames;
+    size_t maxCallDepth;
+    bool memoization;
+    size_t memoLimit;
+    std::unordered_map<const Prototype*, MemoCache> memos;
+    std::vector<PendingMemo> pendingMemos;
+    std::unique_ptr<Jit> jit;
+    uint32_t jitThreshold;
+    std::vector<uint64_t> nativeArgs;
+};
+
+#endif // VM_H
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Runs every tests/*.scr through scrypt and compares what it prints, followed
+# by its exit code, with the matching .out file. A matching .args file holds
+# options to run the script with.
+# usage: tests/run.sh [path to scrypt]
+scrypt=${1:-./scrypt}
+dir=$(dirname "$0")
+failed=0
+for script in "$dir"/*.scr; do
+    expected="${script%.scr}.out"
+    args=$(cat "${script%.scr}.args" 2>/dev/null)
+    actual=$("$scrypt" $args < "$script" 2>&1; echo "exit $?")
+    if [ "$actual" != "$(cat "$expected")" ]; then
+        echo "FAIL $script"
+        echo "$actual" | diff "$expected" - | head -20
+        failed=1
+    fi
+done
+[ $failed = 0 ] && echo "All tests passed"
+exit $failed